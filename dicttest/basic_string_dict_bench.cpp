@@ -0,0 +1,80 @@
+// Lookup and insertion timings of strdict::basic_string_dict against
+// std::unordered_map<std::string, ...>.  Build with optimizations, e.g.
+//
+//     g++ -std=c++17 -O3 -I../include basic_string_dict_bench.cpp -o bench
+//
+// Usage: bench [key_count] [rounds]
+#include "BasicStringDict.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+template <class Func>
+static double time_ns_per_op(std::size_t ops, Func func)
+{
+	auto start = std::chrono::steady_clock::now();
+	func();
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / ops;
+}
+
+int main(int argc, char** argv)
+{
+	std::size_t key_count = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	std::size_t rounds = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 20;
+
+	std::vector<std::string> keys;
+	for(std::size_t i = 0; i < key_count; ++i)
+		keys.push_back("service.key." + std::to_string(i * 7919));
+	// the keys as views into one buffer, like tokens of a parsed request
+	std::string text;
+	for(const auto& key: keys)
+		text += key;
+	std::vector<std::string_view> views;
+	for(std::size_t pos = 0, i = 0; i < key_count; pos += keys[i++].size())
+		views.emplace_back(text.data() + pos, keys[i].size());
+
+	strdict::basic_string_dict<std::size_t> dict;
+	std::unordered_map<std::string, std::size_t> map;
+	double dict_insert = time_ns_per_op(key_count, [&]() {
+		for(std::size_t i = 0; i < key_count; ++i)
+			dict.insert_or_assign(views[i], i);
+	});
+	double map_insert = time_ns_per_op(key_count, [&]() {
+		for(std::size_t i = 0; i < key_count; ++i)
+			map.insert_or_assign(std::string(views[i]), i);
+	});
+
+	std::size_t dict_sum = 0;
+	std::size_t map_sum = 0;
+	double dict_find = time_ns_per_op(key_count * rounds, [&]() {
+		for(std::size_t round = 0; round < rounds; ++round)
+		{
+			for(auto view: views)
+				dict_sum += *dict.find(view);
+		}
+	});
+	// C++17 std::unordered_map can't look up a string_view without a copy
+	double map_find = time_ns_per_op(key_count * rounds, [&]() {
+		for(std::size_t round = 0; round < rounds; ++round)
+		{
+			for(auto view: views)
+				map_sum += map.find(std::string(view))->second;
+		}
+	});
+	if(dict_sum != map_sum)
+	{
+		std::fprintf(stderr, "checksum mismatch\n");
+		return 1;
+	}
+
+	std::printf("%zu keys, %zu rounds\n", key_count, rounds);
+	std::printf("%-26s %8s %8s\n", "", "insert", "find");
+	std::printf("%-26s %6.1fns %6.1fns\n", "basic_string_dict", dict_insert, dict_find);
+	std::printf("%-26s %6.1fns %6.1fns\n", "unordered_map<string, ...>", map_insert, map_find);
+	return 0;
+}
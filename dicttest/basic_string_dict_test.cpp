@@ -0,0 +1,282 @@
+// Tests of the header-only strdict::basic_string_dict.  Built and run by
+// test.py; exits with a non-zero status (or aborts) on failure.
+#undef NDEBUG
+#include "BasicStringDict.h"
+#include <cassert>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using strdict::basic_string_dict;
+
+static std::size_t allocated_bytes = 0;
+
+template <class T>
+struct counting_allocator
+{
+	using value_type = T;
+
+	counting_allocator() = default;
+
+	template <class U>
+	counting_allocator(const counting_allocator<U>&)
+	{
+
+	}
+
+	T* allocate(std::size_t count)
+	{
+		allocated_bytes += count * sizeof(T);
+		return std::allocator<T>().allocate(count);
+	}
+
+	void deallocate(T* ptr, std::size_t count)
+	{
+		allocated_bytes -= count * sizeof(T);
+		std::allocator<T>().deallocate(ptr, count);
+	}
+
+	template <class U>
+	bool operator==(const counting_allocator<U>&) const
+	{ return true; }
+
+	template <class U>
+	bool operator!=(const counting_allocator<U>&) const
+	{ return false; }
+};
+
+// Every key collides, so lookups have to walk whole probe sequences.
+struct constant_hash
+{
+	std::size_t operator()(std::string_view) const
+	{ return 42; }
+};
+
+static std::vector<std::string> keys_of(const basic_string_dict<int>& dict)
+{
+	std::vector<std::string> keys;
+	dict.for_each([&](std::string_view key, const int&) { keys.emplace_back(key); });
+	return keys;
+}
+
+static void test_basics()
+{
+	basic_string_dict<int> dict;
+	assert(dict.empty());
+	assert(dict.insert_or_assign("a", 1).second);
+	assert(dict.try_emplace("b", 2).second);
+	assert(not dict.try_emplace("b", 3).second);
+	assert(not dict.insert_or_assign("a", 4).second);
+	assert(*dict.find("a") == 4);
+	assert(*dict.find("b") == 2);
+	assert(not dict.find("c"));
+	assert(not dict.find(std::string_view("a\0", 2)));
+	dict["c"] += 5;
+	assert(dict.size() == 3);
+	assert((keys_of(dict) == std::vector<std::string>{"a", "b", "c"}));
+	assert(dict.erase("a"));
+	assert(not dict.erase("a"));
+	assert(not dict.contains("a"));
+	dict["a"] = 6;
+	// removed keys lose their place in the order
+	assert((keys_of(dict) == std::vector<std::string>{"b", "c", "a"}));
+	dict.clear();
+	assert(dict.empty() and (dict.bucket_count() == 0));
+	assert(dict.try_emplace("").second);
+	assert(dict.contains(""));
+}
+
+static void test_growth()
+{
+	basic_string_dict<int> dict;
+	for(int i = 0; i < 8; ++i)
+		dict[std::to_string(i)] = i;
+	// small dicts have no buckets
+	assert(dict.bucket_count() == 0);
+	dict["8"] = 8;
+	assert(dict.bucket_count() == 16);
+	for(int i = 9; i < 1000; ++i)
+		dict[std::to_string(i)] = i;
+	for(int i = 0; i < 1000; i += 2)
+		assert(dict.erase(std::to_string(i)));
+	// churn must not fill the table with removed entries
+	for(int round = 0; round < 100; ++round)
+	{
+		assert(dict.try_emplace("x", round).second);
+		assert(dict.erase("x"));
+	}
+	assert(dict.size() == 500);
+	for(int i = 0; i < 1000; ++i)
+		assert(dict.contains(std::to_string(i)) == (i % 2 == 1));
+	auto keys = keys_of(dict);
+	for(std::size_t i = 0; i < keys.size(); ++i)
+		assert(keys[i] == std::to_string(2 * i + 1));
+
+	basic_string_dict<int> reserved;
+	reserved.reserve(1000);
+	auto buckets = reserved.bucket_count();
+	assert(buckets >= 1000 / strdict::table_traits::max_load_factor);
+	for(int i = 0; i < 1000; ++i)
+		reserved[std::to_string(i)] = i;
+	assert(reserved.bucket_count() == buckets);
+}
+
+static void test_collisions()
+{
+	basic_string_dict<int, constant_hash> dict;
+	for(int i = 0; i < 100; ++i)
+		dict[std::to_string(i)] = i;
+	for(int i = 0; i < 100; i += 3)
+		dict.erase(std::to_string(i));
+	for(int i = 0; i < 100; ++i)
+	{
+		const int* value = dict.find(std::to_string(i));
+		assert((value != nullptr) == (i % 3 != 0));
+		assert((not value) or (*value == i));
+	}
+}
+
+static void test_allocator_and_values()
+{
+	{
+		basic_string_dict<std::unique_ptr<int>, std::hash<std::string_view>, counting_allocator<std::unique_ptr<int>>> dict;
+		const std::string long_key(100, 'k');
+		dict.try_emplace(long_key, std::make_unique<int>(1));
+		for(int i = 0; i < 100; ++i)
+			dict.insert_or_assign(std::to_string(i), std::make_unique<int>(i));
+		assert(allocated_bytes > 0);
+		assert(**dict.find(long_key) == 1);
+		assert(**dict.find("99") == 99);
+	}
+	assert(allocated_bytes == 0);
+}
+
+// A table with its values in a vector parallel to the entries, like the
+// unboxed values of a typed strdict.
+struct parallel_entry
+{
+	std::size_t hash;
+	std::string key;
+
+	bool is_empty() const
+	{ return key.empty(); }
+
+	void set_empty()
+	{ key.clear(); }
+};
+
+struct parallel_table:
+	strdict::string_table<parallel_table, parallel_entry>
+{
+	std::vector<int> values;
+	int moves = 0;
+
+	void add(const std::string& key, int value)
+	{
+		std::size_t hash = std::hash<std::string>()(key);
+		auto [bucket, ent] = find_insertion_bucket(hash, [&](const parallel_entry& e) { return e.key == key; });
+		assert(not ent);
+		++occupied;
+		auto action = load_action();
+		entries.push_back(parallel_entry{hash, key});
+		values.push_back(value);
+		link_entry(bucket, entries.size() - 1);
+		resize(action);
+	}
+
+	parallel_entry* find_entry(const std::string& key)
+	{
+		std::size_t hash = std::hash<std::string>()(key);
+		return find_bucket(hash, [&](const parallel_entry& e) { return e.key == key; }).second;
+	}
+
+	int* find(const std::string& key)
+	{
+		parallel_entry* ent = find_entry(key);
+		return ent ? &values[ent - entries.data()] : nullptr;
+	}
+
+	std::size_t entry_hash(const parallel_entry& ent) const
+	{ return ent.hash; }
+
+	void on_entry_moved(std::size_t dest, std::size_t src)
+	{ values[dest] = values[src]; }
+
+	void on_entries_truncated(std::size_t count)
+	{ values.resize(count); }
+
+	void on_entries_moved()
+	{ ++moves; }
+};
+
+static void test_table_policy()
+{
+	parallel_table table;
+	for(int i = 0; i < 8; ++i)
+		table.add("k" + std::to_string(i), i);
+	assert(table.is_small() and (table.moves == 0));
+	table.erase_entry(table.entries[0]);
+	// appends, then compacts the removed entry away without leaving small mode
+	table.add("k8", 8);
+	assert(table.is_small() and (table.moves == 1));
+	assert(table.entries.size() == 8 and table.values.size() == 8);
+	assert(table.entries.front().key == "k1" and table.values.front() == 1);
+	for(int i = 9; i < 100; ++i)
+		table.add("k" + std::to_string(i), i);
+	assert(not table.is_small());
+	for(int i = 1; i < 100; i += 2)
+		table.erase_entry(*table.find_entry("k" + std::to_string(i)));
+	int moves = table.moves;
+	table.rehash(table.bucket_count());
+	assert(table.moves == moves + 1);
+	assert(table.values.size() == table.entries.size());
+	for(int i = 1; i < 100; ++i)
+	{
+		const int* value = table.find("k" + std::to_string(i));
+		assert((value != nullptr) == (i % 2 == 0));
+		assert((not value) or (*value == i));
+	}
+}
+
+// Random operations, checked against std::unordered_map.
+static void test_random()
+{
+	std::mt19937 rng(1234);
+	basic_string_dict<int> dict;
+	std::unordered_map<std::string, int> expected;
+	for(int i = 0; i < 20000; ++i)
+	{
+		std::string key = std::to_string(rng() % 500);
+		switch(rng() % 3)
+		{
+		case 0:
+			dict.insert_or_assign(key, i);
+			expected[key] = i;
+			break;
+		case 1:
+			assert(dict.erase(key) == (expected.erase(key) == 1));
+			break;
+		default:
+			const int* value = dict.find(key);
+			auto pos = expected.find(key);
+			assert((value != nullptr) == (pos != expected.end()));
+			assert((not value) or (*value == pos->second));
+		}
+		assert(dict.size() == expected.size());
+	}
+}
+
+int main()
+{
+	test_basics();
+	test_growth();
+	test_collisions();
+	test_allocator_and_values();
+	test_table_policy();
+	test_random();
+	std::puts("OK");
+	return 0;
+}
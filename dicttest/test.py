@@ -1,12 +1,49 @@
 import collections
 import collections.abc
+import ctypes
 import gc
+import hashlib
 import random
+import shlex
+import shutil
 import string
+import subprocess
 import sys
+import sysconfig
+import os
+import pickle
+import struct
+import tempfile
+import time
+import tracemalloc
 import unittest
 import weakref
-from StringDict import strdict
+from StringDict import strdict, strdefaultdict, mapped_strdict, strdict_key, strdict_chain
+
+def strdict_capi():
+    """The StringDict._C_API function table, callable through ctypes."""
+    get_pointer = ctypes.pythonapi.PyCapsule_GetPointer
+    get_pointer.restype = ctypes.c_void_p
+    get_pointer.argtypes = [ctypes.py_object, ctypes.c_char_p]
+    obj = ctypes.py_object
+    ssize = ctypes.c_ssize_t
+    key = [ctypes.c_char_p, ssize, ctypes.c_int]
+    func = ctypes.PYFUNCTYPE
+    class CAPI(ctypes.Structure):
+        _fields_ = [
+            ('version', ctypes.c_int),
+            ('Check', func(ctypes.c_int, obj)),
+            ('GetVersion', func(ctypes.c_uint64, obj)),
+            ('Size', func(ssize, obj)),
+            ('Reserve', func(ctypes.c_int, obj, ssize)),
+            ('Lookup', func(ctypes.c_int, obj, *key, ctypes.POINTER(obj))),
+            ('Hash', func(ssize, *key)),
+            ('LookupHashed', func(ctypes.c_int, obj, *key, ssize, ctypes.POINTER(obj))),
+            ('SetItem', func(ctypes.c_int, obj, *key, obj)),
+            ('DelItem', func(ctypes.c_int, obj, *key)),
+            ('Next', func(ctypes.c_int, obj, ctypes.POINTER(ssize), ctypes.POINTER(obj), ctypes.POINTER(obj))),
+        ]
+    return CAPI.from_address(get_pointer(sys.modules['StringDict']._C_API, b'StringDict._C_API'))
 
 class DictTest(unittest.TestCase):
 
@@ -590,6 +627,446 @@ class DictTest(unittest.TestCase):
             g['42']
         self.assertEqual(c.exception.args, ('42',))
 
+    def test_missing_redefined(self):
+        class D(strdict):
+            def __missing__(self, key):
+                return 1
+        d = D()
+        self.assertEqual(d['a'], 1)
+        D.__missing__ = lambda self, key: 2
+        self.assertEqual(d['a'], 2)
+        del D.__missing__
+        self.assertRaises(KeyError, d.__getitem__, 'a')
+        D.__missing__ = staticmethod(lambda key: key * 2)
+        self.assertEqual(d['a'], 'aa')
+
+    def test_small_dict_churn(self):
+        rng = random.Random(7)
+        for limit in (4, 8, 9, 12, 40):
+            d = strdict()
+            expected = {}
+            for i in range(2000):
+                key = str(rng.randrange(limit))
+                op = rng.random()
+                if op < 0.5:
+                    d[key] = expected[key] = i
+                elif op < 0.8:
+                    self.assertEqual(d.pop(key, None), expected.pop(key, None))
+                elif op < 0.9:
+                    self.assertEqual(d.setdefault(key, i), expected.setdefault(key, i))
+                elif op < 0.99:
+                    self.assertEqual(d.get(key), expected.get(key))
+                else:
+                    d.clear()
+                    expected.clear()
+                self.assertEqual(len(d), len(expected))
+            self.assertEqual(d, expected)
+            self.assertEqual(sorted(d.keys()), sorted(expected.keys()))
+            if limit <= 8:
+                # never leaves small mode, which keeps the insertion order
+                self.assertEqual(list(d.keys()), list(expected.keys()))
+
+    def test_small_dict_order(self):
+        d = strdict(a=1, b=2)
+        del d['a']
+        d['c'] = 3
+        self.assertEqual(list(d.keys()), ['b', 'c'])
+        d['a'] = 4
+        self.assertEqual(list(d.items()), [('b', 2), ('c', 3), ('a', 4)])
+        d = strdict((str(i), i) for i in range(8))
+        del d['0']
+        d['x'] = 8
+        self.assertEqual(list(d.keys()), [str(i) for i in range(1, 8)] + ['x'])
+        t = strdict(a=1, b=2, value_type='i8')
+        del t['a']
+        t['c'] = 3
+        self.assertEqual(list(t.items()), [('b', 2), ('c', 3)])
+        self.assertEqual(bytes(t), struct.pack('2q', 2, 3))
+
+    def test_update_reserves(self):
+        d = strdict({str(i): i for i in range(100)})
+        d.update({str(i): i for i in range(100, 1000)})
+        self.assertEqual(len(d), 1000)
+        self.assertEqual(d, {str(i): i for i in range(1000)})
+
+    def test_key_width_structured(self):
+        # Keys that only differ in a few bytes, such as big-endian counters,
+        # must still spread over the table.  With colliding probe sequences
+        # this takes minutes instead of milliseconds.
+        n = 100000
+        keys = [b'\0' * 8 + i.to_bytes(8, 'big') for i in range(n)]
+        start = time.perf_counter()
+        d = strdict(((k, i) for i, k in enumerate(keys)), key_width=16)
+        self.assertEqual(sum(d[k] for k in keys), n * (n - 1) // 2)
+        self.assertLess(time.perf_counter() - start, 5.0)
+        keys = [i.to_bytes(4, 'little') for i in range(0, n << 8, 256)]
+        d = strdict(((k, i) for i, k in enumerate(keys)), key_width=4)
+        self.assertEqual(d[keys[-1]], n - 1)
+        self.assertLess(time.perf_counter() - start, 5.0)
+
+    def test_key_width(self):
+        keys = [hashlib.md5(str(i).encode()).digest() for i in range(1000)]
+        d = strdict(((k, i) for i, k in enumerate(keys)), key_width=16)
+        self.assertEqual(d.key_width, 16)
+        self.assertIsNone(strdict().key_width)
+        self.assertEqual(len(d), 1000)
+        self.assertEqual(d[keys[10]], 10)
+        self.assertEqual(d[bytearray(keys[10])], 10)
+        self.assertEqual(d, {k: i for i, k in enumerate(keys)})
+        self.assertEqual(d, strdict({k: i for i, k in enumerate(keys)}))
+        self.assertEqual(strdict({k: i for i, k in enumerate(keys)}), d)
+        self.assertNotIn(b'short', d)
+        self.assertNotIn('x' * 16, d)
+        self.assertIsNone(d.get(b'short'))
+        with self.assertRaises(ValueError):
+            d[b'short'] = 1
+        with self.assertRaises(TypeError):
+            d['x' * 16] = 1
+        self.assertEqual(len(d), 1000)
+        del d[keys[0]]
+        self.assertNotIn(keys[0], d)
+        self.assertEqual(d.pop(keys[1]), 1)
+        e = strdict(key_width=4)
+        e.update({b'abcd': 1, b'efgh': 2})
+        with self.assertRaises(ValueError):
+            e.update({b'abc': 3})
+        self.assertEqual(e, {b'abcd': 1, b'efgh': 2})
+        for copied in (d.copy(), pickle.loads(pickle.dumps(d))):
+            self.assertEqual(copied.key_width, 16)
+            self.assertEqual(copied, d)
+        with self.assertRaises(ValueError):
+            d.__init__(key_width=8)
+        d.clear()
+        d.__init__(key_width=8)
+        self.assertEqual(d.key_width, 8)
+        d[b'12345678'] = 1
+        self.assertEqual(list(d.keys()), [b'12345678'])
+        with self.assertRaises(ValueError):
+            strdict(key_width=-1)
+
+    def test_compact_keys(self):
+        keys = ['key%d' % i for i in range(50)] + ['\u20ac%d' % i for i in range(50)] \
+            + ['\U0001f600 emoji %d' % i for i in range(50)] + ['\u4e2d\u6587%d' % i for i in range(50)] \
+            + ['caf\xe9', b'raw', '', '\ud800', '\U0001f600\ud800 lone surrogate']
+        expected = {k: i for i, k in enumerate(keys)}
+        d = strdict(compact_keys=True)
+        self.assertTrue(d.compact_keys)
+        self.assertFalse(strdict().compact_keys)
+        for k, v in expected.items():
+            d[k] = v
+        self.assertEqual(len(d), len(keys))
+        for k, v in expected.items():
+            self.assertIn(k, d)
+            self.assertEqual(d[k], v)
+        self.assertNotIn('\u20ac', d)
+        self.assertNotIn('\u20ac10x', d)
+        self.assertEqual(d, expected)
+        self.assertEqual(d, strdict(expected))
+        self.assertEqual(strdict(expected), d)
+        self.assertEqual(sorted(d.keys(), key=repr), sorted(keys, key=repr))
+        self.assertEqual(dict(d.items()), expected)
+        self.assertIsNot(d.keys()[0], d.keys()[0])
+        self.assertEqual(repr(strdict({'\u20ac': 1}, compact_keys=True)), "strdict({'\u20ac': 1})")
+        self.assertEqual(d.sorted_items(), strdict(expected).sorted_items())
+        self.assertEqual(strdict(d), expected)
+        for copied in (d.copy(), pickle.loads(pickle.dumps(d))):
+            self.assertTrue(copied.compact_keys)
+            self.assertEqual(copied, expected)
+        del d['\u20ac7']
+        self.assertNotIn('\u20ac7', d)
+        self.assertEqual(d.pop('\U0001f600 emoji 3'), 103)
+        with self.assertRaises(ValueError):
+            strdict(compact_keys=True, prefix_index=True)
+        with self.assertRaises(ValueError):
+            d.__init__(compact_keys=False)
+
+    def test_compact_keys_memory(self):
+        def traced_size(**options):
+            tracemalloc.start()
+            try:
+                d = strdict(((('\u20ac%d' % i) * 4, i) for i in range(1000)), **options)
+                return tracemalloc.get_traced_memory()[0]
+            finally:
+                tracemalloc.stop()
+        self.assertLess(traced_size(compact_keys=True) * 4, traced_size())
+
+    def test_key_handles(self):
+        Key = strdict.Key
+        self.assertIs(Key, strdict_key)
+        k = Key('abc')
+        self.assertEqual(k.key, 'abc')
+        self.assertEqual(hash(k), hash('abc'))
+        self.assertEqual(k, 'abc')
+        self.assertEqual(k, Key('abc'))
+        self.assertNotEqual(k, Key(b'abc'))
+        self.assertIs(Key(k), k)
+        self.assertEqual(repr(k), "strdict.Key('abc')")
+        buf = bytearray(b'xyz')
+        kb = Key(buf)
+        buf[0] = ord('q')
+        self.assertEqual(kb.key, b'xyz')
+        self.assertRaises(TypeError, Key, 1)
+
+        dicts = [strdict(abc=i) for i in range(5)] + [strdict({b'xyz': 'b'}), strdict(compact_keys=True, abc='c')]
+        self.assertEqual([d.get(k) for d in dicts], [0, 1, 2, 3, 4, None, 'c'])
+        self.assertEqual([kb in d for d in dicts], [False] * 5 + [True, False])
+        d = dicts[0]
+        d[Key('\u20ac')] = 5
+        self.assertEqual(d['\u20ac'], 5)
+        self.assertEqual(d.setdefault(Key('abc'), 9), 0)
+        self.assertEqual(d.pop(Key('\u20ac')), 5)
+        with self.assertRaises(KeyError) as cm:
+            d[Key('missing')]
+        self.assertEqual(cm.exception.args, ('missing',))
+        self.assertEqual(strdict({b'xyz': 1}, key_width=3)[kb], 1)
+
+    def test_chain(self):
+        self.assertIs(strdict.chain, strdict_chain)
+        top = strdict(a=1)
+        mid = strdict(compact_keys=True, a=2, b=2, c='\u20ac')
+        base = strdict({'b': 3, 'd': 3, b'e': 3}, value_type='i8')
+        c = strdict.chain(top, mid, base)
+        self.assertEqual(c.maps, (top, mid, base))
+        self.assertEqual((c['a'], c['b'], c['c'], c['d'], c[b'e']), (1, 2, '\u20ac', 3, 3))
+        self.assertEqual(c[strdict.Key('d')], 3)
+        self.assertEqual(c.get('x', 0), 0)
+        self.assertIsNone(c.get('x'))
+        self.assertNotIn('e', c)
+        with self.assertRaises(KeyError) as cm:
+            c[strdict.Key('x')]
+        self.assertEqual(cm.exception.args, ('x',))
+        self.assertRaises(TypeError, c.__getitem__, 1)
+        self.assertEqual(len(c), 5)
+        self.assertEqual(c.keys(), ['a', 'b', 'c', 'd', b'e'])
+        self.assertEqual(c.items(), [('a', 1), ('b', 2), ('c', '\u20ac'), ('d', 3), (b'e', 3)])
+        self.assertEqual(c.values(), [1, 2, '\u20ac', 3, 3])
+
+        # lookups are memoized, so changes to any map must invalidate them
+        del mid['b']
+        self.assertEqual(c['b'], 3)
+        top['b'] = 1
+        self.assertEqual(c['b'], 1)
+        base['d'] = 4
+        self.assertEqual(c['d'], 4)
+        for i in range(100):
+            base[str(i)] = i
+        self.assertEqual([c[str(i)] for i in range(100)], list(range(100)))
+        self.assertEqual((c['a'], c['b'], c['d']), (1, 1, 4))
+        mid.clear()
+        self.assertEqual((c['a'], c['b']), (1, 1))
+        self.assertNotIn('c', c)
+
+        c['z'] = 26
+        self.assertEqual(top['z'], 26)
+        del c['a']
+        self.assertNotIn('a', top)
+        self.assertRaises(KeyError, c.__delitem__, 'd')
+        self.assertEqual(len(strdict.chain()), 0)
+        self.assertRaises(KeyError, strdict.chain().__setitem__, 'a', 1)
+        self.assertRaises(TypeError, strdict.chain, {})
+        self.assertEqual(repr(strdict.chain(strdict(a=1))), "strdict.chain(strdict({'a': 1}))")
+        c = strdict.chain(top)
+        top['self'] = c
+        self.assertIn('strdict.chain(...)', repr(c))
+        del top['self']
+
+    def test_chain_after_reserve(self):
+        # update() reserves space, which may reallocate the entries without
+        # adding or removing keys
+        keys = {'k%d' % i: i for i in range(20)}
+        d = strdict(keys)
+        c = strdict.chain(d)
+        self.assertEqual(c['k5'], 5)
+        d.update(keys)
+        self.assertEqual(c['k5'], 5)
+        small = strdict(a=1)
+        c = strdict.chain(small)
+        self.assertEqual(c['a'], 1)
+        small.update(b=2, c=3)
+        self.assertEqual((c['a'], c['b']), (1, 2))
+
+    def test_slot(self):
+        d = strdict(hits=0, flag=False)
+        s = d.slot('hits')
+        self.assertEqual(s.key, 'hits')
+        self.assertEqual(repr(s), "<strdict slot 'hits'>")
+        for _ in range(5):
+            s.set(s.get() + 1)
+        self.assertEqual(d['hits'], 5)
+        d['hits'] = 7
+        self.assertEqual(s.get(), 7)
+        # adding and removing keys moves entries around
+        for i in range(100):
+            d[str(i)] = i
+        self.assertEqual(s.get(), 7)
+        del d['flag']
+        self.assertEqual(s.get(), 7)
+        del d['hits']
+        self.assertIsNone(s.get())
+        self.assertEqual(s.get(0), 0)
+        s.set(1)
+        self.assertEqual(d['hits'], 1)
+        d.clear()
+        self.assertIsNone(s.get())
+
+        m = d.slot(strdict.Key('missing'))
+        self.assertEqual(m.key, 'missing')
+        self.assertEqual(m.get(-1), -1)
+        m.set('x')
+        self.assertEqual(d['missing'], 'x')
+        self.assertEqual(d.slot(bytearray(b'b')).key, b'b')
+        self.assertRaises(TypeError, d.slot, 1)
+
+        t = strdict(a=1.5, value_type='f8')
+        s = t.slot('a')
+        s.set(s.get() * 2)
+        self.assertEqual(t['a'], 3.0)
+        self.assertRaises(TypeError, s.set, 'x')
+        w = strdict({b'abcd': 1}, key_width=4)
+        self.assertEqual(w.slot(b'abcd').get(), 1)
+        self.assertRaises(ValueError, w.slot, b'abc')
+        c = strdict(compact_keys=True)
+        s = c.slot('\u20ac')
+        s.set(1)
+        self.assertEqual(c['\u20ac'], 1)
+        self.assertEqual(s.get(), 1)
+
+    def test_slot_after_reserve(self):
+        # update() reserves space, which compacts the entries without adding
+        # or removing keys
+        d = strdict(('k%d' % i, i) for i in range(21))
+        del d['k0']
+        s = d.slot('k20')
+        self.assertEqual(s.get(), 20)
+        d.update({'k%d' % i: i for i in range(1, 21)})
+        self.assertEqual(s.get(), 20)
+        s.set(-1)
+        self.assertEqual(d['k20'], -1)
+
+    def test_version(self):
+        d = strdict(a=1)
+        e = strdict(a=1)
+        self.assertNotEqual(d.version, e.version)
+        versions = [d.version]
+        def check_changed():
+            self.assertGreater(d.version, versions[-1])
+            versions.append(d.version)
+        d['b'] = 2
+        check_changed()
+        d['b'] = 3
+        check_changed()
+        d.get('b')
+        'a' in d
+        self.assertEqual(d.version, versions[-1])
+        d.increment('b', 1)
+        check_changed()
+        del d['a']
+        check_changed()
+        d.setdefault('b', 0)
+        self.assertEqual(d.version, versions[-1])
+        d.clear()
+        check_changed()
+        self.assertNotEqual(d.copy().version, d.version)
+        t = strdict(a=1, value_type='i8')
+        v = t.version
+        t['a'] = 2
+        self.assertGreater(t.version, v)
+        v = t.version
+        with memoryview(t) as m:
+            m[0] = 5
+        self.assertGreater(t.version, v)
+
+        # the same version through the capsule
+        api = strdict_capi()
+        self.assertTrue(api.Check(d))
+        self.assertFalse(api.Check({}))
+        self.assertEqual(api.GetVersion(d), d.version)
+
+    def test_capi(self):
+        api = strdict_capi()
+        self.assertGreaterEqual(api.version, 2)
+        d = strdict({'caf\xe9': 1, b'abc': 2, '\u20ac': 3})
+        self.assertEqual(api.Size(d), 3)
+        def key_args(key):
+            if isinstance(key, bytes):
+                return key, len(key), 0
+            width = max(1, (max(map(ord, key), default=0).bit_length() + 7) // 8)
+            kind, encoding = {1: (1, 'latin-1'), 2: (2, 'utf-16-le')}.get(width, (3, 'utf-32-le'))
+            return key.encode(encoding), len(key), kind
+        value = ctypes.py_object()
+        for key in ('caf\xe9', b'abc', '\u20ac'):
+            self.assertEqual(api.Lookup(d, *key_args(key), ctypes.byref(value)), 1)
+            self.assertEqual(value.value, d[key])
+            hash_value = api.Hash(*key_args(key))
+            self.assertEqual(hash_value, hash(key))
+            self.assertEqual(api.LookupHashed(d, *key_args(key), hash_value, ctypes.byref(value)), 1)
+            self.assertEqual(value.value, d[key])
+        self.assertEqual(api.Lookup(d, *key_args(b'x'), ctypes.byref(value)), 0)
+        # str keys are narrowed unless they're prehashed
+        self.assertEqual(api.Lookup(d, 'caf\xe9'.encode('utf-32-le'), 4, 3, ctypes.byref(value)), 1)
+        self.assertEqual(api.Lookup(d, b'abc', 3, 1, ctypes.byref(value)), 0)
+        self.assertEqual(api.SetItem(d, *key_args('new'), 4), 0)
+        self.assertEqual(d['new'], 4)
+        self.assertEqual(api.SetItem(d, 'x'.encode('utf-16-le'), 1, 2, 5), 0)
+        self.assertEqual(d['x'], 5)
+        self.assertEqual(api.DelItem(d, *key_args(b'abc')), 1)
+        self.assertEqual(api.DelItem(d, *key_args(b'abc')), 0)
+        self.assertNotIn(b'abc', d)
+        with self.assertRaises(ValueError):
+            api.Lookup(d, b'', 0, 7, ctypes.byref(value))
+        self.assertEqual(api.Reserve(d, 1000), 0)
+        items = []
+        pos = ctypes.c_ssize_t(0)
+        key = ctypes.py_object()
+        while api.Next(d, ctypes.byref(pos), ctypes.byref(key), ctypes.byref(value)):
+            items.append((key.value, value.value))
+        self.assertEqual(items, d.items())
+        t = strdict(a=1, value_type='i8')
+        self.assertEqual(api.Lookup(t, *key_args('a'), ctypes.byref(value)), 1)
+        self.assertEqual(value.value, 1)
+        with self.assertRaises(TypeError):
+            api.SetItem(t, *key_args('b'), 'x')
+        w = strdict(key_width=4)
+        self.assertEqual(api.SetItem(w, *key_args(b'abcd'), 1), 0)
+        self.assertEqual(api.Lookup(w, *key_args(b'abcd'), ctypes.byref(value)), 1)
+        self.assertEqual(api.Lookup(w, *key_args(b'abc'), ctypes.byref(value)), 0)
+        with self.assertRaises(ValueError):
+            api.SetItem(w, *key_args(b'abc'), 1)
+
+    def test_gc_tracking(self):
+        d = strdict(a=1, b='x', c=(1, 2))
+        self.assertFalse(gc.is_tracked(d))
+        d['d'] = []
+        self.assertTrue(gc.is_tracked(d))
+        del d['d']
+        self.assertTrue(gc.is_tracked(d))
+        self.assertFalse(gc.is_tracked(d.copy()))
+        d.clear()
+        self.assertFalse(gc.is_tracked(d))
+        d.setdefault('e', {})
+        self.assertTrue(gc.is_tracked(d))
+        self.assertTrue(gc.is_tracked(strdict(a=[]).copy()))
+        self.assertTrue(gc.is_tracked(pickle.loads(pickle.dumps(strdict(a=[1])))))
+        self.assertFalse(gc.is_tracked(strdict(value_type='i8', a=1)))
+
+        class D(strdict):
+            pass
+        self.assertTrue(gc.is_tracked(D()))
+
+    def test_gc_untracked_cycle(self):
+        class Obj:
+            pass
+        obj = Obj()
+        ref = weakref.ref(obj)
+        d = strdict()
+        inner = {}
+        d['inner'] = inner
+        inner['d'] = d
+        inner['obj'] = obj
+        del d, inner, obj
+        gc.collect()
+        self.assertIsNone(ref())
+
     def test_tuple_keyerror(self):
         # SF #1576657
         d = strdict({})
@@ -763,6 +1240,841 @@ class DictTest(unittest.TestCase):
         self.assertTrue(a == b)
         self.assertFalse(a != b)
 
+    def test_pickle(self):
+        d = strdict({'a': 1, 'b': [2], '\u20ac': 'euro', '\U0001f600': None, b'raw': 3.5})
+        d[bytearray(b'buf')] = 4
+        del d['a']
+        for proto in range(pickle.HIGHEST_PROTOCOL + 1):
+            e = pickle.loads(pickle.dumps(d, proto))
+            self.assertIs(type(e), strdict)
+            self.assertEqual(e, d)
+            self.assertEqual(list(e.keys()), list(d.keys()))
+            self.assertEqual(repr(e), repr(d))
+            self.assertIn(b'buf', e)
+            self.assertNotIn('buf', e)
+            self.assertNotIn('raw', e)
+            e['new'] = 5
+            self.assertEqual(e['new'], 5)
+
+    def test_setstate_rehash(self):
+        d = strdict((str(i), i) for i in range(1000))
+        keys, values = d.__getstate__()
+        # a different fingerprint means the dump came from another hash seed
+        keys = bytearray(keys)
+        keys[16:24] = struct.pack('q', struct.unpack('q', keys[16:24])[0] ^ 1)
+        e = strdict(x=1)
+        e.__setstate__((bytes(keys), values))
+        self.assertEqual(e, d)
+        for i in range(1000):
+            self.assertEqual(e[str(i)], i)
+
+    def test_setstate_used_dict(self):
+        state = strdict(a0=0, a1=1, a2=2, value_type='i8').__reduce__()[2]
+        d = strdict()
+        d['x'] = 1
+        del d['x']
+        d.__setstate__(state)
+        self.assertEqual(d.value_type, 'i8')
+        self.assertEqual(list(d.items()), [('a0', 0), ('a1', 1), ('a2', 2)])
+        e = strdict((str(i), i) for i in range(100))
+        for i in range(100):
+            del e[str(i)]
+        e.__setstate__(state)
+        self.assertEqual(list(e.items()), [('a0', 0), ('a1', 1), ('a2', 2)])
+        self.assertEqual(bytes(e), struct.pack('3q', 0, 1, 2))
+
+    def test_setstate_invalid(self):
+        keys, values = strdict(a=1, b=2).__getstate__()
+        d = strdict(c=3)
+        self.assertRaises(ValueError, d.__setstate__, (keys, [1]))
+        self.assertRaises(ValueError, d.__setstate__, (keys[:-1], values))
+        self.assertRaises(ValueError, d.__setstate__, (b'x' + keys, values))
+        self.assertEqual(len(d), 0)
+
+    def test_setstate_duplicate_keys(self):
+        # crafted state repeating a key record must not create two entries
+        for n in (1, 20):
+            keys, values = strdict((str(i), i) for i in range(n)).__getstate__()
+            header, records = keys[:32], keys[32:]
+            record = strdict({'0': 0}).__getstate__()[0][32:]
+            header = header[:24] + struct.pack('Q', n + 1)
+            d = strdict(x=1)
+            with self.assertRaisesRegex(ValueError, 'duplicate'):
+                d.__setstate__((header + records + record, values + [0]))
+            self.assertEqual(len(d), 0)
+            d['0'] = 5
+            self.assertEqual(d, {'0': 5})
+
+    def test_pickle_subclass(self):
+        e = pickle.loads(pickle.dumps(PicklableSubclass(a=1)))
+        self.assertIs(type(e), PicklableSubclass)
+        self.assertEqual(e, strdict(a=1))
+        d = PicklableSubclass(a=1)
+        d.attr = 'value'
+        e = pickle.loads(pickle.dumps(d))
+        self.assertEqual(e.attr, 'value')
+
+    def test_delete_and_grow(self):
+        d = strdict()
+        for i in range(1000):
+            d[str(i)] = i
+            del d[str(i)]
+            d['k' + str(i)] = i
+        self.assertEqual(set(d.keys()), {'k' + str(i) for i in range(1000)})
+        self.assertEqual(len(d), 1000)
+        for i in range(1000):
+            self.assertNotIn(str(i), d)
+            self.assertEqual(d['k' + str(i)], i)
+
+    def test_construct_from_strdict(self):
+        d = strdict(strdict(a=1, b=2), c=3)
+        self.assertEqual(d, {'a': 1, 'b': 2, 'c': 3})
+        d.update(strdict(a=4))
+        self.assertEqual(d['a'], 4)
+
+    def test_setitem_refcount(self):
+        value = object()
+        before = sys.getrefcount(value)
+        d = strdict()
+        for i in range(10):
+            d['a'] = value
+        d.update([('b', value)])
+        d.update(c=value)
+        d.update(c=value)
+        self.assertEqual(sys.getrefcount(value), before + 3)
+        del d
+        self.assertEqual(sys.getrefcount(value), before)
+
+    def test_setdefault_reuses_deleted_slot(self):
+        d = strdict(a=1)
+        del d['a']
+        self.assertEqual(d.setdefault('a', 2), 2)
+        self.assertEqual(len(d), 1)
+        self.assertEqual(d, {'a': 2})
+
+    def test_increment(self):
+        d = strdict()
+        self.assertEqual(d.increment('a'), 1)
+        self.assertEqual(d.increment('a', 5), 6)
+        self.assertEqual(d.increment(b'b', delta=-2), -2)
+        self.assertEqual(d.increment('c', 2**70), 2**70)
+        self.assertEqual(d.increment('c', 2**70), 2**71)
+        self.assertEqual(d.increment('f', 0.5), 0.5)
+        self.assertEqual(d.increment('f'), 1.5)
+        self.assertEqual(d, {'a': 6, b'b': -2, 'c': 2**71, 'f': 1.5})
+        d['s'] = 'x'
+        self.assertRaises(TypeError, d.increment, 's')
+        self.assertRaises(TypeError, d.increment, 1)
+        self.assertRaises(TypeError, d.increment, 'l', [1])
+        self.assertNotIn('l', d)
+        self.assertEqual(d.increment('z', 0.0), 0.0)
+        self.assertEqual(d.increment('t', True), 1)
+        self.assertIs(type(d['t']), int)
+
+    def test_increment_mutating_add(self):
+        class Evil(int):
+            def __add__(self, other):
+                d.clear()
+                for i in range(100):
+                    d[str(i)] = i
+                return 42
+        d = strdict(a=Evil(1))
+        self.assertEqual(d.increment('a'), 42)
+        self.assertEqual(d['a'], 42)
+        self.assertEqual(len(d), 101)
+
+        class Radd:
+            def __radd__(self, other):
+                for i in range(1000):
+                    d['k%d' % i] = i
+                return 'r'
+        d = strdict()
+        self.assertEqual(d.increment('a', Radd()), 'r')
+        self.assertEqual(d['a'], 'r')
+        self.assertEqual(len(d), 1001)
+
+    def test_increment_reentrant_unboxing(self):
+        class Index:
+            def __index__(self):
+                d.clear()
+                for i in range(1000):
+                    d['k%d' % i] = i
+                return 3
+        d = strdict(value_type='i8')
+        self.assertEqual(d.increment('a', Index()), 3)
+        self.assertEqual(d.increment('a', Index()), 3)
+        self.assertEqual(len(d), 1001)
+
+    def test_count(self):
+        words = 'the quick brown fox jumps over the lazy dog the end'.split()
+        d = strdict()
+        d.count(words)
+        d.count(iter(['fox']))
+        self.assertEqual(d, dict(collections.Counter(words + ['fox'])))
+        self.assertRaises(TypeError, d.count, ['a', 1])
+        self.assertEqual(d['a'], 1)
+        self.assertRaises(TypeError, d.count, 5)
+
+    def test_from_buffer(self):
+        data = b'apple\t1\nbanana\t2\n\ncherry\t3\napple\t4\n'
+        d = strdict.from_buffer(data)
+        self.assertIs(type(d), strdict)
+        self.assertEqual(d, {b'apple': b'4', b'banana': b'2', b'cherry': b'3'})
+        self.assertEqual(d.keys(), [b'apple', b'banana', b'cherry'])
+        self.assertEqual(hash(d.keys()[0]), hash(b'apple'))
+        d = strdict.from_buffer(bytearray(data), value_parser=int, decode_keys=True)
+        self.assertEqual(d, {'apple': 4, 'banana': 2, 'cherry': 3})
+        d = strdict.from_buffer(b'a=1.5;b= 2 ;c=-7;d=1_000', line_sep=b';', kv_sep=b'=', value_parser=float)
+        self.assertEqual(d, {b'a': 1.5, b'b': 2.0, b'c': -7.0, b'd': 1000.0})
+        d = strdict.from_buffer(b'x\t1\r\ny\t99999999999999999999\r\n', line_sep=b'\r\n', value_parser=int)
+        self.assertEqual(d, {b'x': 1, b'y': 99999999999999999999})
+        d = strdict.from_buffer('caf\xe9\tx\n\u20ac\ty'.encode(), decode_keys=True, value_parser=bytes.decode)
+        self.assertEqual(d, {'caf\xe9': 'x', '\u20ac': 'y'})
+        self.assertEqual(len(strdict.from_buffer(b'')), 0)
+
+    def test_from_buffer_typed(self):
+        lines = b''.join(b'k%d\t%d\n' % (i, i * 3) for i in range(1000))
+        d = strdict.from_buffer(lines, value_parser=int, value_type='i8', decode_keys=True)
+        self.assertEqual(d.value_type, 'i8')
+        self.assertEqual(len(d), 1000)
+        self.assertEqual(d['k999'], 2997)
+        self.assertEqual(memoryview(d).tolist(), [i * 3 for i in range(1000)])
+        d = strdict.from_buffer(b'a\t0.25\nb\t1e3', value_parser=float, value_type='f8')
+        self.assertEqual(d, {b'a': 0.25, b'b': 1000.0})
+
+    def test_from_buffer_errors(self):
+        self.assertRaises(ValueError, strdict.from_buffer, b'a\t1\nb')
+        self.assertRaises(ValueError, strdict.from_buffer, b'a\tx', value_parser=int)
+        self.assertRaises(ValueError, strdict.from_buffer, b'a\t1', kv_sep=b'')
+        self.assertRaises(TypeError, strdict.from_buffer, 'a\t1')
+        self.assertRaises(TypeError, strdict.from_buffer, b'a\t1', value_parser=5)
+        self.assertRaises(TypeError, strdict.from_buffer, b'a\t1.5', value_type='i8')
+
+    def test_from_buffer_subclass(self):
+        d = PicklableSubclass.from_buffer(b'a\tb')
+        self.assertIs(type(d), PicklableSubclass)
+        self.assertEqual(d, {b'a': b'b'})
+
+    def test_lookup_tokens(self):
+        d = strdict({'the': 0, 'cat': 1, 'sat': 2, b'the': 10, b'mat': 13})
+        self.assertEqual(d.lookup_tokens('the cat sat on the  mat'), [0, 1, 2, -1, 0, -1])
+        self.assertEqual(d.lookup_tokens('the cat sat on the  mat', ' '), [0, 1, 2, -1, 0, -1, -1])
+        self.assertEqual(d.lookup_tokens(' \tthe\r\n cat\x0b\x0c\x1c'), [0, 1])
+        self.assertEqual(d.lookup_tokens(b'\tthe \n mat\r\n'), [10, 13])
+        self.assertEqual(d.lookup_tokens(b'the\x1cmat'), [-1])
+        self.assertEqual(d.lookup_tokens(b'the cat sat on the mat'), [10, -1, -1, -1, 10, 13])
+        self.assertEqual(d.lookup_tokens(bytearray(b'the\nmat'), sep=b'\n', default=None), [10, 13])
+        self.assertEqual(d.lookup_tokens('the--cat', '--'), [0, 1])
+        self.assertEqual(d.lookup_tokens(''), [])
+        self.assertEqual(d.lookup_tokens(' \n '), [])
+        self.assertEqual(d.lookup_tokens('', ' '), [-1])
+        self.assertRaises(ValueError, d.lookup_tokens, 'a', '')
+        self.assertRaises(TypeError, d.lookup_tokens, 'a', b' ')
+        self.assertRaises(TypeError, d.lookup_tokens, 5)
+
+    def test_lookup_tokens_wide(self):
+        words = ['caf\xe9', 'na\xefve', '\u20ac', '\U0001f600', 'plain']
+        d = strdict((w, i) for i, w in enumerate(words))
+        # tokens are narrowed to the kind their own str() would have
+        for text in (' '.join(words), ' '.join(words) + ' \u20ac', '\U0001f600 '.join(words), 
+                     '\u3000'.join(words) + '\x85', '\u2028\U0001f600  caf\xe9\xa0plain '):
+            self.assertEqual(d.lookup_tokens(text), [d.get(t, -1) for t in text.split()])
+            self.assertEqual(d.lookup_tokens(text, ' '), [d.get(t, -1) for t in text.split(' ')])
+        self.assertEqual(d.lookup_tokens('\u20ac\U0001f600plain', '\U0001f600'), [2, 4])
+        self.assertEqual(d.lookup_tokens('plain', '\u20ac'), [4])
+        e = strdict(a=5, value_type='i8')
+        self.assertEqual(e.lookup_tokens('a b a', default=0), [5, 0, 5])
+
+    def test_get_path(self):
+        d = strdict(service=strdict(db=strdict({'pool': strdict(size=10), 'caf\xe9': 1, '\u20ac': 2})), top=3)
+        self.assertEqual(d.get_path('service.db.pool.size'), 10)
+        self.assertIs(d.get_path('service.db.pool'), d['service']['db']['pool'])
+        self.assertEqual(d.get_path('top'), 3)
+        self.assertEqual(d.get_path('service.db.caf\xe9'), 1)
+        self.assertEqual(d.get_path('service.db.\u20ac'), 2)
+        self.assertEqual(d.get_path('service/db/\u20ac', sep='/'), 2)
+        self.assertIsNone(d.get_path('service.db.missing'))
+        self.assertEqual(d.get_path('top.size', default=0), 0)
+        self.assertEqual(d.get_path('', default=0), 0)
+        self.assertRaises(ValueError, d.get_path, 'a', '')
+        self.assertRaises(TypeError, d.get_path, 'a', b'.')
+        e = strdict({b'a': strdict({b'b': 1}), b'x': strdict(y=2)})
+        self.assertEqual(e.get_path(b'a.b'), 1)
+        self.assertEqual(e.get_path(bytearray(b'a::b'), b'::'), 1)
+        self.assertIsNone(e.get_path(b'x.y'))
+        f = strdict({b'a': strdict({b'\x00' * 4: 1}, key_width=4)})
+        self.assertEqual(f.get_path(b'a.\x00\x00\x00\x00'), 1)
+        self.assertIsNone(f.get_path(b'a.\x00'))
+
+        d.set_path('service.db.pool.size', 20)
+        self.assertEqual(d['service']['db']['pool']['size'], 20)
+        d.set_path('service.cache.ttl', 5)
+        self.assertEqual(type(d['service']['cache']), strdict)
+        self.assertEqual(d.get_path('service.cache.ttl'), 5)
+        d.set_path('new/\u20ac/x', 1, sep='/')
+        self.assertEqual(d['new']['\u20ac']['x'], 1)
+        d.set_path('top', 4)
+        self.assertEqual(d['top'], 4)
+        with self.assertRaises(TypeError):
+            d.set_path('top.x', 1)
+        c = strdict(compact_keys=True)
+        c.set_path('a.b', 1)
+        self.assertEqual(c.get_path('a.b'), 1)
+        self.assertRaises(ValueError, f.set_path, b'a.\x00', 1)
+
+    def test_get_slice(self):
+        d = strdict({'cat': 1, 'caf\xe9': 2, '\u20ac': 3, b'dog': 4, '': 5})
+        text = 'a cat, a caf\xe9, 5\u20ac'
+        for start in range(len(text) + 1):
+            for stop in range(start, len(text) + 1):
+                key = text[start:stop]
+                self.assertEqual(d.get_slice(text, start, stop), d.get(key))
+                self.assertEqual(d.contains_slice(text, start, stop), key in d)
+        self.assertEqual(d.get_slice(text, -1, None), 3)
+        self.assertEqual(d.get_slice(text, 2, 5, default=0), 1)
+        self.assertEqual(d.get_slice(text, 5, 2, 0), 5)
+        self.assertEqual(d.get_slice(b'hotdog', 3, None), 4)
+        self.assertEqual(d.get_slice(memoryview(b'hotdog'), -3, 10**100), 4)
+        self.assertTrue(d.contains_slice(bytearray(b'dogs'), None, -1))
+        self.assertFalse(d.contains_slice(b'cat', 0, 3))
+        self.assertRaises(TypeError, d.get_slice, 'cat', 0.5, 1)
+        self.assertRaises(TypeError, d.contains_slice, 5, 0, 1)
+
+    def test_longest_prefix(self):
+        d = strdict({'/': 0, '/api': 1, '/api/v1': 2, '/static': 3, b'/api': 4})
+        self.assertEqual(d.longest_prefix('/api/v1/users'), ('/api/v1', 2))
+        self.assertEqual(d.longest_prefix('/api/v2'), ('/api', 1))
+        self.assertEqual(d.longest_prefix(b'/api/v1'), (b'/api', 4))
+        self.assertEqual(d.longest_prefix('/index'), ('/', 0))
+        self.assertIsNone(d.longest_prefix('index'))
+        self.assertEqual(d.longest_prefix('x/api', 1), ('/api', 1))
+        self.assertEqual(d.longest_prefix('x/api', start=-4), ('/api', 1))
+        # the key lengths are kept up to date after the first call
+        d['/api/v1/users'] = 5
+        self.assertEqual(d.longest_prefix('/api/v1/users/7'), ('/api/v1/users', 5))
+        del d['/api/v1/users']
+        del d['/api/v1']
+        self.assertEqual(d.longest_prefix('/api/v1/users/7'), ('/api', 1))
+        d.clear()
+        self.assertIsNone(d.longest_prefix('/'))
+        d[''] = 'empty'
+        self.assertEqual(d.longest_prefix('abc'), ('', 'empty'))
+        self.assertRaises(TypeError, d.longest_prefix, 5)
+
+    def test_longest_prefix_wide(self):
+        d = strdict({'\u20ac': 1, 'ab': 2, 'ab\u20ac': 3, '\U0001f600x': 4})
+        self.assertEqual(d.longest_prefix('ab\u20ac\u20ac'), ('ab\u20ac', 3))
+        self.assertEqual(d.longest_prefix('ab\U0001f600'), ('ab', 2))
+        self.assertEqual(d.longest_prefix('\U0001f600xy'), ('\U0001f600x', 4))
+        self.assertEqual(d.longest_prefix('\u20ac\U0001f600'), ('\u20ac', 1))
+
+    def test_insert_delete_churn(self):
+        d = strdict()
+        for i in range(20000):
+            d[str(i)] = i
+            del d[str(i)]
+        self.assertEqual(len(d), 0)
+        self.assertNotIn('0', d)
+
+    def test_sorted_items(self):
+        rng = random.Random(5)
+        alphabet = 'ab\xe9\u20ac\U0001f600'
+        keys = {''.join(rng.choice(alphabet) for i in range(rng.randrange(6))) for j in range(500)}
+        keys |= {''.join(rng.choice('abcd') for i in range(rng.randrange(8))) for j in range(500)}
+        bkeys = {bytes(rng.randrange(256) for i in range(rng.randrange(4))) for j in range(300)}
+        d = strdict((k, i) for i, k in enumerate(keys | bkeys))
+        expected = sorted((k, d[k]) for k in bkeys) + sorted((k, d[k]) for k in keys)
+        self.assertEqual(d.sorted_items(), expected)
+        self.assertEqual(d.sorted_items('b', 'c'), [(k, v) for k, v in expected if isinstance(k, str) and 'b' <= k < 'c'])
+        self.assertEqual(d.sorted_items(stop=b'\x80'), [(k, v) for k, v in expected if isinstance(k, bytes) and k < b'\x80'])
+        self.assertEqual(d.sorted_items(start=''), sorted((k, d[k]) for k in keys))
+        self.assertEqual(strdict().sorted_items(), [])
+        self.assertEqual(strdict(b=1, a=2).sorted_items(), [('a', 2), ('b', 1)])
+        # long shared prefixes must not recurse once per digit
+        for prefix in ('x' * 10000, 'y' * 100000, '\u20ac' * 10000, b'z' * 10000):
+            keys = [prefix + type(prefix)(b'%03d' % i if isinstance(prefix, bytes) else '%03d' % i) for i in range(100)]
+            keys += [prefix[:5000] + k[-3:] for k in keys[:40]]
+            rng.shuffle(keys)
+            d = strdict((k, i) for i, k in enumerate(keys))
+            self.assertEqual([k for k, v in d.sorted_items()], sorted(keys))
+
+    def test_fastcall_arguments(self):
+        d = strdict(a=1)
+        self.assertEqual(d.get('a'), 1)
+        self.assertEqual(d.get('b', 2), 2)
+        self.assertEqual(d.increment(key='a', delta=2), 3)
+        self.assertEqual(d.get_slice('xax', stop=2, start=1), 3)
+        self.assertEqual(d.sorted_items(stop='b'), [('a', 3)])
+        self.assertRaises(TypeError, d.increment, 'a', key='a')
+        self.assertRaises(TypeError, d.increment, 'a', amount=1)
+        self.assertRaises(TypeError, d.increment, delta=1)
+        self.assertRaises(TypeError, d.sorted_items, 'a', 'b', 'c')
+        self.assertRaises(TypeError, d.pop, 'a', 1, 2)
+        d.update({'b': 2}, c=3)
+        self.assertEqual(d, {'a': 3, 'b': 2, 'c': 3})
+
+    def test_construct(self):
+        self.assertEqual(strdict(), {})
+        self.assertEqual(strdict({'a': 1}), {'a': 1})
+        self.assertEqual(strdict({'a': 1}, b=2), {'a': 1, 'b': 2})
+        self.assertEqual(strdict(value_type='i8', a=1).value_type, 'i8')
+        self.assertRaises(TypeError, strdict, {}, {})
+
+        class Sub(strdict):
+            def __init__(self, *args, **kwargs):
+                super().__init__(*args, **kwargs)
+                self.initialized = True
+
+        sub = Sub({'a': 1})
+        self.assertTrue(sub.initialized)
+        self.assertEqual(sub, {'a': 1})
+        self.assertEqual(strdict(sub), {'a': 1})
+        self.assertEqual(sub.get('a'), 1)
+
+
+class DefaultDictTest(unittest.TestCase):
+
+    def test_basic(self):
+        d = strdefaultdict(list)
+        self.assertIsInstance(d, strdict)
+        self.assertIs(d.default_factory, list)
+        d['a'].append(1)
+        d['a'].append(2)
+        d[b'b'].append(3)
+        self.assertEqual(d, {'a': [1, 2], b'b': [3]})
+        self.assertEqual(d.get('c'), None)
+        self.assertNotIn('c', d)
+        self.assertEqual(strdefaultdict(int, {'a': 1}, b=2), {'a': 1, 'b': 2})
+        self.assertEqual(repr(strdefaultdict(int, a=1)), "strdefaultdict(<class 'int'>, strdict({'a': 1}))")
+
+    def test_no_factory(self):
+        d = strdefaultdict()
+        self.assertIsNone(d.default_factory)
+        self.assertRaises(KeyError, d.__getitem__, 'a')
+        d.default_factory = int
+        self.assertEqual(d['a'], 0)
+        del d.default_factory
+        self.assertRaises(KeyError, d.__getitem__, 'b')
+        self.assertRaises(TypeError, strdefaultdict, 5)
+        with self.assertRaises(TypeError):
+            d.default_factory = 5
+
+    def test_factory_mutates(self):
+        d = strdefaultdict()
+        def factory():
+            for i in range(20):
+                d[str(i)] = i
+            return 'x'
+        d.default_factory = factory
+        self.assertEqual(d['key'], 'x')
+        self.assertEqual(len(d), 21)
+        self.assertEqual(d['key'], 'x')
+        d.default_factory = lambda: d.pop('key')
+        self.assertEqual(d['key'], 'x')
+        self.assertEqual(d['key'], 'x')
+
+    def test_factory_resizes(self):
+        # update() of existing keys rehashes without adding or removing keys
+        d = strdefaultdict(None, (('k%d' % i, i) for i in range(21)))
+        del d['k0']
+        def factory():
+            d.update({'k%d' % i: i for i in range(1, 21)})
+            return 'z'
+        d.default_factory = factory
+        self.assertEqual(d['zz'], 'z')
+        self.assertEqual(len(d), 21)
+        self.assertEqual(d.get('zz'), 'z')
+        self.assertEqual(d, dict({'k%d' % i: i for i in range(1, 21)}, zz='z'))
+
+    def test_typed(self):
+        d = strdefaultdict(int, value_type='i8')
+        for word in 'a b a c a'.split():
+            d[word] += 1
+        self.assertEqual(d, {'a': 3, 'b': 1, 'c': 1})
+
+    def test_typed_factory_mutates(self):
+        class Index:
+            def __index__(self):
+                for i in range(1000):
+                    d['k%d' % i] = i
+                return 5
+        d = strdefaultdict(Index, value_type='i8')
+        self.assertEqual(d['x'], 5)
+        self.assertEqual(len(d), 1001)
+        self.assertEqual(d.get('x'), 5)
+
+    def test_subclass_missing(self):
+        class D(strdefaultdict):
+            def __missing__(self, key):
+                return 'missing'
+        d = D(list)
+        self.assertEqual(d['a'], 'missing')
+        self.assertNotIn('a', d)
+
+    def test_copy_and_pickle(self):
+        d = strdefaultdict(list, a=[1])
+        for e in (d.copy(), pickle.loads(pickle.dumps(d))):
+            self.assertIs(type(e), strdefaultdict)
+            self.assertIs(e.default_factory, list)
+            self.assertEqual(e, d)
+            e['b'].append(1)
+            self.assertNotIn('b', d)
+
+    def test_cycle_collected(self):
+        class D(strdefaultdict):
+            pass
+        d = D()
+        d.default_factory = lambda: d
+        ref = weakref.ref(d)
+        del d
+        gc.collect()
+        self.assertIsNone(ref())
+
+
+class PrefixIndexTest(unittest.TestCase):
+
+    def test_prefix_queries(self):
+        d = strdict({'user:2:name': 'b', 'user:1:name': 'a', 'user:1:age': 30,
+                     'group:1': 'g', b'user:3': 'bytes', 'user': 0}, prefix_index=True)
+        self.assertTrue(d.prefix_index)
+        self.assertEqual(d.keys_with_prefix('user:1:'), ['user:1:age', 'user:1:name'])
+        self.assertEqual(d.items_with_prefix('user:'),
+                         [('user:1:age', 30), ('user:1:name', 'a'), ('user:2:name', 'b')])
+        self.assertEqual(d.keys_with_prefix(b'user'), [b'user:3'])
+        self.assertEqual(d.count_prefix('user'), 4)
+        self.assertEqual(d.count_prefix(''), 5)
+        self.assertEqual(d.count_prefix('x'), 0)
+        self.assertEqual(d.keys_with_prefix(''), sorted(k for k in d.keys() if isinstance(k, str)))
+
+    def test_prefix_index_updates(self):
+        d = strdict(prefix_index=True)
+        keys = ['%s%d' % (random.choice('abc'), random.randrange(1000)) for i in range(2000)]
+        for k in keys:
+            d[k] = k
+        for k in keys[::3]:
+            d.pop(k, None)
+        d.popitem()
+        d.setdefault('a-new', 1)
+        for p in ('', 'a', 'b1', 'c99', 'z'):
+            expected = sorted(k for k in d.keys() if k.startswith(p))
+            self.assertEqual(d.keys_with_prefix(p), expected)
+            self.assertEqual(d.count_prefix(p), len(expected))
+        d.clear()
+        self.assertEqual(d.keys_with_prefix(''), [])
+
+    def test_prefix_wide_keys(self):
+        keys = ['\u20acx', 'caf\xe9', 'ca\U0001f600', 'cab', '\xe9']
+        d = strdict(((k, 1) for k in keys), prefix_index=True)
+        self.assertEqual(d.keys_with_prefix(''), sorted(keys))
+        self.assertEqual(d.keys_with_prefix('ca'), sorted(k for k in keys if k.startswith('ca')))
+        self.assertEqual(d.keys_with_prefix('\u20ac'), ['\u20acx'])
+
+    def test_prefix_index_copy_and_pickle(self):
+        d = strdict(a=1, ab=2, value_type='i8', prefix_index=True)
+        for e in (d.copy(), pickle.loads(pickle.dumps(d))):
+            self.assertTrue(e.prefix_index)
+            self.assertEqual(e.value_type, 'i8')
+            e['abc'] = 3
+            self.assertEqual(e.items_with_prefix('ab'), [('ab', 2), ('abc', 3)])
+        self.assertEqual(d.count_prefix('ab'), 1)
+
+    def test_sorted_items(self):
+        d = strdict(prefix_index=True)
+        for k in ('pear', 'apple', b'fig', 'banana', 'cherry'):
+            d[k] = len(k)
+        self.assertEqual(d.sorted_items(), [(b'fig', 3), ('apple', 5), ('banana', 6), ('cherry', 6), ('pear', 4)])
+        self.assertEqual(d.sorted_items('b', 'p'), [('banana', 6), ('cherry', 6)])
+
+    def test_without_prefix_index(self):
+        d = strdict(a=1)
+        self.assertFalse(d.prefix_index)
+        self.assertRaises(ValueError, d.keys_with_prefix, 'a')
+        self.assertRaises(ValueError, d.count_prefix, 'a')
+
+
+class TypedDictTest(unittest.TestCase):
+
+    def test_int64(self):
+        d = strdict(value_type='i8')
+        self.assertEqual(d.value_type, 'i8')
+        d['a'] = 1
+        d.update(b=2**62, c=True)
+        self.assertEqual(d, {'a': 1, 'b': 2**62, 'c': 1})
+        self.assertEqual(d.setdefault('a', 5), 1)
+        self.assertEqual(d.pop('b'), 2**62)
+        self.assertEqual(d.items(), [('a', 1), ('c', 1)])
+        self.assertEqual(repr(d), "strdict({'a': 1, 'c': 1})")
+        with self.assertRaises(TypeError):
+            d['x'] = 1.5
+        with self.assertRaises(OverflowError):
+            d['x'] = 2**63
+        self.assertNotIn('x', d)
+
+    def test_increment(self):
+        d = strdict(value_type='i8')
+        d.count(['a', 'b', 'a'])
+        self.assertEqual(d.increment('a', 10), 12)
+        self.assertEqual(d, {'a': 12, 'b': 1})
+        d['m'] = 2**63 - 1
+        self.assertRaises(OverflowError, d.increment, 'm')
+        self.assertEqual(d['m'], 2**63 - 1)
+        self.assertRaises(TypeError, d.increment, 'a', 0.5)
+        f = strdict(value_type='f8')
+        f.increment('x', 0.25)
+        self.assertEqual(f.increment('x'), 1.25)
+
+    def test_float64(self):
+        d = strdict({'a': 1, 'b': 2.5}, value_type='f8')
+        self.assertEqual(d.value_type, 'f8')
+        self.assertEqual(d['a'], 1.0)
+        self.assertIsInstance(d['a'], float)
+        with self.assertRaises(TypeError):
+            d['c'] = 'x'
+
+    def test_invalid_value_type(self):
+        with self.assertRaises(ValueError):
+            strdict(value_type='i4')
+        self.assertEqual(strdict(value_type=None).value_type, 'O')
+
+    def test_reentrant_unboxing(self):
+        # __index__() runs before the key is probed, so it may change the
+        # dict freely.
+        class Index:
+            def __init__(self, mutate):
+                self.mutate = mutate
+
+            def __index__(self):
+                self.mutate()
+                return 7
+
+        def grow():
+            for i in range(1000):
+                d['k%d' % i] = i
+
+        d = strdict(value_type='i8')
+        d['target'] = Index(grow)
+        self.assertEqual(d['target'], 7)
+        self.assertEqual(len(d), 1001)
+        d['target'] = Index(d.clear)
+        self.assertEqual(d, {'target': 7})
+        s = d.slot('target')
+        s.set(Index(grow))
+        self.assertEqual(d['target'], 7)
+        s.set(Index(d.clear))
+        self.assertEqual(d, {'target': 7})
+        d.clear()
+        d.setdefault('target', Index(grow))
+        self.assertEqual(d['target'], 7)
+
+    def test_buffer(self):
+        d = strdict(value_type='i8')
+        for i in range(100):
+            d[str(i)] = i
+        for i in range(0, 100, 2):
+            del d[str(i)]
+        m = memoryview(d)
+        self.assertEqual(m.format, 'q')
+        self.assertEqual(m.tolist(), list(range(1, 100, 2)))
+        self.assertEqual(m.tolist(), d.values())
+        m[0] = 42
+        self.assertEqual(d['1'], 42)
+        with self.assertRaises(BufferError):
+            d['new'] = 1
+        with self.assertRaises(BufferError):
+            del d['1']
+        with self.assertRaises(BufferError):
+            d.clear()
+        d['3'] = 7
+        d.update({'3': 8, '5': 9})
+        d.update([('7', 10)], **{'9': 11})
+        self.assertEqual(m.tolist()[1:5], [8, 9, 10, 11])
+        with self.assertRaises(BufferError):
+            d.update({'3': 1, 'new': 1})
+        self.assertNotIn('new', d)
+        m.release()
+        d['new'] = 1
+        self.assertEqual(memoryview(d).tolist()[-1], 1)
+        with self.assertRaises(BufferError):
+            memoryview(strdict(a=1))
+
+    def test_buffer_float(self):
+        d = strdict(a=0.5, b=1.5, value_type='f8')
+        with memoryview(d) as m:
+            self.assertEqual(m.format, 'd')
+            self.assertEqual(m.tolist(), [0.5, 1.5])
+        self.assertEqual(memoryview(strdict(value_type='f8')).tolist(), [])
+
+    def test_pickle(self):
+        d = strdict(value_type='i8')
+        for i in range(50):
+            d['k%d' % i] = -i
+        for i in range(10):
+            del d['k%d' % i]
+        e = pickle.loads(pickle.dumps(d))
+        self.assertEqual(e.value_type, 'i8')
+        self.assertEqual(e, d)
+        self.assertEqual(e.keys(), d.keys())
+
+    def test_copy(self):
+        d = strdict(a=1, b=2, value_type='f8')
+        e = d.copy()
+        self.assertEqual(e.value_type, 'f8')
+        e['a'] = 3
+        self.assertEqual(d['a'], 1.0)
+
+    def test_save(self):
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        try:
+            strdict(a=1, b=2, value_type='i8').save(path)
+            m = strdict.open_mmap(path)
+            self.assertEqual(m['b'], 2)
+            m.close()
+        finally:
+            os.unlink(path)
+
+
+class PicklableSubclass(strdict):
+    pass
+
+
+class MappedDictTest(unittest.TestCase):
+
+    def setUp(self):
+        fd, self.path = tempfile.mkstemp()
+        os.close(fd)
+
+    def tearDown(self):
+        os.unlink(self.path)
+
+    def test_save_open_mmap(self):
+        d = strdict({'a': 1, 'b': -2.5, 'c': b'bytes', 'd': 'str\u20ac',
+                     b'e': None, '\u20ac': True, '\U0001f600': 2**62})
+        del d['a']
+        d.save(self.path)
+        m = strdict.open_mmap(self.path)
+        self.assertIsInstance(m, mapped_strdict)
+        self.assertEqual(len(m), len(d))
+        for k, v in d.items():
+            self.assertIn(k, m)
+            self.assertEqual(m[k], v)
+            self.assertIs(type(m[k]), type(v))
+        self.assertNotIn('a', m)
+        self.assertNotIn('e', m)
+        self.assertIn(bytearray(b'e'), m)
+        self.assertRaises(KeyError, m.__getitem__, 'a')
+        self.assertIsNone(m.get('a'))
+        self.assertEqual(m.get('a', 3), 3)
+        self.assertEqual(m[strdict.Key('\u20ac')], True)
+        self.assertNotIn(strdict.Key('a'), m)
+        self.assertEqual(strdict(m.items()), d)
+        self.assertEqual(sorted(m.keys(), key=repr), sorted(d.keys(), key=repr))
+        it = iter(m)
+        self.assertEqual(list(m), m.keys())
+        self.assertEqual({k: m[k] for k in m}, dict(m.items()))
+        m.close()
+        self.assertRaises(ValueError, len, m)
+        self.assertRaises(ValueError, iter, m)
+        self.assertEqual(len(list(it)), len(d))
+
+    def test_save_large(self):
+        d = strdict((str(i), i) for i in range(10000))
+        d.save(self.path)
+        m = strdict.open_mmap(self.path)
+        for i in range(10000):
+            self.assertEqual(m[str(i)], i)
+        self.assertNotIn('10000', m)
+
+    def test_save_replaces_mapped_file(self):
+        strdict(a=1).save(self.path)
+        old = strdict.open_mmap(self.path)
+        strdict(a=2).save(self.path)
+        self.assertEqual(old['a'], 1)
+        self.assertEqual(strdict.open_mmap(self.path)['a'], 2)
+
+    def test_save_unsupported_value(self):
+        self.assertRaises(TypeError, strdict(a=[]).save, self.path)
+        self.assertRaises(OverflowError, strdict(a=2**64).save, self.path)
+
+    def test_open_invalid_file(self):
+        with open(self.path, 'wb') as f:
+            f.write(b'not a strdict' * 10)
+        self.assertRaises(ValueError, strdict.open_mmap, self.path)
+
+
+class SharedDictTest(unittest.TestCase):
+
+    def setUp(self):
+        self.name = 'strdict-test-%d' % os.getpid()
+
+    def tearDown(self):
+        try:
+            strdict.unlink_shared(self.name)
+        except FileNotFoundError:
+            pass
+
+    def test_save_attach_shared(self):
+        d = strdict({'a': 1, b'b': 'two', '\u20ac': 3.0})
+        d.save_shared(self.name)
+        m = strdict.attach_shared(self.name)
+        self.assertIsInstance(m, mapped_strdict)
+        self.assertEqual(strdict(m.items()), d)
+
+    def test_attach_from_other_process(self):
+        strdict((str(i), i) for i in range(1000)).save_shared(self.name)
+        code = ("from StringDict import strdict\n"
+                "m = strdict.attach_shared(%r)\n"
+                "print(sum(m[str(i)] for i in range(1000)))" % self.name)
+        out = subprocess.check_output([sys.executable, '-c', code],
+                                      env=dict(os.environ, PYTHONPATH=os.pathsep.join(sys.path)))
+        self.assertEqual(int(out), sum(range(1000)))
+
+    def test_resave_keeps_old_mapping(self):
+        strdict(a=1).save_shared(self.name)
+        old = strdict.attach_shared(self.name)
+        strdict(a=2).save_shared(self.name)
+        self.assertEqual(old['a'], 1)
+        self.assertEqual(strdict.attach_shared(self.name)['a'], 2)
+
+    def test_unlink_shared(self):
+        strdict(a=1).save_shared(self.name)
+        m = strdict.attach_shared(self.name)
+        strdict.unlink_shared(self.name)
+        self.assertEqual(m['a'], 1)
+        self.assertRaises(FileNotFoundError, strdict.attach_shared, self.name)
+
+
+class BasicStringDictTest(unittest.TestCase):
+    """Builds and runs the C++ tests of include/BasicStringDict.h.
+
+    These fail without a C++ compiler (the extension needs one anyway), unless
+    STRDICT_SKIP_CXX_TESTS=1 is set in the environment."""
+
+    def setUp(self):
+        cxx = (os.environ.get('CXX') or sysconfig.get_config_var('CXX')
+               or shutil.which('c++') or shutil.which('g++'))
+        if os.environ.get('STRDICT_SKIP_CXX_TESTS') == '1':
+            self.skipTest('STRDICT_SKIP_CXX_TESTS=1')
+        if not cxx or not shutil.which(shlex.split(cxx)[0]):
+            self.fail('No C++ compiler found for the C++ tests; set CXX, or '
+                      'set STRDICT_SKIP_CXX_TESTS=1 to skip them.')
+        self.cxx = shlex.split(cxx)
+        self.here = os.path.dirname(os.path.abspath(__file__))
+        self.include = os.path.join(self.here, os.pardir, 'include')
+
+    def compile(self, source, *args):
+        cmd = self.cxx + ['-std=c++17', '-Wall', '-I', self.include, os.path.join(self.here, source)]
+        subprocess.run(cmd + list(args), check=True)
+
+    def test_cpp_tests(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            exe = os.path.join(tmp, 'basic_string_dict_test')
+            self.compile('basic_string_dict_test.cpp', '-O1', '-o', exe)
+            self.assertEqual(subprocess.check_output([exe]).strip(), b'OK')
+
+    def test_benchmark_builds(self):
+        self.compile('basic_string_dict_bench.cpp', '-fsyntax-only')
+
 
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,570 @@
+#ifndef BASIC_STRING_DICT_H
+#define BASIC_STRING_DICT_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The hash table engine of strdict as a header-only template, for use without
+// python.  Only depends on the standard library.
+
+namespace strdict {
+
+// Constants and probing of the table.
+struct table_traits
+{
+	static constexpr const double max_load_factor = 0.667;
+	static constexpr const std::size_t min_buckets = 8;
+	static constexpr const std::size_t small_capacity = 8;
+	static constexpr const std::size_t perturb_shift = 5;
+
+	// Call 'pred' with each bucket of the probe sequence of 'hash' in a
+	// table of 'mask' + 1 buckets, until it returns true.  Same sequence as
+	// CPython's dict: the high bits of 'hash' are mixed in until they are
+	// shifted out, after which it visits every bucket.
+	template <class Pred>
+	static void visit_probe_sequence(std::size_t hash, std::size_t mask, Pred pred)
+	{
+		std::size_t perturb = hash;
+		for(std::size_t idx = hash & mask; not pred(idx); )
+		{
+			perturb >>= perturb_shift;
+			idx = mask & (idx * 5 + perturb + 1);
+		}
+	}
+
+	// The smallest number of buckets that holds 'count' keys below the
+	// maximum load factor.
+	static std::size_t bucket_count_for(std::size_t count)
+	{
+		std::size_t buckets = min_buckets;
+		while(double(count) / buckets >= max_load_factor)
+			buckets <<= 1;
+		return buckets;
+	}
+};
+
+// What an insertion has to do to the table, see string_table::load_action().
+enum class table_resize
+{
+	none = 0,
+	grow = 1,
+	compact = 2
+};
+
+// The table of strdict (StringDictBase) and basic_string_dict.  Keys live in
+// an insertion-ordered vector of entries, indexed by a power-of-two table of
+// offsets into it.  Tables with at most 'small_capacity' entries have no
+// offsets and are searched linearly.  Removed entries stay in place (and keep
+// their buckets) until the next rehash.
+//
+// 'Entry' has is_empty() and set_empty(), and is move-assignable.  'Derived'
+// is the dict type (CRTP), which supplies the entry policy:
+//
+//     // the hash of the key in 'ent'
+//     std::size_t entry_hash(const Entry& ent) const;
+//     // entries[dest] was move-assigned from entries[src] by a rehash
+//     void on_entry_moved(std::size_t dest, std::size_t src);
+//     // a rehash dropped all entries from 'count' on
+//     void on_entries_truncated(std::size_t count);
+//     // the entries were compacted or got new buckets
+//     void on_entries_moved();
+template <class Derived, class Entry, class Alloc = std::allocator<Entry>>
+class string_table
+{
+	template <class T>
+	using rebind_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+public:
+	using offset_type = std::ptrdiff_t;
+
+	string_table() = default;
+
+	explicit string_table(const Alloc& alloc):
+		entries(alloc), offsets(alloc)
+	{
+
+	}
+
+	std::size_t bucket_count() const
+	{ return offsets.size(); }
+
+	bool is_small() const
+	{ return offsets.empty(); }
+
+	std::size_t entry_slot_count() const
+	{ return entries.size(); }
+
+	// The bucket and entry of the key 'match' accepts, where 'hash' is the
+	// hash of the key.  If it's missing, the entry is null and the bucket is
+	// the open bucket that ended the probe sequence.  The bucket is always -1
+	// for small tables.
+	template <class Match>
+	std::pair<offset_type, Entry*> find_bucket(std::size_t hash, Match match)
+	{
+		if(is_small())
+		{
+			for(Entry& ent: entries)
+			{
+				if((not ent.is_empty()) and match(ent))
+					return std::make_pair(offset_type(-1), &ent);
+			}
+			return std::make_pair(offset_type(-1), nullptr);
+		}
+		Entry* found = nullptr;
+		offset_type bucket = -1;
+		table_traits::visit_probe_sequence(hash, mask, [&](std::size_t idx) {
+			offset_type ofs = offsets[idx];
+			if(ofs >= 0)
+			{
+				Entry& ent = entries[ofs];
+				if(ent.is_empty() or (not match(ent)))
+					return false;
+				found = &ent;
+			}
+			bucket = static_cast<offset_type>(idx);
+			return true;
+		});
+		return std::make_pair(bucket, found);
+	}
+
+	// Like find_bucket(), but if the key is missing, returns the first
+	// removed entry in its probe sequence (and its bucket) for reuse, if
+	// any.  Small tables never reuse removed entries, since that would put
+	// the new key before older ones; load_action() compacts them when
+	// they're full instead.
+	template <class Match>
+	std::pair<offset_type, Entry*> find_insertion_bucket(std::size_t hash, Match match)
+	{
+		if(is_small())
+			return find_bucket(hash, match);
+		Entry* found = nullptr;
+		offset_type bucket = -1;
+		table_traits::visit_probe_sequence(hash, mask, [&](std::size_t idx) {
+			offset_type ofs = offsets[idx];
+			if(ofs < 0)
+			{
+				// the end of the probe sequence: insert here unless a
+				// removed entry came first
+				if(not found)
+					bucket = static_cast<offset_type>(idx);
+				return true;
+			}
+			Entry& ent = entries[ofs];
+			if(ent.is_empty())
+			{
+				if(not found)
+				{
+					found = &ent;
+					bucket = static_cast<offset_type>(idx);
+				}
+				return false;
+			}
+			if(not match(ent))
+				return false;
+			found = &ent;
+			bucket = static_cast<offset_type>(idx);
+			return true;
+		});
+		return std::make_pair(bucket, found);
+	}
+
+	// What the table has to do when a key is added, called with 'occupied'
+	// already counting it.  Removed entries keep their buckets until the
+	// next rehash, so they count towards the load.  Otherwise a table with a
+	// lot of churn could run out of open buckets and probe forever.
+	table_resize load_action() const
+	{
+		std::size_t used = std::max<std::size_t>(occupied, entries.size() + 1);
+		if(is_small())
+		{
+			// Stay small as long as the keys fit once the removed entries
+			// are dropped.
+			if(used <= table_traits::small_capacity)
+				return table_resize::none;
+			else if(static_cast<std::size_t>(occupied) <= table_traits::small_capacity)
+				return table_resize::compact;
+		}
+		else if((double(used) / offsets.size()) < table_traits::max_load_factor)
+			return table_resize::none;
+		else if((double(occupied) / offsets.size()) < (table_traits::max_load_factor / 2))
+			return table_resize::compact;
+		return table_resize::grow;
+	}
+
+	// Allocate the buckets for grow(), so that it doesn't throw.
+	void reserve_growth()
+	{ offsets.reserve(grown_bucket_count()); }
+
+	// Apply the result of load_action() once the key is in.
+	void resize(table_resize action) noexcept
+	{
+		if(action == table_resize::grow)
+			grow();
+		else if(action == table_resize::compact)
+			compact();
+	}
+
+	// Double the number of buckets (or leave small mode), dropping the
+	// removed entries.  Doesn't throw after reserve_growth().
+	void grow()
+	{ rehash(grown_bucket_count()); }
+
+	// Drop the removed entries and rebuild the offsets with 'buckets'
+	// buckets, or none for a small table.
+	void rehash(std::size_t buckets)
+	{
+		assert((buckets & (buckets - 1)) == 0);
+		assert((buckets == 0) or (static_cast<std::size_t>(occupied) < buckets));
+		offsets.reserve(buckets);
+		derived().on_entries_moved();
+		offsets.assign(buckets, -1);
+		mask = buckets ? (buckets - 1) : 0;
+		remove_empty_entries();
+		place_all_entries();
+	}
+
+	// Drop the removed entries without resizing, so that the entries are
+	// contiguous and in insertion order.
+	void compact() noexcept
+	{
+		if(static_cast<std::size_t>(occupied) == entries.size())
+			return;
+		derived().on_entries_moved();
+		std::fill(offsets.begin(), offsets.end(), -1);
+		remove_empty_entries();
+		place_all_entries();
+	}
+
+	// Point 'bucket' from find_bucket() or find_insertion_bucket() at the
+	// new entry 'index'.  Small tables have no buckets to update.
+	void link_entry(offset_type bucket, std::size_t index)
+	{
+		if(is_small())
+			return;
+		assert(offsets[bucket] == -1);
+		offsets[bucket] = static_cast<offset_type>(index);
+	}
+
+	// Point the first open bucket of the probe sequence of entry 'index' at
+	// it, for entries that were added without a probe.
+	void place_entry(std::size_t index)
+	{
+		if(is_small())
+			return;
+		table_traits::visit_probe_sequence(derived().entry_hash(entries[index]), mask, [&](std::size_t idx) {
+			if(offsets[idx] >= 0)
+				return false;
+			offsets[idx] = static_cast<offset_type>(index);
+			return true;
+		});
+	}
+
+	// Remove the key of 'ent', which keeps its slot and bucket until the
+	// next rehash.
+	void erase_entry(Entry& ent)
+	{
+		assert(not ent.is_empty());
+		ent.set_empty();
+		--occupied;
+	}
+
+	std::vector<Entry, Alloc> entries;
+	// Indices into 'entries', or -1 for open buckets.  Empty for small tables.
+	std::vector<offset_type, rebind_alloc<offset_type>> offsets;
+	std::size_t mask = 0;
+	// number of keys
+	std::ptrdiff_t occupied = 0;
+
+private:
+	Derived& derived()
+	{ return static_cast<Derived&>(*this); }
+
+	std::size_t grown_bucket_count() const
+	{ return is_small() ? table_traits::bucket_count_for(occupied) : 2 * offsets.size(); }
+
+	void place_all_entries()
+	{
+		for(std::size_t i = 0; (not is_small()) and (i < entries.size()); ++i)
+			place_entry(i);
+	}
+
+	void remove_empty_entries() noexcept
+	{
+		// don't do an O(n) traversal if there are no empty entries
+		if(static_cast<std::size_t>(occupied) == entries.size())
+			return;
+
+		// Move all of the non-empty entries to the front of the array,
+		// keeping them in insertion order.
+		std::size_t dest = 0;
+		for(std::size_t src = 0; src < entries.size(); ++src)
+		{
+			if(entries[src].is_empty())
+				continue;
+			if(dest != src)
+			{
+				entries[dest] = std::move(entries[src]);
+				derived().on_entry_moved(dest, src);
+			}
+			++dest;
+		}
+		assert(static_cast<std::ptrdiff_t>(dest) == occupied);
+		entries.erase(entries.begin() + dest, entries.end());
+		derived().on_entries_truncated(dest);
+	}
+};
+
+namespace detail {
+
+template <class Value, class String>
+struct basic_string_dict_entry
+{
+	std::size_t hash;
+	String key;
+	// empty for removed entries
+	std::optional<Value> value;
+
+	bool is_empty() const
+	{ return not value.has_value(); }
+
+	void set_empty()
+	{
+		value.reset();
+		key = String(key.get_allocator());
+	}
+};
+
+// The key strings and entries of a basic_string_dict<Value, Hash, Alloc>.
+template <class Value, class Alloc>
+struct basic_string_dict_types
+{
+	template <class T>
+	using rebind_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+	using string_type = std::basic_string<char, std::char_traits<char>, rebind_alloc<char>>;
+	using entry = basic_string_dict_entry<Value, string_type>;
+	using entry_allocator = rebind_alloc<entry>;
+};
+
+} /* namespace detail */
+
+// Insertion-ordered map from strings to 'Value', on the table of strdict.
+// Keys are looked up as std::string_view, so lookups never allocate.  'Hash'
+// hashes std::string_view; 'Alloc' is rebound for the entries, the offsets
+// and the key strings.
+template <class Value, class Hash = std::hash<std::string_view>, class Alloc = std::allocator<Value>>
+class basic_string_dict:
+	private string_table<basic_string_dict<Value, Hash, Alloc>, 
+		typename detail::basic_string_dict_types<Value, Alloc>::entry,
+		typename detail::basic_string_dict_types<Value, Alloc>::entry_allocator>
+{
+	using types = detail::basic_string_dict_types<Value, Alloc>;
+	using string_type = typename types::string_type;
+	using entry = typename types::entry;
+	using table = string_table<basic_string_dict, entry, typename types::entry_allocator>;
+
+	friend table;
+
+public:
+	using key_type = std::string_view;
+	using mapped_type = Value;
+	using hasher = Hash;
+	using allocator_type = Alloc;
+	using size_type = std::size_t;
+
+	basic_string_dict():
+		basic_string_dict(Hash(), Alloc())
+	{
+
+	}
+
+	explicit basic_string_dict(const Hash& hash, const Alloc& alloc = Alloc()):
+		table(typename types::entry_allocator(alloc)), hash_(hash), alloc_(alloc)
+	{
+
+	}
+
+	explicit basic_string_dict(const Alloc& alloc):
+		basic_string_dict(Hash(), alloc)
+	{
+
+	}
+
+	size_type size() const
+	{ return this->occupied; }
+
+	bool empty() const
+	{ return this->occupied == 0; }
+
+	using table::bucket_count;
+
+	allocator_type get_allocator() const
+	{ return allocator_type(alloc_); }
+
+	// The value of 'key', or null if it's missing.
+	Value* find(key_type key)
+	{
+		entry* ent = find_entry(key, hash_(key));
+		return ent ? &*ent->value : nullptr;
+	}
+
+	const Value* find(key_type key) const
+	{ return const_cast<basic_string_dict*>(this)->find(key); }
+
+	bool contains(key_type key) const
+	{ return find(key) != nullptr; }
+
+	// Add 'key' with a value constructed from 'args' unless it's already
+	// there.  Returns its value and whether it was added.
+	template <class ... Args>
+	std::pair<Value*, bool> try_emplace(key_type key, Args&& ... args)
+	{
+		std::size_t hash = hash_(key);
+		if(entry* ent = find_entry(key, hash); ent)
+			return std::make_pair(&*ent->value, false);
+		entry& ent = add_entry(key, hash, std::forward<Args>(args)...);
+		return std::make_pair(&*ent.value, true);
+	}
+
+	// Add 'key' or replace its value.  Returns its value and whether it was
+	// added.
+	template <class V>
+	std::pair<Value*, bool> insert_or_assign(key_type key, V&& value)
+	{
+		std::size_t hash = hash_(key);
+		if(entry* ent = find_entry(key, hash); ent)
+		{
+			*ent->value = std::forward<V>(value);
+			return std::make_pair(&*ent->value, false);
+		}
+		entry& ent = add_entry(key, hash, std::forward<V>(value));
+		return std::make_pair(&*ent.value, true);
+	}
+
+	Value& operator[](key_type key)
+	{ return *try_emplace(key).first; }
+
+	// Returns whether 'key' was removed.
+	bool erase(key_type key)
+	{
+		entry* ent = find_entry(key, hash_(key));
+		if(not ent)
+			return false;
+		this->erase_entry(*ent);
+		return true;
+	}
+
+	void clear() noexcept
+	{
+		this->entries.clear();
+		this->offsets.clear();
+		this->mask = 0;
+		this->occupied = 0;
+	}
+
+	// Make room for 'count' keys in total.
+	void reserve(size_type count)
+	{
+		this->entries.reserve(count);
+		if(count > table_traits::small_capacity)
+		{
+			if(std::size_t buckets = table_traits::bucket_count_for(count); buckets > this->offsets.size())
+				this->rehash(buckets);
+		}
+	}
+
+	// Call 'visit(key, value)' with each key and value in insertion order.
+	template <class Visitor>
+	void for_each(Visitor visit)
+	{
+		for(entry& ent: this->entries)
+		{
+			if(not ent.is_empty())
+				visit(key_type(ent.key), *ent.value);
+		}
+	}
+
+	template <class Visitor>
+	void for_each(Visitor visit) const
+	{
+		for(const entry& ent: this->entries)
+		{
+			if(not ent.is_empty())
+				visit(key_type(ent.key), *ent.value);
+		}
+	}
+
+private:
+	entry* find_entry(key_type key, std::size_t hash)
+	{
+		return this->find_bucket(hash, [&](const entry& ent) {
+			return (ent.hash == hash) and (key_type(ent.key) == key);
+		}).second;
+	}
+
+	// Append an entry for 'key', which must not be in the dict yet.
+	template <class ... Args>
+	entry& add_entry(key_type key, std::size_t hash, Args&& ... args)
+	{
+		++this->occupied;
+		table_resize action = this->load_action();
+		try
+		{
+			if(action == table_resize::grow)
+				this->reserve_growth();
+			this->entries.push_back(entry{hash, string_type(key.data(), key.size(), alloc_), std::nullopt});
+		}
+		catch(...)
+		{
+			--this->occupied;
+			throw;
+		}
+		try
+		{
+			this->entries.back().value.emplace(std::forward<Args>(args)...);
+		}
+		catch(...)
+		{
+			this->entries.pop_back();
+			--this->occupied;
+			throw;
+		}
+		this->place_entry(this->entries.size() - 1);
+		this->resize(action);
+		return this->entries.back();
+	}
+
+	// entry policy of the table
+	std::size_t entry_hash(const entry& ent) const
+	{ return ent.hash; }
+
+	void on_entry_moved(std::size_t, std::size_t)
+	{
+
+	}
+
+	void on_entries_truncated(std::size_t)
+	{
+
+	}
+
+	void on_entries_moved()
+	{
+
+	}
+
+	Hash hash_;
+	typename types::template rebind_alloc<char> alloc_;
+};
+
+} /* namespace strdict */
+
+#endif /* BASIC_STRING_DICT_H */
@@ -24,6 +24,12 @@ Py_ssize_t DataKind_ItemSize(DataKind kind);
 
 Py_ssize_t DataKind_Alignment(DataKind kind);
 
+/* 
+ * Hash raw key data of the given kind.  Gives the same result as hash() on the 
+ * equivalent str() or bytes() object. 
+ */
+Py_hash_t DataKind_Hash(DataKind kind, const void* data, Py_ssize_t size);
+
 typedef struct key_info_ {
 	PyObject* key;
 	Py_hash_t hash;
@@ -34,6 +40,12 @@ typedef struct key_info_ {
 
 int KeyInfo_Init(PyObject* key, KeyInfo* ki, Py_buffer* buff);
 
+/* 
+ * Like KeyInfo_Init(), but leaves 'ki->hash' as -1.  For callers that don't 
+ * index by the python hash of the key. 
+ */
+int KeyInfo_InitUnhashed(PyObject* key, KeyInfo* ki, Py_buffer* buff);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
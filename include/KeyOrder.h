@@ -0,0 +1,63 @@
+#ifndef KEY_ORDER_H
+#define KEY_ORDER_H
+
+#include "KeyInfo.h"
+#include <algorithm>
+#include <cstring>
+
+// Ordering of strdict keys: all bytes keys come before all str keys, bytes are
+// ordered like bytes() and str like str() (by code point), regardless of the
+// kind that the data is stored in.
+
+inline Py_UCS4 key_code_point(const KeyInfo& ki, Py_ssize_t index)
+{
+	assert(index < ki.data_size);
+	switch(ki.kind)
+	{
+	case PY_UCS2:
+		return reinterpret_cast<const Py_UCS2*>(ki.data)[index];
+	case PY_UCS4:
+		return reinterpret_cast<const Py_UCS4*>(ki.data)[index];
+	default:
+		return ki.data[index];
+	}
+}
+
+inline bool key_is_str(const KeyInfo& ki)
+{ return ki.kind != PY_BYTES; }
+
+// Compare the first 'len' code points of two keys of the same type.
+inline int compare_code_points(const KeyInfo& l, const KeyInfo& r, Py_ssize_t len)
+{
+	if((l.kind == r.kind) and (l.kind <= PY_UCS1))
+		return std::memcmp(l.data, r.data, len);
+	for(Py_ssize_t i = 0; i < len; ++i)
+	{
+		Py_UCS4 lc = key_code_point(l, i);
+		Py_UCS4 rc = key_code_point(r, i);
+		if(lc != rc)
+			return (lc < rc) ? -1 : 1;
+	}
+	return 0;
+}
+
+// Three-way comparison of two keys.
+inline int compare_keys(const KeyInfo& l, const KeyInfo& r)
+{
+	if(key_is_str(l) != key_is_str(r))
+		return key_is_str(l) ? 1 : -1;
+	if(int cmp = compare_code_points(l, r, std::min(l.data_size, r.data_size)); cmp != 0)
+		return cmp;
+	return (l.data_size > r.data_size) - (l.data_size < r.data_size);
+}
+
+// Whether 'key' starts with 'prefix'.  str keys never start with bytes
+// prefixes and vice versa.
+inline bool key_starts_with(const KeyInfo& key, const KeyInfo& prefix)
+{
+	return (key_is_str(key) == key_is_str(prefix))
+		and (key.data_size >= prefix.data_size)
+		and (compare_code_points(key, prefix, prefix.data_size) == 0);
+}
+
+#endif /* KEY_ORDER_H */
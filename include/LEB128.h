@@ -15,7 +15,7 @@ typedef struct leb128_encoding
 } Leb128Encoding;
 
 
-Leb128Encoding leb128_encode(uint_least64_t value)
+static inline Leb128Encoding leb128_encode(uint_least64_t value)
 {
 	Leb128Encoding enc;
 	unsigned char* byte = enc.encoding;
@@ -30,7 +30,7 @@ Leb128Encoding leb128_encode(uint_least64_t value)
 	return enc;
 }
 
-uint_least64_t leb128_decode(const unsigned char* data, size_t* count)
+static inline uint_least64_t leb128_decode(const unsigned char* data, size_t* count)
 {
 	uint_least64_t value = 0;
 	unsigned char shift = 0;
@@ -43,5 +43,27 @@ uint_least64_t leb128_decode(const unsigned char* data, size_t* count)
 	return value;
 }
 
+/* 
+ * Like leb128_decode(), but never reads at or past 'end'.  Sets '*count' to 
+ * zero if the encoding is truncated or does not fit in 64 bits. 
+ */
+static inline uint_least64_t leb128_decode_bounded(const unsigned char* data, const unsigned char* end, size_t* count)
+{
+	uint_least64_t value = 0;
+	unsigned char shift = 0;
+	const unsigned char* pos = data;
+	do {
+		if((pos >= end) || (shift >= sizeof(value) * CHAR_BIT))
+		{
+			*count = 0;
+			return 0;
+		}
+		value |= ((uint_least64_t)(0x7f & *pos)) << shift;
+		shift += 7;
+	} while(*pos++ & 0x80);
+	*count = pos - data;
+	return value;
+}
+
 
 #endif /* LEB128_H */
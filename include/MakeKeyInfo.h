@@ -4,6 +4,8 @@
 #include "KeyInfo.h"
 #include "StringDictEntry.h"
 #include <variant>
+#include <vector>
+#include <algorithm>
 
 struct KeyMetaInfo
 {
@@ -89,11 +91,27 @@ std::pair<KeyInfo, KeyMetaInfo> make_key_info(PyObject* key)
 		assert(ki.kind >= PY_BYTES);
 		assert(ki.kind <= PY_UCS4);
 		KeyMetaInfo::ensure_no_error(&buff);
-		assert(not KeyMetaInfo(buff).error());
+		assert(buff.buf);
 		return std::make_pair(ki, KeyMetaInfo(buff));
 	}
 }
 
+// Like make_key_info(), but leaves the hash as -1, for callers that hash the 
+// key data themselves.
+std::pair<KeyInfo, KeyMetaInfo> make_unhashed_key_info(PyObject* key)
+{
+	KeyInfo ki;
+	Py_buffer buff;
+	buff.buf = nullptr;
+	if(0 != KeyInfo_InitUnhashed(key, &ki, &buff))
+	{
+		assert(PyErr_Occurred());
+		return std::make_pair(ki, KeyMetaInfo::as_error());
+	}
+	KeyMetaInfo::ensure_no_error(&buff);
+	return std::make_pair(ki, KeyMetaInfo(buff));
+}
+
 KeyInfo make_key_info(const StringDictEntry* ent)
 {
 	KeyInfo ki;
@@ -101,6 +119,115 @@ KeyInfo make_key_info(const StringDictEntry* ent)
 	return ki;
 }
 
+// KeyInfo for raw key data, e.g. a slice of a larger buffer.  There's no key
+// object, so the key is never cached.
+KeyInfo make_key_info(const unsigned char* data, Py_ssize_t size, DataKind kind)
+{
+	KeyInfo ki;
+	ki.key = nullptr;
+	ki.data = data;
+	ki.data_size = size;
+	ki.kind = kind;
+	ki.hash = DataKind_Hash(kind, data, size);
+	return ki;
+}
+
+
+template <class To, class From>
+static void narrow_code_points(const From* first, const From* last, std::vector<unsigned char>& scratch)
+{
+	scratch.resize((last - first) * sizeof(To));
+	To* dest = reinterpret_cast<To*>(scratch.data());
+	for(; first < last; ++first)
+		*dest++ = static_cast<To>(*first);
+}
+
+// KeyInfo for a slice of the data of a str().  Python stores each str in the 
+// narrowest kind that can hold its characters, and strdict compares keys by 
+// kind, so slices that fit in a narrower kind are narrowed into 'scratch'.
+KeyInfo make_str_slice_key_info(const void* data, Py_ssize_t size, DataKind kind, std::vector<unsigned char>& scratch)
+{
+	assert(kind != PY_BYTES);
+	const unsigned char* key_data = static_cast<const unsigned char*>(data);
+	if(kind == PY_UCS2)
+	{
+		const auto* first = static_cast<const Py_UCS2*>(data);
+		const auto* last = first + size;
+		if(std::all_of(first, last, [](Py_UCS2 c) { return c < 0x100; }))
+		{
+			narrow_code_points<Py_UCS1>(first, last, scratch);
+			key_data = scratch.data();
+			kind = PY_UCS1;
+		}
+	}
+	else if(kind == PY_UCS4)
+	{
+		const auto* first = static_cast<const Py_UCS4*>(data);
+		const auto* last = first + size;
+		Py_UCS4 max_char = 0;
+		for(const auto* pos = first; pos < last; ++pos)
+			max_char = std::max(max_char, *pos);
+		if(max_char < 0x100)
+		{
+			narrow_code_points<Py_UCS1>(first, last, scratch);
+			key_data = scratch.data();
+			kind = PY_UCS1;
+		}
+		else if(max_char < 0x10000)
+		{
+			narrow_code_points<Py_UCS2>(first, last, scratch);
+			key_data = scratch.data();
+			kind = PY_UCS2;
+		}
+	}
+	return make_key_info(key_data, size, kind);
+}
+
+// KeyInfo for obj[start:stop], where 'obj' is a str or a bytes-like object,
+// pointing into the storage of 'obj' (or into 'scratch' for narrowed str 
+// slices).  'start' and 'stop' are adjusted like slice indices.
+struct SliceKeyInfo
+{
+	SliceKeyInfo() = default;
+	SliceKeyInfo(const SliceKeyInfo&) = delete;
+	SliceKeyInfo& operator=(const SliceKeyInfo&) = delete;
+
+	~SliceKeyInfo()
+	{
+		if(buff.obj)
+			PyBuffer_Release(&buff);
+	}
 
+	int init(PyObject* obj, Py_ssize_t start, Py_ssize_t stop)
+	{
+		assert(not buff.obj);
+		if(PyUnicode_Check(obj))
+		{
+			PySlice_AdjustIndices(PyUnicode_GET_LENGTH(obj), &start, &stop, 1);
+			Py_ssize_t len = std::max(stop - start, Py_ssize_t(0));
+			int kind = PyUnicode_KIND(obj);
+			const void* data = static_cast<const char*>(PyUnicode_DATA(obj)) + start * kind;
+			if(kind == PyUnicode_1BYTE_KIND)
+				ki = make_key_info(static_cast<const unsigned char*>(data), len, PY_UCS1);
+			else 
+				ki = make_str_slice_key_info(data, len, (kind == PyUnicode_2BYTE_KIND) ? PY_UCS2 : PY_UCS4, scratch);
+			return 0;
+		}
+		if(0 != PyObject_GetBuffer(obj, &buff, PyBUF_SIMPLE))
+		{
+			buff.obj = nullptr;
+			return -1;
+		}
+		PySlice_AdjustIndices(buff.len, &start, &stop, 1);
+		Py_ssize_t len = std::max(stop - start, Py_ssize_t(0));
+		ki = make_key_info(static_cast<const unsigned char*>(buff.buf) + start, len, PY_BYTES);
+		return 0;
+	}
+
+	KeyInfo ki;
+private:
+	Py_buffer buff = {};
+	std::vector<unsigned char> scratch;
+};
 
 #endif /* MAKE_KEY_INFO_H */
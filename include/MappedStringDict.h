@@ -0,0 +1,102 @@
+#ifndef MAPPED_STRING_DICT_H
+#define MAPPED_STRING_DICT_H
+
+#include <Python.h>
+#include <stdint.h>
+#include "KeyInfo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * On-disk strdict format.  Everything is stored in host byte order; the
+ * 'byte_order' field lets readers reject files written on a host with
+ * different endianness.
+ *
+ * 	[header]   StringDictFileHeader
+ * 	[index]    bucket_count offsets of 'index_width' bytes each, -1 for an empty bucket
+ * 	[entries]  count StringDictFileEntry records
+ * 	[records]  one record per entry:
+ * 	             - 1 byte DataKind
+ * 	             - unsigned LEB128 length of the key (in code units)
+ * 	             - the key data, followed by a null byte
+ * 	             - 1 byte StringDictFileValueTag
+ * 	             - the value payload (see StringDictFileValueTag)
+ *
+ * Buckets are probed the same way as in strdict, but with a hash that does not
+ * depend on the hash seed of the process that wrote the file.
+ */
+
+#define STRING_DICT_FILE_MAGIC "STRDICT"
+#define STRING_DICT_FILE_VERSION 1
+#define STRING_DICT_FILE_BYTE_ORDER 0x01020304u
+
+typedef struct string_dict_file_header_ {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t count;
+	uint64_t bucket_count;
+	uint64_t index_width;
+	uint64_t index_offset;
+	uint64_t entries_offset;
+	uint64_t records_offset;
+	uint64_t total_size;
+} StringDictFileHeader;
+
+typedef struct string_dict_file_entry_ {
+	uint64_t hash;
+	/* offset of the record relative to 'records_offset' */
+	uint64_t record;
+} StringDictFileEntry;
+
+typedef enum string_dict_file_value_tag_ {
+	/* no payload */
+	SDF_NONE = 0,
+	/* 1 byte, 0 or 1 */
+	SDF_BOOL = 1,
+	/* 8 byte signed integer */
+	SDF_INT = 2,
+	/* 8 byte IEEE double */
+	SDF_FLOAT = 3,
+	/* unsigned LEB128 length followed by the bytes */
+	SDF_BYTES = 4,
+	/* unsigned LEB128 length followed by the UTF-8 encoded string */
+	SDF_STR = 5
+} StringDictFileValueTag;
+
+extern PyTypeObject MappedStringDict_Type;
+
+/*
+ * Write 'count' key-value pairs to the file at 'path' (a str, bytes or
+ * os.PathLike object).  The file is written to a temporary file next to
+ * 'path' which then atomically replaces 'path', so processes that still have
+ * the old file mapped are unaffected.
+ *
+ * Returns 0 on success, or -1 with an exception set.  Only None, bool, int,
+ * float, bytes and str values are supported.
+ */
+int MappedStringDict_Save(PyObject* path, const KeyInfo* keys, PyObject* const* values, Py_ssize_t count);
+
+/* Map the file at 'path' read-only and return a new mapped_strdict instance. */
+PyObject* MappedStringDict_Open(PyObject* path);
+
+/*
+ * Like MappedStringDict_Save(), but writes to a new POSIX shared memory 
+ * segment.  An existing segment with the same name is unlinked first; 
+ * processes attached to it keep their mapping.
+ */
+int MappedStringDict_SaveShared(PyObject* name, const KeyInfo* keys, PyObject* const* values, Py_ssize_t count);
+
+/* Map the shared memory segment 'name' read-only and return a new mapped_strdict instance. */
+PyObject* MappedStringDict_OpenShared(PyObject* name);
+
+/* Remove the name of a shared memory segment written by MappedStringDict_SaveShared(). */
+int MappedStringDict_UnlinkShared(PyObject* name);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MAPPED_STRING_DICT_H */
@@ -123,4 +123,21 @@ private:
 
 
 
+#if PY_VERSION_HEX < 0x03090000
+inline int PyObject_GC_IsTracked(PyObject* obj)
+{ return PyObject_IS_GC(obj) and _PyObject_GC_IS_TRACKED(obj); }
+
+inline PyObject* PyObject_CallNoArgs(PyObject* func)
+{ return PyObject_CallObject(func, nullptr); }
+
+inline PyObject* PyObject_CallOneArg(PyObject* func, PyObject* arg)
+{ return PyObject_CallFunctionObjArgs(func, arg, nullptr); }
+#endif
+
+// Whether 'obj' is, or may later become, tracked by the garbage collector.
+// Only tuples are untracked for good; other containers can start out 
+// untracked and be tracked later.  Same as CPython's _PyObject_GC_MAY_BE_TRACKED.
+inline bool gc_may_be_tracked(PyObject* obj)
+{ return PyObject_IS_GC(obj) and ((not PyTuple_CheckExact(obj)) or PyObject_GC_IsTracked(obj)); }
+
 #endif /* PYTHON_UTILS_H */
@@ -0,0 +1,106 @@
+#ifndef STRING_DICT_CAPI_H
+#define STRING_DICT_CAPI_H
+
+#include <Python.h>
+#include <stdint.h>
+#include "KeyInfo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * C API of the StringDict module for other extension modules, exported as the
+ * capsule StringDict._C_API.  Get it with StringDict_ImportCAPI().
+ *
+ * Functions are only ever appended to StringDict_CAPI, and each addition bumps
+ * STRING_DICT_CAPI_VERSION, so a module built against an older version of this
+ * header keeps working with newer versions of StringDict.
+ *
+ * Keys are passed as 'length' code units of DataKind 'kind' at 'data': bytes
+ * for PY_BYTES, and the characters of a str for the other kinds.  They are
+ * looked up without creating key objects.  The functions taking a 'dict'
+ * require a strdict (see Check()) and the GIL.
+ */
+
+#define STRING_DICT_CAPSULE_NAME "StringDict._C_API"
+#define STRING_DICT_CAPI_VERSION 2
+
+typedef struct string_dict_capi_ {
+	/* STRING_DICT_CAPI_VERSION of the StringDict module */
+	int version;
+
+	/* Whether 'obj' is a strdict, or an instance of a subtype. */
+	int (*Check)(PyObject* obj);
+
+	/*
+	 * The version tag of the strdict 'dict' (see strdict.version).  It
+	 * changes whenever keys are added or removed or values are replaced, and
+	 * no two states of any strdicts in the process share a version.
+	 */
+	uint64_t (*GetVersion)(PyObject* dict);
+
+	/* Added in version 2 */
+
+	/* Number of keys in 'dict'. */
+	Py_ssize_t (*Size)(PyObject* dict);
+
+	/* Make room for 'count' keys in total.  Returns 0, or -1 on error. */
+	int (*Reserve)(PyObject* dict, Py_ssize_t count);
+
+	/*
+	 * Look up a key.  Returns 1 and a new reference to its value in '*value',
+	 * 0 if the key is missing, or -1 with an exception set.  str keys may be
+	 * passed in any kind that holds their characters.
+	 */
+	int (*Lookup)(PyObject* dict, const void* data, Py_ssize_t length, DataKind kind, PyObject** value);
+
+	/*
+	 * The hash of a key, for LookupHashed().  str keys must be in the
+	 * narrowest kind that holds their characters, like str() stores them.
+	 */
+	Py_hash_t (*Hash)(const void* data, Py_ssize_t length, DataKind kind);
+
+	/*
+	 * Like Lookup(), with the hash of the key computed by Hash() (or equal to
+	 * hash() of the key in python).  The same rules apply to the kind of str
+	 * keys as for Hash().
+	 */
+	int (*LookupHashed)(PyObject* dict, const void* data, Py_ssize_t length, DataKind kind, Py_hash_t hash, PyObject** value);
+
+	/* Add a key or replace its value.  Returns 0, or -1 on error. */
+	int (*SetItem)(PyObject* dict, const void* data, Py_ssize_t length, DataKind kind, PyObject* value);
+
+	/* Remove a key.  Returns 1 if it was removed, 0 if it's missing, or -1 on error. */
+	int (*DelItem)(PyObject* dict, const void* data, Py_ssize_t length, DataKind kind);
+
+	/*
+	 * Iterate like PyDict_Next(), starting with '*pos' set to 0, but with new
+	 * references in '*key' and '*value' (either may be NULL to skip it).
+	 * Returns 1 for each key, 0 at the end, or -1 with an exception set.  The
+	 * dict must not gain or lose keys during the iteration.
+	 */
+	int (*Next)(PyObject* dict, Py_ssize_t* pos, PyObject** key, PyObject** value);
+} StringDict_CAPI;
+
+/*
+ * Import the StringDict module and return its C API, or NULL with an
+ * exception set if it's unavailable or older than this header.
+ */
+static inline const StringDict_CAPI* StringDict_ImportCAPI(void)
+{
+	const StringDict_CAPI* api = (const StringDict_CAPI*)PyCapsule_Import(STRING_DICT_CAPSULE_NAME, 0);
+	if(api && (api->version < STRING_DICT_CAPI_VERSION))
+	{
+		PyErr_Format(PyExc_ImportError, "StringDict C API version %d is older than the required version %d.",
+			api->version, STRING_DICT_CAPI_VERSION);
+		return NULL;
+	}
+	return api;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* STRING_DICT_CAPI_H */
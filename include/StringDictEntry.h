@@ -12,22 +12,56 @@ PyObject* Entry_Value(const StringDictEntry* self);
 
 int Entry_Matches(const StringDictEntry* self, const KeyInfo* ki);
 
+typedef int (*EntryMatchFunc)(const StringDictEntry* self, const KeyInfo* ki);
+
+/* 
+ * Entry_Matches() specialized for keys of the given kind.  Lookups get it 
+ * once instead of dispatching on the kind for every entry they compare.
+ */
+EntryMatchFunc Entry_MatchFunction(DataKind kind);
+
 PyObject* Entry_Value(const StringDictEntry* self);
 
 PyObject* Entry_Key(const StringDictEntry* self);
 
+/* 
+ * New reference to the key of 'self'.  Unlike Entry_Key(), a key that isn't 
+ * cached yet is created without caching it.
+ */
+PyObject* Entry_NewKey(const StringDictEntry* self);
+
+/* Length of the key of 'self' in code units (code points for str keys). */
+Py_ssize_t Entry_KeyLength(const StringDictEntry* self);
+
+/* Kind of the key of 'self'; for keys stored as UTF-8, the kind of the original str. */
+DataKind Entry_KeyKind(const StringDictEntry* self);
+
+/* 
+ * Whether the key of 'self' is stored as UTF-8.  Such entries have no raw key 
+ * data; Entry_AsKeyInfo() can't be used on them.
+ */
+int Entry_IsEncoded(const StringDictEntry* self);
+
 void Entry_SetValue(StringDictEntry* self, PyObject* new_value);
 
 PyObject* Entry_ExchangeValue(StringDictEntry* self, PyObject* new_value);
 
 StringDictEntry* Entry_FromKeyInfo(const KeyInfo* ki, PyObject* value);
 
+/* 
+ * Like Entry_FromKeyInfo(), but never keeps a reference to 'ki->key', and 
+ * stores str keys with code points above U+00FF as UTF-8 when that is shorter.
+ */
+StringDictEntry* Entry_FromKeyInfoCompact(const KeyInfo* ki, PyObject* value);
+
 void Entry_AsKeyInfo(const StringDictEntry* self, KeyInfo* ki);
 
 PyObject* Entry_AsTuple(const StringDictEntry* self);
 
 StringDictEntry* Entry_Copy(const StringDictEntry* other);
 
+int Entry_WriteKeyRepr(const StringDictEntry* self, _PyUnicodeWriter* writer);
+
 int Entry_WriteRepr(const StringDictEntry* self, _PyUnicodeWriter* writer);
 
 void Entry_Delete(StringDictEntry* self);
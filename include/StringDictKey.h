@@ -0,0 +1,39 @@
+#ifndef STRING_DICT_KEY_H
+#define STRING_DICT_KEY_H
+
+#include <Python.h>
+#include "KeyInfo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * strdict.Key: a str or bytes key with its KeyInfo computed up front.
+ * KeyInfo_Init() and KeyInfo_InitUnhashed() copy the KeyInfo of a Key instead
+ * of inspecting and hashing the key again, so a Key can be looked up in any
+ * number of strdicts (and mapped_strdicts) for the cost of one.
+ *
+ * Buffer-protocol keys are copied into a bytes object, so 'ki.key' is always
+ * a strong reference to a str or bytes object that 'ki.data' points into.
+ */
+typedef struct string_dict_key_ {
+	PyObject_HEAD
+	KeyInfo ki;
+} StringDictKey;
+
+extern PyTypeObject StringDictKey_Type;
+
+#define StringDictKey_Check(op) (Py_TYPE(op) == &StringDictKey_Type)
+
+/* The str or bytes object of 'key' if it's a Key, else 'key'.  Borrowed. */
+static inline PyObject* StringDictKey_Unwrap(PyObject* key)
+{
+	return StringDictKey_Check(key) ? ((StringDictKey*)key)->ki.key : key;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* STRING_DICT_KEY_H */
@@ -38,7 +38,22 @@ PyDoc_STRVAR(strdict_doc,
 "    for k, v in iterable:\n"
 "        d[k] = v\n"
 "StringDict(**kwargs) -> new string dictionary initialized with the name=value pairs\n"
-"    in the keyword argument list.  For example:  StringDict(one=1, two=2)");
+"    in the keyword argument list.  For example:  StringDict(one=1, two=2)\n"
+"\n"
+"StringDict(..., value_type='i8') or StringDict(..., value_type='f8') store the values\n"
+"unboxed as 64-bit integers or floats, and export them in insertion order with the\n"
+"buffer protocol, e.g. memoryview(D).  Entries can't be added or removed while the\n"
+"values are exported.\n"
+"\n"
+"StringDict(..., prefix_index=True) also keeps the keys in sorted order, for\n"
+"D.keys_with_prefix(), D.items_with_prefix() and D.count_prefix().\n"
+"\n"
+"StringDict(..., key_width=N) only takes bytes keys of exactly N bytes, such as UUIDs\n"
+"or digests.  The key bytes are used as the hash, and no key objects are kept.\n"
+"\n"
+"StringDict(..., compact_keys=True) doesn't keep the key objects either, and stores\n"
+"non-Latin-1 str keys as UTF-8 when that is shorter.  Keys are created when they're\n"
+"needed.  compact_keys can't be combined with prefix_index=True.");
 
 PyDoc_STRVAR(getitem__doc__, "x.__getitem__(y) <==> x[y]");
 
@@ -62,6 +77,50 @@ In either case, this is followed by: for k in F:  D[k] = F[k]");
 PyDoc_STRVAR(clear__doc__,
 "D.clear() -> None.  Remove all items from D.");
 
+PyDoc_STRVAR(strdict_key_doc,
+"strdict.Key(key) -> a prehashed strdict key.\n"
+"\n"
+"key is a str or a bytes-like object (which is copied to bytes).  A Key can be used\n"
+"in place of key with any strdict or mapped_strdict method, without inspecting or\n"
+"hashing key again.  Useful for looking up the same key in many dicts.");
+
+PyDoc_STRVAR(strdict_key_key__doc__,
+"The str or bytes object of the key.");
+
+PyDoc_STRVAR(strdict_chain_doc,
+"strdict.chain(*maps) -> a view of several strdicts as one mapping.\n"
+"\n"
+"Like collections.ChainMap, a key resolves to its value in the first of maps that\n"
+"has it, and setting or deleting keys changes only the first map.  The key is\n"
+"hashed once per lookup, and where each key was found is remembered until any of\n"
+"maps adds or removes keys.  __missing__() of the maps is not called.");
+
+PyDoc_STRVAR(strdict_chain_get__doc__,
+"C.get(k[,d]) -> C[k] if k in C, else d.  d defaults to None.");
+
+PyDoc_STRVAR(strdict_chain_keys__doc__,
+"C.keys() -> list of the distinct keys of C.maps: the keys of the first map, then\n\
+the keys of each later map that aren't in an earlier one.");
+
+PyDoc_STRVAR(strdict_chain_values__doc__,
+"C.values() -> list of the values of C.keys().");
+
+PyDoc_STRVAR(strdict_chain_items__doc__,
+"C.items() -> list of the (key, value) pairs of C.keys().");
+
+PyDoc_STRVAR(strdict_chain_maps__doc__,
+"Tuple of the chained strdicts, searched first to last.");
+
+PyDoc_STRVAR(strdefaultdict_doc,
+"strdefaultdict(default_factory=None, /, [...]) --> strdict with default factory\n\
+\n\
+Like collections.defaultdict, but a strdict: looking up a missing key inserts and\n\
+returns default_factory().  The remaining arguments are passed to strdict().");
+
+PyDoc_STRVAR(default_factory__doc__,
+"Factory for default values, called by __getitem__ for missing keys; None to raise\n\
+KeyError instead.");
+
 PyDoc_STRVAR(copy__doc__,
 "D.copy() -> a shallow copy of D");
 
@@ -74,5 +133,149 @@ PyDoc_STRVAR(items__doc__,
 PyDoc_STRVAR(values__doc__,
 "D.values() -> an object providing a view on D's values");
 
+PyDoc_STRVAR(getstate__doc__,
+"D.__getstate__() -> (keys, values).  keys is a compact dump of the stored key\n\
+data and hashes, values is a list of the corresponding values.");
+
+PyDoc_STRVAR(setstate__doc__,
+"D.__setstate__(state) -> None.  Replace the contents of D with a state from\n\
+__getstate__().  Keys are not re-compared, and are only rehashed if the state\n\
+came from a process with a different hash seed.");
+
+PyDoc_STRVAR(reduce__doc__,
+"Helper for pickle.");
+
+PyDoc_STRVAR(save__doc__,
+"D.save(path) -> None.  Write D to path in a format that strdict.open_mmap() can map.\n\
+Only None, bool, int, float, bytes and str values are supported.  The file is\n\
+replaced atomically, so readers that still map an older version are unaffected.");
+
+PyDoc_STRVAR(open_mmap__doc__,
+"strdict.open_mmap(path) -> mapped_strdict.  Map a file written by D.save() read-only.\n\
+Lookups are served from the mapped file without materializing the entries, and\n\
+the pages are shared between all processes that map the same file.");
+
+PyDoc_STRVAR(save_shared__doc__,
+"D.save_shared(name) -> None.  Like D.save(), but writes to a new POSIX shared memory\n\
+segment that other processes can map with strdict.attach_shared(name).  An existing\n\
+segment with the same name is unlinked first.");
+
+PyDoc_STRVAR(attach_shared__doc__,
+"strdict.attach_shared(name) -> mapped_strdict.  Map a shared memory segment written by\n\
+D.save_shared() read-only.  All processes that attach share one physical copy.");
+
+PyDoc_STRVAR(unlink_shared__doc__,
+"strdict.unlink_shared(name) -> None.  Remove the name of a shared memory segment\n\
+written by D.save_shared().  Existing mappings stay valid.");
+
+PyDoc_STRVAR(increment__doc__,
+"D.increment(k, delta=1) -> D[k] + delta.  Add delta to D[k], which is treated as 0\n\
+if k is not in D, and return the new value.  k is looked up once\n\
+unless adding runs python code.");
+
+PyDoc_STRVAR(count__doc__,
+"D.count(iterable) -> None.  Increment D[k] by one for every k in iterable, as if by\n\
+D.increment(k).");
+
+PyDoc_STRVAR(from_buffer__doc__,
+"strdict.from_buffer(data, line_sep=b'\\n', kv_sep=b'\\t', value_parser=None,\n\
+                    decode_keys=False, value_type=None) -> new strdict.\n\
+Load the lines of a bytes-like object (such as an mmap.mmap of a file) of the form\n\
+<key><kv_sep><value>.  Empty lines are skipped, and later lines replace earlier ones.\n\
+The keys are hashed and copied straight from data: as bytes, or as str decoded from\n\
+UTF-8 if decode_keys is true.  Values are the bytes after kv_sep, or the result of\n\
+value_parser(value_bytes).  int and float are parsed without calling them when\n\
+possible, and with value_type='i8' or 'f8' no value objects are created at all.");
+
+PyDoc_STRVAR(lookup_tokens__doc__,
+"D.lookup_tokens(text, sep=None, default=-1) -> list.  Split text (a str or bytes-like\n\
+object) on sep like text.split(sep), and return the value of each token in D, or\n\
+default for tokens that aren't in D.  If sep is None, text is split on runs of\n\
+whitespace.  The tokens are looked up straight from text without creating str or\n\
+bytes objects.");
+
+PyDoc_STRVAR(slot__doc__,
+"D.slot(key) -> a handle for reading and writing D[key].  The handle remembers where\n\
+key is stored, and only looks it up again after keys were added to or removed from D.");
+
+PyDoc_STRVAR(strdict_slot_doc,
+"Handle for one key of a strdict, returned by strdict.slot(key).");
+
+PyDoc_STRVAR(strdict_slot_get__doc__,
+"S.get([default]) -> the value of the key of S in its strdict, or default (None) if\n\
+the key is missing.  __missing__() is not called.");
+
+PyDoc_STRVAR(strdict_slot_set__doc__,
+"S.set(value) -> None.  Set the value of the key of S in its strdict.");
+
+PyDoc_STRVAR(strdict_slot_key__doc__,
+"The key of the slot.");
+
+PyDoc_STRVAR(get_path__doc__,
+"D.get_path(path, sep='.', default=None) -> the value at path in nested strdicts.\n\
+path (a str or bytes-like object) is split on sep like path.split(sep), and each\n\
+segment is looked up in the value of the previous one, starting with D.  Returns\n\
+default if a segment is missing or a value before the last segment isn't a strdict.\n\
+Segments are looked up straight from path without creating str or bytes objects.");
+
+PyDoc_STRVAR(set_path__doc__,
+"D.set_path(path, value, sep='.') -> None.  Set the value at path in nested strdicts,\n\
+like D.get_path(), adding a new strdict for each missing level.  Raises TypeError\n\
+if a value before the last segment isn't a strdict.");
+
+PyDoc_STRVAR(get_slice__doc__,
+"D.get_slice(obj, start, stop, default=None) -> D.get(obj[start:stop], default), but\n\
+without creating obj[start:stop].  obj is a str or a bytes-like object.");
+
+PyDoc_STRVAR(contains_slice__doc__,
+"D.contains_slice(obj, start, stop) -> obj[start:stop] in D, but without creating\n\
+obj[start:stop].  obj is a str or a bytes-like object.");
+
+PyDoc_STRVAR(longest_prefix__doc__,
+"D.longest_prefix(s, start=0) -> (k, v) or None.  Return the item of D with the longest\n\
+key k that s[start:] starts with, or None if there is none.  Only key lengths that\n\
+occur in D are tried, and no substrings of s are created.");
+
+PyDoc_STRVAR(keys_with_prefix__doc__,
+"D.keys_with_prefix(p) -> list of the keys of D that start with p, in sorted order.\n\
+str prefixes only match str keys and bytes prefixes only match bytes keys.\n\
+D must have been created with prefix_index=True.");
+
+PyDoc_STRVAR(items_with_prefix__doc__,
+"D.items_with_prefix(p) -> list of the (k, v) items of D whose keys start with p, in\n\
+sorted order.  D must have been created with prefix_index=True.");
+
+PyDoc_STRVAR(count_prefix__doc__,
+"D.count_prefix(p) -> number of keys of D that start with p.  D must have been created\n\
+with prefix_index=True.");
+
+PyDoc_STRVAR(sorted_items__doc__,
+"D.sorted_items(start=None, stop=None) -> list of the (k, v) items of D with\n\
+start <= k < stop, sorted by key.  bytes keys come before str keys, and None bounds\n\
+are open.  The keys are sorted natively by their code points (with the prefix index,\n\
+if D has one).");
+
+PyDoc_STRVAR(version__doc__,
+"Version tag of D.  It changes whenever keys are added or removed or values are\n\
+replaced (but not when a value object is mutated), and no two states of any strdicts\n\
+share a version, so derived data can be cached with the version it was computed at.\n\
+Values written through an exported buffer only change the version once the buffer\n\
+is released.  Also available to C extensions through StringDict._C_API.");
+
+PyDoc_STRVAR(key_width__doc__,
+"The fixed size in bytes of the keys of D, or None if D takes any str or bytes keys.\n\
+Fixed-width dicts are meant for uniformly distributed keys like UUIDs and digests;\n\
+the key bytes are used as the hash.");
+
+PyDoc_STRVAR(compact_keys__doc__,
+"Whether D stores its keys compactly: without keeping the key objects, and with str\n\
+keys that have code points above U+00FF stored as UTF-8 when that is shorter.");
+
+PyDoc_STRVAR(prefix_index__doc__,
+"Whether D keeps its keys in sorted order for prefix queries.");
+
+PyDoc_STRVAR(value_type__doc__,
+"How the values are stored: 'O' for python objects, 'i8' for 64-bit integers and\n\
+'f8' for 64-bit floats.");
 
 #endif /* STRINGDICT_DOCS_ */
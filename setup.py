@@ -1,9 +1,10 @@
 from distutils.core import setup, Extension
 
 StringDict_module = Extension('StringDict',
-                    sources = ['src/StringDict.cpp', 'src/StringDictEntry.c', 'src/KeyInfo.c'],
-                    depends = ['LEB128.h', 'MakeKeyInfo.h', 'PythonUtils.h', 'StringDict_Docs.h', 'StringDictEntry.h', 'setup.py'],
+                    sources = ['src/StringDict.cpp', 'src/StringDictEntry.c', 'src/KeyInfo.c', 'src/MappedStringDict.cpp'],
+                    depends = ['BasicStringDict.h', 'KeyOrder.h', 'LEB128.h', 'MakeKeyInfo.h', 'MappedStringDict.h', 'PythonUtils.h', 'StringDict_Docs.h', 'StringDictCAPI.h', 'StringDictEntry.h', 'StringDictKey.h', 'setup.py'],
                     include_dirs = ['include'],
+                    libraries = ['rt'],
 		    extra_compile_args = ["-std=c++17", "-O3", '-fno-delete-null-pointer-checks'])
 
 setup (name = 'StringDict',
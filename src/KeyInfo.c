@@ -1,4 +1,5 @@
 #include "KeyInfo.h"
+#include "StringDictKey.h"
 #include <stdbool.h>
 
 void DataKind_Info(DataKind kind, Py_ssize_t* size, Py_ssize_t* alignment)
@@ -46,21 +47,27 @@ Py_ssize_t DataKind_Alignment(DataKind kind)
 	return alignment;
 }
 
-int KeyInfo_Init(PyObject* key, KeyInfo* ki, Py_buffer* buff)
+Py_hash_t DataKind_Hash(DataKind kind, const void* data, Py_ssize_t size)
+{
+	// Both str() and bytes() hash their raw data with _Py_HashBytes()
+	return _Py_HashBytes(data, size * DataKind_ItemSize(kind));
+}
+
+int KeyInfo_InitUnhashed(PyObject* key, KeyInfo* ki, Py_buffer* buff)
 {
 	assert(key);
 	assert(ki);
 
-	// Bypass user-defined hashes for str() and bytes() subtypes.  
-	// Sounds bad, but this hash table is for strings and other string-like
-	// data, so we treat strings as strings here.  
+	ki->hash = -1;
+	if(StringDictKey_Check(key))
+	{
+		*ki = ((StringDictKey*)key)->ki;
+		ki->hash = -1;
+		return 0;
+	}
 	if(PyUnicode_Check(key))
 	{
 		ki->key = key;
-		ki->hash = PyUnicode_Type.tp_hash(key);
-		if((ki->hash == -1) && PyErr_Occurred())
-			return -1;
-
 		int _kind = PyUnicode_KIND(key);
 		switch(_kind)
 		{
@@ -87,17 +94,12 @@ int KeyInfo_Init(PyObject* key, KeyInfo* ki, Py_buffer* buff)
 	{
 		ki->key = key;
 		ki->kind = PY_BYTES;
-		ki->hash = PyBytes_Type.tp_hash(key);
-		if((ki->hash == -1) && PyErr_Occurred())
-			return -1;
 		char* data;
 		Py_ssize_t len;
 		if(0 != PyBytes_AsStringAndSize(key, &data, &len))
 			return -1;
 		ki->data = (unsigned char*)data;
 		ki->data_size = len;
-		assert(ki->kind >= PY_BYTES);
-		assert(ki->kind <= PY_UCS4);
 		return 0;
 	}
 	else
@@ -110,11 +112,35 @@ int KeyInfo_Init(PyObject* key, KeyInfo* ki, Py_buffer* buff)
 		ki->kind = PY_BYTES;
 		ki->data = buff->buf;
 		ki->data_size = buff->len;
-		ki->hash = _Py_HashBytes(ki->data, ki->data_size);
-		assert(ki->kind >= PY_BYTES);
-		assert(ki->kind <= PY_UCS4);
 		return 0;
 	}
-
 }
 
+int KeyInfo_Init(PyObject* key, KeyInfo* ki, Py_buffer* buff)
+{
+	if(StringDictKey_Check(key))
+	{
+		*ki = ((StringDictKey*)key)->ki;
+		return 0;
+	}
+	if(0 != KeyInfo_InitUnhashed(key, ki, buff))
+		return -1;
+
+	// Bypass user-defined hashes for str() and bytes() subtypes.  
+	// Sounds bad, but this hash table is for strings and other string-like
+	// data, so we treat strings as strings here.  
+	if(PyUnicode_Check(key))
+		ki->hash = PyUnicode_Type.tp_hash(key);
+	else if(PyBytes_Check(key))
+		ki->hash = PyBytes_Type.tp_hash(key);
+	else
+		ki->hash = _Py_HashBytes(ki->data, ki->data_size);
+
+	if((ki->hash == -1) && PyErr_Occurred())
+	{
+		if(!ki->key)
+			PyBuffer_Release(buff);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,996 @@
+#include <Python.h>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <new>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "MappedStringDict.h"
+#include "StringDictKey.h"
+#include "PythonUtils.h"
+#include "LEB128.h"
+
+namespace {
+
+using std::uint64_t;
+using std::int64_t;
+
+constexpr const uint64_t perturb_shift = 5;
+constexpr const double max_load_factor = 0.667;
+constexpr const uint64_t min_buckets = 8;
+
+// Hash of the raw key data that, unlike _Py_HashBytes(), doesn't depend on the
+// hash seed of the current process.  Reads the data 8 bytes at a time and
+// finishes with the splitmix64 finalizer.
+uint64_t stable_hash(const unsigned char* data, std::size_t len)
+{
+	constexpr const uint64_t mul = 0x9e3779b97f4a7c15ull;
+	uint64_t h = len * mul;
+	for(; len >= sizeof(uint64_t); data += sizeof(uint64_t), len -= sizeof(uint64_t))
+	{
+		uint64_t word;
+		std::memcpy(&word, data, sizeof(word));
+		h = (h ^ word) * mul;
+		h ^= h >> 32;
+	}
+	if(len > 0)
+	{
+		uint64_t word = 0;
+		std::memcpy(&word, data, len);
+		h = (h ^ word) * mul;
+		h ^= h >> 32;
+	}
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ull;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebull;
+	h ^= h >> 31;
+	return h;
+}
+
+uint64_t key_hash(const KeyInfo& ki)
+{
+	return stable_hash(ki.data, ki.data_size * DataKind_ItemSize(ki.kind));
+}
+
+// Same probe sequence as CPython's dict.  Terminates as long as there is at
+// least one open bucket.
+template <class Pred>
+void visit_buckets(uint64_t hash, uint64_t mask, Pred pred)
+{
+	uint64_t perturb = hash;
+	for(uint64_t idx = hash & mask; not pred(idx); idx = mask & (idx * 5 + perturb + 1))
+		perturb >>= perturb_shift;
+}
+
+int64_t load_index(const unsigned char* index, uint64_t width, uint64_t bucket)
+{
+	if(width == sizeof(std::int32_t))
+	{
+		std::int32_t ofs;
+		std::memcpy(&ofs, index + bucket * width, sizeof(ofs));
+		return ofs;
+	}
+	int64_t ofs;
+	std::memcpy(&ofs, index + bucket * width, sizeof(ofs));
+	return ofs;
+}
+
+void store_index(unsigned char* index, uint64_t width, uint64_t bucket, int64_t value)
+{
+	if(width == sizeof(std::int32_t))
+	{
+		std::int32_t ofs = static_cast<std::int32_t>(value);
+		std::memcpy(index + bucket * width, &ofs, sizeof(ofs));
+	}
+	else
+	{
+		std::memcpy(index + bucket * width, &value, sizeof(value));
+	}
+}
+
+uint64_t round_up(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+struct EncodedValue
+{
+	StringDictFileValueTag tag;
+	long long int_value = 0;
+	double float_value = 0.0;
+	const char* data = nullptr;
+	Py_ssize_t size = 0;
+
+	std::size_t payload_size() const
+	{
+		switch(tag)
+		{
+		case SDF_NONE:
+			return 0;
+		case SDF_BOOL:
+			return 1;
+		case SDF_INT:
+			return sizeof(int_value);
+		case SDF_FLOAT:
+			return sizeof(float_value);
+		case SDF_BYTES:
+		case SDF_STR:
+			return leb128_encode(size).len + size;
+		}
+		assert(false);
+		return 0;
+	}
+
+	unsigned char* write(unsigned char* pos) const
+	{
+		*pos++ = static_cast<unsigned char>(tag);
+		switch(tag)
+		{
+		case SDF_NONE:
+			break;
+		case SDF_BOOL:
+			*pos++ = static_cast<unsigned char>(int_value);
+			break;
+		case SDF_INT:
+			std::memcpy(pos, &int_value, sizeof(int_value));
+			pos += sizeof(int_value);
+			break;
+		case SDF_FLOAT:
+			std::memcpy(pos, &float_value, sizeof(float_value));
+			pos += sizeof(float_value);
+			break;
+		case SDF_BYTES:
+		case SDF_STR:
+		{
+			Leb128Encoding enc = leb128_encode(size);
+			std::memcpy(pos, enc.encoding, enc.len);
+			pos += enc.len;
+			std::memcpy(pos, data, size);
+			pos += size;
+			break;
+		}
+		}
+		return pos;
+	}
+};
+
+int encode_value(PyObject* value, EncodedValue* enc)
+{
+	if(value == Py_None)
+	{
+		enc->tag = SDF_NONE;
+	}
+	else if(PyBool_Check(value))
+	{
+		enc->tag = SDF_BOOL;
+		enc->int_value = (value == Py_True);
+	}
+	else if(PyLong_CheckExact(value))
+	{
+		enc->tag = SDF_INT;
+		enc->int_value = PyLong_AsLongLong(value);
+		if((enc->int_value == -1) and PyErr_Occurred())
+			return -1;
+	}
+	else if(PyFloat_CheckExact(value))
+	{
+		enc->tag = SDF_FLOAT;
+		enc->float_value = PyFloat_AS_DOUBLE(value);
+	}
+	else if(PyBytes_CheckExact(value))
+	{
+		enc->tag = SDF_BYTES;
+		enc->data = PyBytes_AS_STRING(value);
+		enc->size = PyBytes_GET_SIZE(value);
+	}
+	else if(PyUnicode_CheckExact(value))
+	{
+		enc->tag = SDF_STR;
+		enc->data = PyUnicode_AsUTF8AndSize(value, &(enc->size));
+		if(not enc->data)
+			return -1;
+	}
+	else
+	{
+		PyErr_Format(PyExc_TypeError, "Cannot save strdict value of type '%.200s'; only None, "
+			"bool, int, float, bytes and str values are supported.", Py_TYPE(value)->tp_name);
+		return -1;
+	}
+	return 0;
+}
+
+std::size_t key_record_size(const KeyInfo& ki)
+{
+	return 1 + leb128_encode(ki.data_size).len + ki.data_size * DataKind_ItemSize(ki.kind) + 1;
+}
+
+unsigned char* write_key_record(unsigned char* pos, const KeyInfo& ki)
+{
+	*pos++ = static_cast<unsigned char>(ki.kind);
+	Leb128Encoding enc = leb128_encode(ki.data_size);
+	std::memcpy(pos, enc.encoding, enc.len);
+	pos += enc.len;
+	std::size_t data_bytes = ki.data_size * DataKind_ItemSize(ki.kind);
+	std::memcpy(pos, ki.data, data_bytes);
+	pos += data_bytes;
+	*pos++ = '\0';
+	return pos;
+}
+
+// Computes the layout of the file and writes it to 'dest', which must be at
+// least 'total_size()' bytes.
+struct FileWriter
+{
+	FileWriter(const KeyInfo* keys_, PyObject* const* values_, Py_ssize_t count_):
+		keys(keys_), values(values_), count(count_)
+	{
+
+	}
+
+	// Validates the values and computes the layout.  May throw std::bad_alloc.
+	int prepare()
+	{
+		encoded.resize(count);
+		hashes.resize(count);
+		records.resize(count);
+		uint64_t record_pos = 0;
+		for(Py_ssize_t i = 0; i < count; ++i)
+		{
+			if(0 != encode_value(values[i], &encoded[i]))
+				return -1;
+			hashes[i] = key_hash(keys[i]);
+			records[i] = record_pos;
+			record_pos += key_record_size(keys[i]) + 1 + encoded[i].payload_size();
+		}
+
+		bucket_count = min_buckets;
+		while(bucket_count * max_load_factor <= static_cast<double>(count))
+			bucket_count <<= 1;
+		index_width = (bucket_count <= INT32_MAX) ? sizeof(std::int32_t) : sizeof(int64_t);
+
+		std::memcpy(header.magic, STRING_DICT_FILE_MAGIC, sizeof(STRING_DICT_FILE_MAGIC));
+		header.version = STRING_DICT_FILE_VERSION;
+		header.byte_order = STRING_DICT_FILE_BYTE_ORDER;
+		header.count = count;
+		header.bucket_count = bucket_count;
+		header.index_width = index_width;
+		header.index_offset = round_up(sizeof(StringDictFileHeader), alignof(int64_t));
+		header.entries_offset = round_up(header.index_offset + bucket_count * index_width, alignof(StringDictFileEntry));
+		header.records_offset = header.entries_offset + count * sizeof(StringDictFileEntry);
+		header.total_size = header.records_offset + record_pos;
+		return 0;
+	}
+
+	uint64_t total_size() const
+	{ return header.total_size; }
+
+	void write(unsigned char* dest) const
+	{
+		unsigned char* index = dest + header.index_offset;
+		std::memset(index, 0xff, bucket_count * index_width);
+		auto* entries = reinterpret_cast<StringDictFileEntry*>(dest + header.entries_offset);
+		unsigned char* record_base = dest + header.records_offset;
+		uint64_t mask = bucket_count - 1;
+		for(Py_ssize_t i = 0; i < count; ++i)
+		{
+			entries[i].hash = hashes[i];
+			entries[i].record = records[i];
+			unsigned char* pos = write_key_record(record_base + records[i], keys[i]);
+			encoded[i].write(pos);
+			visit_buckets(hashes[i], mask, [&](uint64_t bucket) {
+				if(load_index(index, index_width, bucket) >= 0)
+					return false;
+				store_index(index, index_width, bucket, i);
+				return true;
+			});
+		}
+		// Write the header (and with it, the magic string) last so that a 
+		// process attaching to a shared memory segment that is still being 
+		// written never sees a valid-looking header.
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(dest, &header, sizeof(header));
+	}
+
+	const KeyInfo* keys;
+	PyObject* const* values;
+	Py_ssize_t count;
+	std::vector<EncodedValue> encoded;
+	std::vector<uint64_t> hashes;
+	std::vector<uint64_t> records;
+	uint64_t bucket_count = 0;
+	uint64_t index_width = 0;
+	StringDictFileHeader header{};
+};
+
+int write_fd(int fd, PyObject* name, const FileWriter& writer)
+{
+	if(0 != ftruncate(fd, writer.total_size()))
+	{
+		PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+		return -1;
+	}
+	void* mem = mmap(nullptr, writer.total_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(mem == MAP_FAILED)
+	{
+		PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+		return -1;
+	}
+	writer.write(static_cast<unsigned char*>(mem));
+	munmap(mem, writer.total_size());
+	return 0;
+}
+
+int write_file(const std::string& path, PyObject* path_obj, const FileWriter& writer)
+{
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path_obj);
+		return -1;
+	}
+	auto fd_guard = make_scope_guard([&](){ close(fd); });
+	return write_fd(fd, path_obj, writer);
+}
+
+// Convert the name of a shared memory segment to the form shm_open() 
+// expects, i.e. with a leading '/'.
+bool shared_memory_name(PyObject* name, std::string* out)
+{
+	PyObject* name_bytes_ = nullptr;
+	if(not PyUnicode_FSConverter(name, &name_bytes_))
+		return false;
+	PythonObject name_bytes(name_bytes_);
+	out->assign(PyBytes_AS_STRING(name_bytes.get()));
+	if(out->empty() or (out->front() != '/'))
+		out->insert(out->begin(), '/');
+	return true;
+}
+
+} /* namespace */
+
+struct MappedStringDict:
+	public PyObject
+{
+	struct Record
+	{
+		DataKind kind;
+		const unsigned char* data;
+		Py_ssize_t size;
+		const unsigned char* value;
+	};
+
+	bool is_closed() const
+	{ return not base; }
+
+	std::size_t size() const
+	{ return header()->count; }
+
+	const StringDictFileHeader* header() const
+	{ return reinterpret_cast<const StringDictFileHeader*>(base); }
+
+	const StringDictFileEntry* entry_at(uint64_t index) const
+	{ return reinterpret_cast<const StringDictFileEntry*>(base + header()->entries_offset) + index; }
+
+	const unsigned char* records_end() const
+	{ return base + map_size; }
+
+	static int validate(const unsigned char* mem, std::size_t size)
+	{
+		StringDictFileHeader hdr;
+		if(size < sizeof(hdr))
+			return corrupt();
+		std::memcpy(&hdr, mem, sizeof(hdr));
+		if(0 != std::memcmp(hdr.magic, STRING_DICT_FILE_MAGIC, sizeof(STRING_DICT_FILE_MAGIC)))
+		{
+			PyErr_SetString(PyExc_ValueError, "File is not a saved strdict.");
+			return -1;
+		}
+		if(hdr.version != STRING_DICT_FILE_VERSION)
+		{
+			PyErr_Format(PyExc_ValueError, "Unsupported strdict file version %u.", (unsigned)hdr.version);
+			return -1;
+		}
+		if(hdr.byte_order != STRING_DICT_FILE_BYTE_ORDER)
+		{
+			PyErr_SetString(PyExc_ValueError, "strdict file was written on a host with a different byte order.");
+			return -1;
+		}
+		bool valid = (hdr.total_size == size)
+			and (hdr.bucket_count >= min_buckets)
+			and ((hdr.bucket_count & (hdr.bucket_count - 1)) == 0)
+			and (hdr.count < hdr.bucket_count)
+			and ((hdr.index_width == sizeof(std::int32_t)) or (hdr.index_width == sizeof(int64_t)))
+			and (hdr.index_offset >= sizeof(hdr))
+			and (hdr.entries_offset % alignof(StringDictFileEntry) == 0)
+			and (hdr.index_offset + hdr.bucket_count * hdr.index_width <= hdr.entries_offset)
+			and (hdr.entries_offset + hdr.count * sizeof(StringDictFileEntry) == hdr.records_offset)
+			and (hdr.records_offset <= size);
+		return valid ? 0 : corrupt();
+	}
+
+	static int corrupt()
+	{
+		PyErr_SetString(PyExc_ValueError, "Corrupt strdict file.");
+		return -1;
+	}
+
+	// Decode the record of the given entry.  Bounds-checked so that a damaged
+	// file raises an exception instead of reading past the end of the mapping.
+	int record_at(const StringDictFileEntry* ent, Record* rec) const
+	{
+		const unsigned char* pos = base + header()->records_offset;
+		const unsigned char* end = records_end();
+		if(ent->record >= static_cast<uint64_t>(end - pos))
+			return corrupt();
+		pos += ent->record;
+		if(*pos > PY_UCS4)
+			return corrupt();
+		rec->kind = static_cast<DataKind>(*pos++);
+		std::size_t count = 0;
+		uint64_t len = leb128_decode_bounded(pos, end, &count);
+		if(not count)
+			return corrupt();
+		pos += count;
+		uint64_t data_bytes = len * DataKind_ItemSize(rec->kind);
+		// data, null terminator and value tag
+		if((len > static_cast<uint64_t>(end - pos)) or (data_bytes + 2 > static_cast<uint64_t>(end - pos)))
+			return corrupt();
+		rec->data = pos;
+		rec->size = len;
+		rec->value = pos + data_bytes + 1;
+		return 0;
+	}
+
+	// Returns the entry matching 'ki', nullptr if there isn't one, or sets an
+	// exception and returns nullptr.
+	const StringDictFileEntry* find(const KeyInfo& ki) const
+	{
+		const StringDictFileHeader* hdr = header();
+		const unsigned char* index = base + hdr->index_offset;
+		uint64_t hash = key_hash(ki);
+		const StringDictFileEntry* found = nullptr;
+		Record rec;
+		visit_buckets(hash, hdr->bucket_count - 1, [&](uint64_t bucket) {
+			int64_t ofs = load_index(index, hdr->index_width, bucket);
+			if(ofs < 0)
+				return true;
+			if(static_cast<uint64_t>(ofs) >= hdr->count)
+			{
+				corrupt();
+				return true;
+			}
+			const StringDictFileEntry* ent = entry_at(ofs);
+			if(ent->hash != hash)
+				return false;
+			if(0 != record_at(ent, &rec))
+				return true;
+			if((rec.kind == ki.kind) and (rec.size == ki.data_size)
+				and (0 == std::memcmp(rec.data, ki.data, ki.data_size * DataKind_ItemSize(ki.kind))))
+			{
+				found = ent;
+				return true;
+			}
+			return false;
+		});
+		return found;
+	}
+
+	PyObject* make_value(const Record& rec) const
+	{
+		const unsigned char* pos = rec.value;
+		const unsigned char* end = records_end();
+		switch(*pos++)
+		{
+		case SDF_NONE:
+			Py_RETURN_NONE;
+		case SDF_BOOL:
+			if(pos >= end)
+				break;
+			return PyBool_FromLong(*pos);
+		case SDF_INT:
+		{
+			long long value;
+			if(static_cast<std::size_t>(end - pos) < sizeof(value))
+				break;
+			std::memcpy(&value, pos, sizeof(value));
+			return PyLong_FromLongLong(value);
+		}
+		case SDF_FLOAT:
+		{
+			double value;
+			if(static_cast<std::size_t>(end - pos) < sizeof(value))
+				break;
+			std::memcpy(&value, pos, sizeof(value));
+			return PyFloat_FromDouble(value);
+		}
+		case SDF_BYTES:
+		case SDF_STR:
+		{
+			std::size_t count = 0;
+			uint64_t len = leb128_decode_bounded(pos, end, &count);
+			if((not count) or (len > static_cast<uint64_t>(end - pos - count)))
+				break;
+			const char* data = reinterpret_cast<const char*>(pos + count);
+			if(rec.value[0] == SDF_BYTES)
+				return PyBytes_FromStringAndSize(data, len);
+			else
+				return PyUnicode_DecodeUTF8(data, len, nullptr);
+		}
+		default:
+			break;
+		}
+		corrupt();
+		return nullptr;
+	}
+
+	static PyObject* make_key(const Record& rec)
+	{
+		if(rec.kind == PY_BYTES)
+			return PyBytes_FromStringAndSize(reinterpret_cast<const char*>(rec.data), rec.size);
+		static constexpr const int unicode_kinds[] = {
+			0, PyUnicode_1BYTE_KIND, PyUnicode_2BYTE_KIND, PyUnicode_4BYTE_KIND
+		};
+		return PyUnicode_FromKindAndData(unicode_kinds[rec.kind], rec.data, rec.size);
+	}
+
+	PyObject* lookup(PyObject* key, PyObject* default_value)
+	{
+		if(ensure_open() < 0)
+			return nullptr;
+		KeyInfo ki;
+		Py_buffer buff;
+		if(0 != KeyInfo_InitUnhashed(key, &ki, &buff))
+			return nullptr;
+		auto buff_guard = make_scope_guard([&]() {
+			if(not ki.key)
+				PyBuffer_Release(&buff);
+		});
+		const StringDictFileEntry* ent = find(ki);
+		if(PyErr_Occurred())
+			return nullptr;
+		if(not ent)
+		{
+			if(default_value)
+			{
+				Py_INCREF(default_value);
+				return default_value;
+			}
+			PyErr_SetObject(PyExc_KeyError, StringDictKey_Unwrap(key));
+			return nullptr;
+		}
+		Record rec;
+		if(0 != record_at(ent, &rec))
+			return nullptr;
+		return make_value(rec);
+	}
+
+	int contains(PyObject* key)
+	{
+		if(ensure_open() < 0)
+			return -1;
+		KeyInfo ki;
+		Py_buffer buff;
+		if(0 != KeyInfo_InitUnhashed(key, &ki, &buff))
+			return -1;
+		auto buff_guard = make_scope_guard([&]() {
+			if(not ki.key)
+				PyBuffer_Release(&buff);
+		});
+		const StringDictFileEntry* ent = find(ki);
+		if(PyErr_Occurred())
+			return -1;
+		return bool(ent);
+	}
+
+	template <class GetItem>
+	PyObject* make_itemlist(GetItem get_item)
+	{
+		if(ensure_open() < 0)
+			return nullptr;
+		PythonObject itemlist(PyList_New(size()));
+		if(not itemlist)
+			return nullptr;
+		Record rec;
+		for(std::size_t i = 0; i < size(); ++i)
+		{
+			if(0 != record_at(entry_at(i), &rec))
+				return nullptr;
+			PyObject* item = get_item(rec);
+			if(not item)
+				return nullptr;
+			PyList_SET_ITEM(itemlist.get(), i, item);
+		}
+		return itemlist.release();
+	}
+
+	PyObject* get_keys()
+	{
+		return make_itemlist(make_key);
+	}
+
+	PyObject* get_values()
+	{
+		return make_itemlist([&](const Record& rec) { return make_value(rec); });
+	}
+
+	PyObject* get_items()
+	{
+		return make_itemlist([&](const Record& rec) -> PyObject* {
+			PythonObject key(make_key(rec));
+			if(not key)
+				return nullptr;
+			PythonObject value(make_value(rec));
+			if(not value)
+				return nullptr;
+			return PyTuple_Pack(2, key.get(), value.get());
+		});
+	}
+
+	int ensure_open() const
+	{
+		if(is_closed())
+		{
+			PyErr_SetString(PyExc_ValueError, "Operation on closed mapped_strdict.");
+			return -1;
+		}
+		return 0;
+	}
+
+	void close()
+	{
+		if(base)
+			munmap(base, map_size);
+		base = nullptr;
+		map_size = 0;
+	}
+
+	unsigned char* base;
+	std::size_t map_size;
+};
+
+extern "C" {
+
+int MappedStringDict_Save(PyObject* path, const KeyInfo* keys, PyObject* const* values, Py_ssize_t count)
+{
+	PyObject* path_bytes_ = nullptr;
+	if(not PyUnicode_FSConverter(path, &path_bytes_))
+		return -1;
+	PythonObject path_bytes(path_bytes_);
+	try
+	{
+		FileWriter writer(keys, values, count);
+		if(0 != writer.prepare())
+			return -1;
+		std::string final_path(PyBytes_AS_STRING(path_bytes.get()));
+		std::string tmp_path = final_path + ".tmp" + std::to_string(getpid());
+		if(0 != write_file(tmp_path, path, writer))
+		{
+			unlink(tmp_path.c_str());
+			return -1;
+		}
+		if(0 != rename(tmp_path.c_str(), final_path.c_str()))
+		{
+			PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+			unlink(tmp_path.c_str());
+			return -1;
+		}
+		return 0;
+	}
+	catch(const std::bad_alloc&)
+	{
+		PyErr_SetString(PyExc_MemoryError, "Allocation failed while saving strdict instance.");
+		return -1;
+	}
+}
+
+// Map the file or shared memory segment 'fd' and wrap it in a new 
+// mapped_strdict.  Doesn't close 'fd'.
+static PyObject* mapped_strdict_from_fd(int fd, PyObject* name)
+{
+	struct stat st;
+	if(0 != fstat(fd, &st))
+		return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+	std::size_t size = st.st_size;
+	if(size < sizeof(StringDictFileHeader))
+	{
+		MappedStringDict::corrupt();
+		return nullptr;
+	}
+	void* mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	if(mem == MAP_FAILED)
+		return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+	if(0 != MappedStringDict::validate(static_cast<unsigned char*>(mem), size))
+	{
+		munmap(mem, size);
+		return nullptr;
+	}
+	MappedStringDict* self = PyObject_New(MappedStringDict, &MappedStringDict_Type);
+	if(not self)
+	{
+		munmap(mem, size);
+		return nullptr;
+	}
+	self->base = static_cast<unsigned char*>(mem);
+	self->map_size = size;
+	return self;
+}
+
+PyObject* MappedStringDict_Open(PyObject* path)
+{
+	PyObject* path_bytes_ = nullptr;
+	if(not PyUnicode_FSConverter(path, &path_bytes_))
+		return nullptr;
+	PythonObject path_bytes(path_bytes_);
+	int fd = open(PyBytes_AS_STRING(path_bytes.get()), O_RDONLY);
+	if(fd < 0)
+		return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+	auto fd_guard = make_scope_guard([&](){ close(fd); });
+	return mapped_strdict_from_fd(fd, path);
+}
+
+int MappedStringDict_SaveShared(PyObject* name, const KeyInfo* keys, PyObject* const* values, Py_ssize_t count)
+{
+	std::string shm_name;
+	if(not shared_memory_name(name, &shm_name))
+		return -1;
+	try
+	{
+		FileWriter writer(keys, values, count);
+		if(0 != writer.prepare())
+			return -1;
+		// Processes that are attached to an existing segment with this name 
+		// keep their mapping; new ones attach to the new segment.
+		if((0 != shm_unlink(shm_name.c_str())) and (errno != ENOENT))
+		{
+			PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+			return -1;
+		}
+		int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if(fd < 0)
+		{
+			PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+			return -1;
+		}
+		auto fd_guard = make_scope_guard([&](){ close(fd); });
+		if(0 != write_fd(fd, name, writer))
+		{
+			shm_unlink(shm_name.c_str());
+			return -1;
+		}
+		return 0;
+	}
+	catch(const std::bad_alloc&)
+	{
+		PyErr_SetString(PyExc_MemoryError, "Allocation failed while saving strdict instance.");
+		return -1;
+	}
+}
+
+PyObject* MappedStringDict_OpenShared(PyObject* name)
+{
+	std::string shm_name;
+	if(not shared_memory_name(name, &shm_name))
+		return nullptr;
+	int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+	if(fd < 0)
+		return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+	auto fd_guard = make_scope_guard([&](){ close(fd); });
+	return mapped_strdict_from_fd(fd, name);
+}
+
+int MappedStringDict_UnlinkShared(PyObject* name)
+{
+	std::string shm_name;
+	if(not shared_memory_name(name, &shm_name))
+		return -1;
+	if(0 != shm_unlink(shm_name.c_str()))
+	{
+		PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+		return -1;
+	}
+	return 0;
+}
+
+static MappedStringDict* to_mapped_string_dict(PyObject* self)
+{
+	if(not PyObject_TypeCheck(self, &MappedStringDict_Type))
+	{
+		PyErr_SetObject(PyExc_TypeError, self);
+		return nullptr;
+	}
+	return static_cast<MappedStringDict*>(self);
+}
+
+static void mapped_strdict_dealloc(PyObject* self)
+{
+	static_cast<MappedStringDict*>(self)->close();
+	Py_TYPE(self)->tp_free(self);
+}
+
+static Py_ssize_t mapped_strdict_length(PyObject* self)
+{
+	auto* dict = to_mapped_string_dict(self);
+	if((not dict) or (dict->ensure_open() < 0))
+		return -1;
+	return dict->size();
+}
+
+static PyObject* mapped_strdict_subscript(PyObject* self, PyObject* key)
+{
+	auto* dict = to_mapped_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->lookup(key, nullptr);
+}
+
+static int mapped_strdict_contains(PyObject* self, PyObject* key)
+{
+	auto* dict = to_mapped_string_dict(self);
+	if(not dict)
+		return -1;
+	return dict->contains(key);
+}
+
+static PyObject* mapped_strdict___contains__(PyObject* self, PyObject* key)
+{
+	int cont = mapped_strdict_contains(self, key);
+	if(cont < 0)
+		return nullptr;
+	return PyBool_FromLong(cont);
+}
+
+static PyObject* mapped_strdict_get(PyObject* self, PyObject* args)
+{
+	auto* dict = to_mapped_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* key;
+	PyObject* default_value = Py_None;
+	if(not PyArg_ParseTuple(args, "O|O", &key, &default_value))
+		return nullptr;
+	return dict->lookup(key, default_value);
+}
+
+static PyObject* mapped_strdict_keys(PyObject* self)
+{
+	auto* dict = to_mapped_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->get_keys();
+}
+
+// Iterates over a list of the keys, so closing the mapping doesn't affect
+// iterators that already exist.
+static PyObject* mapped_strdict_iter(PyObject* self)
+{
+	PythonObject keys(mapped_strdict_keys(self));
+	if(not keys)
+		return nullptr;
+	return PyObject_GetIter(keys.get());
+}
+
+static PyObject* mapped_strdict_values(PyObject* self)
+{
+	auto* dict = to_mapped_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->get_values();
+}
+
+static PyObject* mapped_strdict_items(PyObject* self)
+{
+	auto* dict = to_mapped_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->get_items();
+}
+
+static PyObject* mapped_strdict_close(PyObject* self)
+{
+	auto* dict = to_mapped_string_dict(self);
+	if(not dict)
+		return nullptr;
+	dict->close();
+	Py_RETURN_NONE;
+}
+
+static PyObject* mapped_strdict_repr(PyObject* self)
+{
+	auto* dict = to_mapped_string_dict(self);
+	if(not dict)
+		return nullptr;
+	if(dict->is_closed())
+		return PyUnicode_FromString("<closed mapped_strdict>");
+	return PyUnicode_FromFormat("<mapped_strdict with %zu entries>", dict->size());
+}
+
+PyDoc_STRVAR(mapped_strdict_doc,
+"Read-only strdict backed by a file written with strdict.save() or a shared\n"
+"memory segment written with strdict.save_shared().\n"
+"\n"
+"Instances are created with strdict.open_mmap(path) or\n"
+"strdict.attach_shared(name).  Lookups are served directly from the mapping;\n"
+"keys and values are only materialized when they are returned.  A mapping\n"
+"opened before fork() is shared by the child processes as well.");
+
+PyDoc_STRVAR(mapped_strdict_get__doc__,
+"get($self, key, default=None, /)\n"
+"--\n"
+"\n"
+"Return the value for key if key is in the dictionary, else default.");
+
+PyDoc_STRVAR(mapped_strdict_close__doc__,
+"close($self, /)\n"
+"--\n"
+"\n"
+"Unmap the underlying file.  Any further operation raises ValueError.");
+
+static PySequenceMethods mapped_strdict_as_sequence = {
+    0,                          /* sq_length */
+    0,                          /* sq_concat */
+    0,                          /* sq_repeat */
+    0,                          /* sq_item */
+    0,                          /* sq_slice */
+    0,                          /* sq_ass_item */
+    0,                          /* sq_ass_slice */
+    mapped_strdict_contains,    /* sq_contains */
+    0,                          /* sq_inplace_concat */
+    0,                          /* sq_inplace_repeat */
+};
+
+static PyMappingMethods mapped_strdict_as_mapping = {
+    (lenfunc)mapped_strdict_length,        /*mp_length*/
+    (binaryfunc)mapped_strdict_subscript,  /*mp_subscript*/
+    0,                                     /*mp_ass_subscript*/
+};
+
+static PyMethodDef mapped_strdict_methods[] = {
+    {"__contains__", (PyCFunction)mapped_strdict___contains__, METH_O | METH_COEXIST, nullptr},
+    {"__getitem__",  (PyCFunction)mapped_strdict_subscript,    METH_O | METH_COEXIST, nullptr},
+    {"get",          (PyCFunction)mapped_strdict_get,          METH_VARARGS,          mapped_strdict_get__doc__},
+    {"keys",         (PyCFunction)mapped_strdict_keys,         METH_NOARGS,           nullptr},
+    {"values",       (PyCFunction)mapped_strdict_values,       METH_NOARGS,           nullptr},
+    {"items",        (PyCFunction)mapped_strdict_items,        METH_NOARGS,           nullptr},
+    {"close",        (PyCFunction)mapped_strdict_close,        METH_NOARGS,           mapped_strdict_close__doc__},
+    {NULL,           NULL}   /* sentinel */
+};
+
+PyTypeObject MappedStringDict_Type{
+	PyVarObject_HEAD_INIT(nullptr, 0)
+	"StringDict.mapped_strdict",
+	sizeof(MappedStringDict),
+	0,
+	(destructor)mapped_strdict_dealloc,                  /* tp_dealloc */
+	0,                                                   /* tp_print */
+	0,                                                   /* tp_getattr */
+	0,                                                   /* tp_setattr */
+	0,                                                   /* tp_as_async */
+	(reprfunc)mapped_strdict_repr,                       /* tp_repr */
+	0,                                                   /* tp_as_number */
+	&mapped_strdict_as_sequence,                         /* tp_as_sequence */
+	&mapped_strdict_as_mapping,                          /* tp_as_mapping */
+	PyObject_HashNotImplemented,                         /* tp_hash */
+	0,                                                   /* tp_call */
+	0,                                                   /* tp_str */
+	PyObject_GenericGetAttr,                             /* tp_getattro */
+	0,                                                   /* tp_setattro */
+	0,                                                   /* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,                                  /* tp_flags */
+	mapped_strdict_doc,                                  /* tp_doc */
+	0,                                                   /* tp_traverse */
+	0,                                                   /* tp_clear */
+	0,                                                   /* tp_richcompare */
+	0,                                                   /* tp_weaklistoffset */
+	(getiterfunc)mapped_strdict_iter,                    /* tp_iter */
+	0,                                                   /* tp_iternext */
+	mapped_strdict_methods,                              /* tp_methods */
+};
+
+} /* extern "C" */
@@ -7,12 +7,22 @@
 #include "StringDictEntry.h"
 #include "MakeKeyInfo.h"
 #include "PythonUtils.h"
+#include "MappedStringDict.h"
+#include "StringDictKey.h"
+#include "StringDictCAPI.h"
+#include "LEB128.h"
+#include "KeyOrder.h"
+#include "BasicStringDict.h"
 #include <memory>
 #include <climits>
 #include <limits>
 #include <type_traits>
 #include <cstring>
+#include <cstdint>
 #include <functional>
+#include <map>
+#include <set>
+#include <array>
 #include <utility>
 #include <iostream>
 
@@ -60,8 +70,8 @@ struct Entry {
 	Entry(Entry&&) = default;
 	Entry& operator=(Entry&&) = default;
 
-	Entry(const KeyInfo& ki, PyObject* value):
-		entry_(Entry_FromKeyInfo(&ki, value)), hash_(ki.hash)
+	Entry(const KeyInfo& ki, PyObject* value, bool compact = false):
+		entry_(compact ? Entry_FromKeyInfoCompact(&ki, value) : Entry_FromKeyInfo(&ki, value)), hash_(ki.hash)
 	{ /* CTOR */ }
 
 	PyObject* get_value() const
@@ -105,6 +115,25 @@ struct Entry {
 		return k;
 	}
 
+	// New reference to the key, without caching it in the entry.
+	PyObject* new_key() const
+	{
+		assert(self());
+		return Entry_NewKey(self());
+	}
+
+	Py_ssize_t key_length() const
+	{
+		assert(self());
+		return Entry_KeyLength(self());
+	}
+
+	DataKind key_kind() const
+	{
+		assert(self());
+		return Entry_KeyKind(self());
+	}
+
 	bool is_empty() const
 	{ return not self(); }
 
@@ -126,10 +155,18 @@ struct Entry {
 		return (hash_ == ki.hash) and Entry_Matches(self(), &ki);
 	}
 
-	void assign_from(const KeyInfo& ki, PyObject* value)
+	// 'match' is Entry_MatchFunction(ki.kind).
+	bool matches(const KeyInfo& ki, EntryMatchFunc match)
+	{
+		assert(self());
+		assert(match == Entry_MatchFunction(ki.kind));
+		return (hash_ == ki.hash) and match(self(), &ki);
+	}
+
+	void assign_from(const KeyInfo& ki, PyObject* value, bool compact = false)
 	{
 		assert(is_empty());
-		Entry tmp(ki, value);
+		Entry tmp(ki, value, compact);
 		this->swap(tmp);
 	}
 
@@ -171,6 +208,25 @@ struct Entry {
 		ki.hash = hash();
 		return ki;
 	}
+
+	// Like as_key_info(), but keys stored as UTF-8 are decoded into 'owner'.  
+	// Returns nullopt with an exception set if that fails.
+	std::optional<KeyInfo> decoded_key_info(PythonObject& owner) const
+	{
+		assert(self());
+		if(not Entry_IsEncoded(self()))
+			return as_key_info();
+		owner = PythonObject(new_key());
+		if(not owner)
+			return std::nullopt;
+		KeyInfo ki;
+		ki.key = nullptr;
+		ki.hash = hash();
+		ki.data = static_cast<const unsigned char*>(PyUnicode_DATA(owner.get()));
+		ki.data_size = PyUnicode_GET_LENGTH(owner.get());
+		ki.kind = (PyUnicode_KIND(owner.get()) == PyUnicode_2BYTE_KIND) ? PY_UCS2 : PY_UCS4;
+		return ki;
+	}
 	
 	int write_repr(_PyUnicodeWriter* writer) const
 	{
@@ -178,6 +234,15 @@ struct Entry {
 		return Entry_WriteRepr(self(), writer);
 	}
 
+	int write_key_repr(_PyUnicodeWriter* writer) const
+	{
+		assert(self());
+		return Entry_WriteKeyRepr(self(), writer);
+	}
+
+	const StringDictEntry* get() const
+	{ return self(); }
+
 	using is_open_t = decltype(std::mem_fn(&Entry::is_empty));
 	using is_closed_t = decltype(std::not_fn(std::declval<is_open_t>()));
 
@@ -208,24 +273,291 @@ void swap(Entry& l, Entry& r)
 	l.swap(r);
 }
 
+// The entries and offsets live in the strdict::string_table base, which is
+// shared with strdict::basic_string_dict (see BasicStringDict.h).  This class
+// is its entry policy: the unboxed values move along with their entries.
 struct StringDictBase: 
-	public PyObject
+	public PyObject,
+	public strdict::string_table<StringDictBase, Entry>
 {
+	friend strdict::string_table<StringDictBase, Entry>;
+
 	using uhash_t = std::make_unsigned_t<Py_hash_t>;
-	static constexpr const uhash_t perturb_shift = 5;
-	static constexpr const double max_load_factor = 0.667;
-	static constexpr const Py_ssize_t min_buckets = 8;
+	static constexpr const double max_load_factor = strdict::table_traits::max_load_factor;
+	static constexpr const Py_ssize_t min_buckets = strdict::table_traits::min_buckets;
+	// Dicts with at most this many entry slots have no 'offsets' table; keys
+	// are found by a linear scan of the entries (and their hashes).  New 
+	// dicts start out small, so they don't allocate until the first insertion.
+	static constexpr const Py_ssize_t small_capacity = strdict::table_traits::small_capacity;
+	
+	// Values are either python objects stored in the entries themselves, or 
+	// (for typed dicts) unboxed numbers stored in 'unboxed_values', which 
+	// runs parallel to 'entries'.  The entries of a typed dict hold None.
+	enum class ValueType: char {
+		object = 'O',
+		int64 = 'q',
+		float64 = 'd'
+	};
+
+	union UnboxedValue {
+		std::int64_t i;
+		double f;
+	};
+
+	static_assert(sizeof(UnboxedValue) == sizeof(std::int64_t));
 	
 	StringDictBase() = default;
 	StringDictBase(const StringDictBase& other) = delete;
 	StringDictBase(StringDictBase&& other) = default;
 
+	bool is_typed() const
+	{ return value_type != ValueType::object; }
+
+	// Fixed-width dicts only hold bytes keys of exactly 'key_width' bytes.  
+	// Such keys (UUIDs, digests, packed IDs) are hashed by mixing their words
+	// rather than by hashing a key object, and key objects aren't cached.  0
+	// for regular dicts.
+	Py_ssize_t get_key_width() const
+	{ return key_width; }
+
+	void set_key_width(Py_ssize_t width)
+	{
+		assert(entries.empty());
+		assert(width >= 0);
+		key_width = width;
+	}
+
+	static Py_hash_t fixed_width_hash(const unsigned char* data, Py_ssize_t width)
+	{
+		std::uint64_t hash = 0;
+		for(Py_ssize_t pos = 0; pos < width; pos += sizeof(hash))
+		{
+			std::uint64_t word = 0;
+			if(width - pos >= static_cast<Py_ssize_t>(sizeof(word)))
+				std::memcpy(&word, data + pos, sizeof(word));
+			else
+				std::memcpy(&word, data + pos, width - pos);
+			hash = ((hash << 7) | (hash >> 57)) ^ word;
+		}
+		// The splitmix64 finalizer, so that keys differing only in a few 
+		// bits (such as big-endian counters) spread over the low bits.
+		hash ^= hash >> 30;
+		hash *= 0xbf58476d1ce4e5b9ull;
+		hash ^= hash >> 27;
+		hash *= 0x94d049bb133111ebull;
+		hash ^= hash >> 31;
+		auto result = static_cast<Py_hash_t>(hash);
+		return (result == -1) ? -2 : result;
+	}
+
+	// Set the hash of 'ki' for a fixed-width dict.  Returns false if 'ki' 
+	// can't be a key of this dict.
+	bool to_fixed_width(KeyInfo& ki) const
+	{
+		assert(key_width > 0);
+		if((ki.kind != PY_BYTES) or (ki.data_size != key_width))
+			return false;
+		ki.hash = fixed_width_hash(ki.data, key_width);
+		ki.key = nullptr;
+		return true;
+	}
+
+	// Raise unless 'ki' can be added to this dict.
+	bool check_key_width(const KeyInfo& ki) const
+	{
+		if((not key_width) or ((ki.kind == PY_BYTES) and (ki.data_size == key_width)))
+			return true;
+		fixed_width_error(ki);
+		return false;
+	}
+
+	int fixed_width_error(const KeyInfo& ki) const
+	{
+		if(ki.kind != PY_BYTES)
+			PyErr_Format(PyExc_TypeError, "Keys of a strdict with key_width=%zd must be bytes-like objects.", key_width);
+		else
+			PyErr_Format(PyExc_ValueError, "Keys of a strdict with key_width=%zd must be %zd bytes long, not %zd.", 
+				key_width, key_width, ki.data_size);
+		return -1;
+	}
+
+	// Compact dicts don't keep key objects, and store str keys as UTF-8 
+	// when that's shorter than their code units.  Keys are created on demand.
+	bool has_compact_keys() const
+	{ return compact_keys; }
+
+	void set_compact_keys(bool enable)
+	{
+		assert(entries.empty());
+		assert(not (enable and prefix_index_enabled));
+		compact_keys = enable;
+	}
+
+	// Changes whenever keys are added or removed, or entries move.
+	std::uint64_t get_generation() const
+	{ return generation; }
+
+	// Changes whenever keys are added or removed, or values are replaced.
+	// Versions come from one process-wide counter, so no two states of any
+	// strdicts share a version, like the ma_version_tag of CPython's dicts.
+	std::uint64_t get_version() const
+	{ return version; }
+
+	// New reference to the key of 'ent'.
+	PyObject* key_of(const Entry& ent) const
+	{ return compact_keys ? ent.new_key() : ent.get_key_newref(); }
+
+	// KeyInfo for a key object.  Fixed-width dicts skip the python hash.
+	std::pair<KeyInfo, KeyMetaInfo> key_info_for(PyObject* key) const
+	{
+		if(not key_width)
+			return make_key_info(key);
+		auto result = make_unhashed_key_info(key);
+		if(result.second)
+			to_fixed_width(result.first);
+		return result;
+	}
+
+	ValueType get_value_type() const
+	{ return value_type; }
+
+	void set_value_type(ValueType type)
+	{
+		assert(entries.empty());
+		value_type = type;
+	}
+
+	Py_ssize_t index_of(const Entry& ent) const
+	{
+		assert(&ent >= entries.data());
+		assert(&ent < entries.data() + entries.size());
+		return &ent - entries.data();
+	}
+
+	// Inverse of index_of().  Indices stay valid while get_generation() is
+	// unchanged.
+	Entry& entry_from_index(Py_ssize_t index)
+	{
+		assert(index >= 0);
+		assert(index < static_cast<Py_ssize_t>(entries.size()));
+		return entries[index];
+	}
+
+	// New reference to the value in 'ent', boxing it for typed dicts.
+	PyObject* value_of(const Entry& ent) const
+	{
+		assert(not ent.is_empty());
+		switch(value_type)
+		{
+		case ValueType::int64:
+			return PyLong_FromLongLong(unboxed_values[index_of(ent)].i);
+		case ValueType::float64:
+			return PyFloat_FromDouble(unboxed_values[index_of(ent)].f);
+		default:
+			return ent.get_value_newref();
+		}
+	}
+
+	int unbox_value(PyObject* value, UnboxedValue* unboxed) const
+	{
+		assert(is_typed());
+		if(value_type == ValueType::int64)
+		{
+			if(not PyIndex_Check(value))
+			{
+				PyErr_Format(PyExc_TypeError, "Values of int64 strdict instances must be integers, not '%.200s'.", 
+					Py_TYPE(value)->tp_name);
+				return -1;
+			}
+			PythonObject index(PyNumber_Index(value));
+			if(not index)
+				return -1;
+			unboxed->i = PyLong_AsLongLong(index);
+			if((unboxed->i == -1) and PyErr_Occurred())
+				return -1;
+		}
+		else
+		{
+			unboxed->f = PyFloat_AsDouble(value);
+			if((unboxed->f == -1.0) and PyErr_Occurred())
+				return -1;
+		}
+		return 0;
+	}
+
+	// New (key, value) tuple for 'ent'.
+	PyObject* item_of(const Entry& ent) const
+	{
+		if((not is_typed()) and (not compact_keys))
+			return ent.as_tuple();
+		PythonObject key(key_of(ent));
+		if(not key)
+			return nullptr;
+		PythonObject value(value_of(ent));
+		if(not value)
+			return nullptr;
+		return PyTuple_Pack(2, key.get(), value.get());
+	}
+
+	// Like CPython's dicts, exact strdicts are only tracked by the garbage 
+	// collector once they hold a value that may be part of a reference cycle.
+	// Instances of subtypes are always tracked.
+	void track_value(PyObject* value)
+	{
+		if(gc_may_be_tracked(value) and (not PyObject_GC_IsTracked(this)))
+			PyObject_GC_Track(this);
+	}
+
+	// Unbox 'value' for a typed dict.  Unboxing can run python code that 
+	// changes the dict, so it has to happen before the key is probed.
+	// Returns 'unboxed', nullptr for untyped dicts, or nullptr with an
+	// exception set on error.
+	const UnboxedValue* unbox_for_insertion(PyObject* value, UnboxedValue* unboxed) const
+	{
+		if(not is_typed())
+			return nullptr;
+		return (0 == unbox_value(value, unboxed)) ? unboxed : nullptr;
+	}
+
+	// Replace the value of an existing entry.  Typed dicts pass the value 
+	// from unbox_for_insertion() in 'unboxed'.
+	void store_value(Entry& ent, PyObject* value, const UnboxedValue* unboxed)
+	{
+		assert(not ent.is_empty());
+		on_value_changed();
+		if(not is_typed())
+		{
+			ent.set_value(value);
+			track_value(value);
+			return;
+		}
+		assert(unboxed);
+		unboxed_values[index_of(ent)] = *unboxed;
+	}
+
+	void on_value_changed() noexcept
+	{ version = ++last_version; }
+
+	// Typed dicts can export their values with the buffer protocol.  While 
+	// they do, entries can't be added or removed.
+	bool check_resizable() const
+	{
+		if(exports > 0)
+		{
+			PyErr_SetString(PyExc_BufferError, "Existing exports of data: strdict cannot add or remove entries.");
+			return false;
+		}
+		return true;
+	}
 	
+	// Make room for 'len' entries.  This is only a hint: while values are 
+	// exported nothing is reserved, and inserts that actually add entries 
+	// raise BufferError instead, so updates of existing keys still work.
 	int reserve_space(Py_ssize_t len)
 	{
 		// assert(size() == 0);
 		assert(len >= 0);
-		if(len == 0)
+		if((len == 0) or (exports > 0))
 			return 0;
 		std::size_t ofs_count_needed = len / max_load_factor;
 		// overflow check
@@ -236,6 +568,22 @@ struct StringDictBase:
 			return -1;
 		}
 
+		if(is_small() and (len <= small_capacity))
+		{
+			try
+			{
+				entries.reserve(len);
+			}
+			catch(const std::bad_alloc&)
+			{
+				PyErr_SetString(PyExc_MemoryError, "Allocation failed while trying to reserve memory for strdict instance.");
+				return -1;
+			}
+			// the entries may have been reallocated
+			++generation;
+			return 0;
+		}
+
 		// make sure the number of offsets is a power of two >= min_buckets
 		// TODO: something a little faster
 		std::size_t count = min_buckets;
@@ -248,15 +596,12 @@ struct StringDictBase:
 		// allocate
 		try
 		{
+			if(is_typed())
+				unboxed_values.reserve(len);
 			entries.reserve(len);
-			if(size() > 0)
-			{
-				// Reserve the space, resize to half the space, and finally
-				// trigger a rehash by calling grow()
-				offsets.reserve(ofs_count_needed);
-				offsets.resize(ofs_count_needed >> 1, -1);
-				grow();
-			}
+			// the entries may have been reallocated
+			++generation;
+			rehash(ofs_count_needed);
 		}
 		catch(const std::bad_alloc&)
 		{
@@ -271,62 +616,19 @@ struct StringDictBase:
 		return 0;
 	}
 
-	std::size_t bucket_count() const
-	{ return offsets.size(); }
-
 	std::size_t size() const
 	{ return occupied; }
 
-	std::size_t entry_slot_count() const
-	{ return entries.size(); }
-
-	const Py_ssize_t& offset_at(Py_ssize_t index) const
-	{
-		assert(index < static_cast<Py_ssize_t>(offsets.size()));
-		assert(index >= 0);
-		return offsets[index];
-	}
-	
-	Py_ssize_t& offset_at(Py_ssize_t index) 
-	{
-		const Py_ssize_t& ofs = static_cast<const StringDictBase*>(this)->offset_at(index);
-		return const_cast<Py_ssize_t&>(ofs);
-	}
-	
-	const Entry* pointer_to_entry_at(Py_ssize_t index) const
-	{
-		assert(index < static_cast<Py_ssize_t>(entries.size()));
-		if(not (index >= 0))
-			std::cerr << index << std::endl;;
-		return entries.data() + index;
-	}
-	
-	Entry* pointer_to_entry_at(Py_ssize_t index) 
+	// The bits of 'hash_value' for the probe sequence.
+	static std::size_t probe_hash(Py_hash_t hash_value)
 	{
-		const Entry* ent = static_cast<const StringDictBase*>(this)->pointer_to_entry_at(index);
-		return const_cast<Entry*>(ent);
-	}
-	
-	const Entry& entry_at(Py_ssize_t index) const
-	{ return *pointer_to_entry_at(index); }
-	
-	Entry& entry_at(Py_ssize_t index) 
-	{ return *pointer_to_entry_at(index); }
-	
-	template <class Pred>
-	void visit_with_hash(Py_hash_t hash_value, Pred pred)
-	{
-		assert(mask + 1 == offsets.size());
-		uhash_t perturb;
-		// copy the hash into 'perturb' bit-for-bit...
-		// Py_hash_t is signed, but we want unsigned because 
-		// '.advance_index()' does a logical shift right.
-		std::memcpy(&perturb, &(hash_value), sizeof(perturb));
-		
-		for(uhash_t idx = hash_value & mask; not pred(idx); advance_index(idx, perturb))
-		{
-			/* LOOP */
-		}
+		uhash_t hash_bits;
+		// copy the hash bit-for-bit...
+		// Py_hash_t is signed, but we want unsigned because the probe 
+		// sequence does a logical shift right.
+		std::memcpy(&hash_bits, &(hash_value), sizeof(hash_bits));
+		static_assert(sizeof(uhash_t) == sizeof(std::size_t));
+		return hash_bits;
 	}
 	
 	template <class Visitor>
@@ -361,104 +663,51 @@ struct StringDictBase:
 		}
 	}
 
-	std::pair<Py_ssize_t, Entry*> find_existing(const KeyInfo& ki)
+	// The bucket and entry of 'key_info'.  If it's missing, the entry is null
+	// and the bucket is the open bucket that ended its probe sequence.  Small
+	// dicts have no buckets, so the bucket is always -1 for them.
+	std::pair<Py_ssize_t, Entry*> find_existing(const KeyInfo& key_info)
 	{
-		Entry* found = nullptr;
-		Py_ssize_t offsets_index = -1;
-		auto visit_pred = [&](std::size_t ofs_index) -> bool
-		{
-			auto ofs = offset_at(ofs_index);
-			if(ofs < 0)
-			{
-				offsets_index = ofs_index;
-				return true;
-			}
-			Entry* ent = pointer_to_entry_at(ofs);
-			if((not ent->is_empty()) and ent->matches(ki))
-			{
-				found = ent;
-				offsets_index = ofs_index;
-				return true;
-			}
-			return false;
-		};
-		visit_with_hash(ki.hash, visit_pred);
-		assert((not found) or (found == pointer_to_entry_at(offset_at(offsets_index))));
-		return std::make_pair(offsets_index, found);
+		KeyInfo ki = key_info;
+		if(key_width and (not to_fixed_width(ki)))
+			return std::make_pair(Py_ssize_t(-1), nullptr);
+		EntryMatchFunc match = Entry_MatchFunction(ki.kind);
+		return find_bucket(probe_hash(ki.hash), [&](Entry& ent) { return ent.matches(ki, match); });
 	}
 
-	std::pair<Py_ssize_t, Entry*> find_insertion(const KeyInfo& ki) 
+	// Like find_existing(), but if the key is missing, returns the first 
+	// removed entry of its probe sequence to fill with assign_entry(), if 
+	// there is one.  Otherwise the key goes in the returned bucket through
+	// add_entry().
+	std::pair<Py_ssize_t, Entry*> find_insertion(const KeyInfo& key_info) 
 	{
-		Entry* found = nullptr;
-		Py_ssize_t offsets_index = -1;
-		auto visit_pred = [&](std::size_t ofs_index) -> bool
-		{
-			auto ofs = offset_at(ofs_index);
-			if(ofs < 0)
-			{
-				// Found an open bucket: break out of the traversal.
-				// If we found an empty Entry instance earlier in the 
-				// traversal, then that entry is the insertion position.
-				// Otherwise, the insertion position is the current offset,
-				// and it will have to be appended it to the 'entries' vector.
-				//
-				// In the former case, 'found' points to the empty 'Entry' instance
-				// that we already found, in the latter 'Entry' is null.
-				if(not found)
-					offsets_index = static_cast<Py_ssize_t>(ofs_index);
-				return true;
-			}
-			
-			// check to see if this entry contains the key we're looking for
-			Entry* ent = pointer_to_entry_at(ofs);
-			assert(ent);
-
-			if(ent->is_empty()) 
-			{
-				// Found an empty slot.  If this is the first empty slot that
-				// we've encountered, then set 'found' and 'offsets_index' to 
-				// the current position.
-				// If we don't end up finding the key we're looking for, this 
-				// will be the insertion position.
-				if(not found)
-				{
-					found = ent;
-					offsets_index = static_cast<Py_ssize_t>(ofs_index);
-				}
-				// Continue traversal.
-				return false;
-			}
-			else if(ent->matches(ki))
-			{
-				// Found the key.  Set 'found' and 'offsets_index' then break out
-				// of the traversal.
-				found = ent;
-				offsets_index = static_cast<Py_ssize_t>(ofs_index);
-				return true;
-			}
-			// Found a non-empty, non-matching entry.  Continue traversal.
-			return false;
-		};
-		visit_with_hash(ki.hash, visit_pred);
-		
-		// postconditions
-		assert((not found) or (pointer_to_entry_at(offset_at(offsets_index)) == found));
-		return std::make_pair(offsets_index, found);
+		KeyInfo ki = key_info;
+		if(key_width and (not to_fixed_width(ki)))
+			return std::make_pair(Py_ssize_t(-1), nullptr);
+		EntryMatchFunc match = Entry_MatchFunction(ki.kind);
+		return find_insertion_bucket(probe_hash(ki.hash), [&](Entry& ent) { return ent.matches(ki, match); });
 	}
 
 	void clear() noexcept
 	{
-		// get out early if we're already empty
-		if(size() == 0)
+		// get out early if we're already empty.  A dict without keys can still
+		// hold removed entries, which have to go too.
+		if(entries.empty() and offsets.empty())
 		{
 			return;
 		}
-		assert(offsets.size() >= min_buckets);
 		// Before destructing 'ents', move the vector out of the way. 
 		// This is to ensure we don't start calling destructors recursively.
 		//
 		// TODO: If we switch to a non-POCMA allocator, this might leak an exception.
 		auto ents(std::move(entries));
+		++generation;
+		on_value_changed();
+		unboxed_values.clear();
+		if(key_length_counts)
+			key_length_counts->clear();
+		if(prefix_index)
+			prefix_index->clear();
 			
 		// don't forget to fix 'occupied'!
 		occupied = 0;
@@ -466,96 +715,44 @@ struct StringDictBase:
 		assert(entries.size() == 0 or std::all_of(entries.begin(), entries.end(), Entry::is_open));
 		
 
-		// try to reduce the capacity of offsets vector
-		try
-		{
-			offsets.resize(min_buckets);
-			offsets.shrink_to_fit();
-		}
-		catch(const std::bad_alloc&)
-		{
-			// only catch bad_alloc.  I don't want to silence 
-			// unrelated exceptions and hide a bug
-		}
-		// whether or not it failed, fill with '-1' sentinal indices
-		std::fill(offsets.begin(), offsets.end(), -1);
-		assert(((offsets.size() & (offsets.size() - 1)) == 0) and "offsets.size() not a power of 2");
-		// don't forget to fix 'mask'!
-		mask = offsets.size() - 1;
+		// go back to a small dict, releasing the offsets
+		decltype(offsets)().swap(offsets);
+		mask = 0;
 		// finally, destroy the key-value-pairs
 		// for(auto& ent: ents)
 		// 	ent.clear();
 		ents.clear();
 	}
-private:
 
-	void grow_relocate_entry(const Entry& ent)
-	{
-		Py_hash_t ent_hash = ent.hash();
-		Py_ssize_t idx = -1;
-		auto visit_pred = [&](std::size_t ofs_idx)
-		{
-			if(offset_at(ofs_idx) < 0)
-			{
-				idx = ofs_idx;
-				return true;
-			}
-			return false;
-		};
-		visit_with_hash(ent_hash, visit_pred);
-		assert(offset_at(idx) == -1);
-		offset_at(idx) = &ent - entries.data();
-	}
+private:
+	// Entry policy of the table.
+	std::size_t entry_hash(const Entry& ent) const
+	{ return probe_hash(ent.hash()); }
 
-	void advance_index(uhash_t& idx, uhash_t& perturb)
+	void on_entry_moved(std::size_t dest, std::size_t src) noexcept
 	{
-		perturb >>= perturb_shift;
-		idx = mask & (idx * 5 + perturb_shift);
+		if(is_typed())
+			unboxed_values[dest] = unboxed_values[src];
 	}
 
-	void grow()
+	void on_entries_truncated(std::size_t count) noexcept
 	{
-		// double the size and set all offsets to -1
-		offsets.assign(offsets.size() * 2, -1);
-		// adjust the mask accordingly
-		mask <<= 1;
-		mask |= 1;
-		// remove all empty Entry instances 
-		grow_remove_empty_entries();
-		// finaly, repoint all of the offsets
-		for(auto& ent: entries)
-			grow_relocate_entry(ent);
+		if(is_typed())
+			unboxed_values.resize(count);
 	}
 
-	void grow_remove_empty_entries() noexcept
-	{
-		// don't do an O(n) traversal if there are no empty entries
-		if(occupied == static_cast<Py_ssize_t>(size()))
-		{
-			assert(std::all_of(entries.begin(), entries.end(), Entry::is_closed));
-			return;
-		}
-
-		// TODO: optimize for the fact that we know how many empty entries there are.
-		//       also std::partition() uses swaps, but we only need moves.
-
-		// put all of the empty entries at the end of the array
-		auto empties = std::partition(entries.begin(), entries.end(), Entry::is_closed);
-
-		// postconditions
-		assert(std::all_of(empties, entries.end(), Entry::is_open));
-		assert(std::all_of(entries.begin(), empties, Entry::is_closed));
-		assert(empties - entries.begin() == occupied);
-
-		// erase all of the empty elements at the end of the entries vector
-		entries.erase(empties, entries.end());
-	}
+	void on_entries_moved() noexcept
+	{ ++generation; }
 
 protected:
-	Entry* add_entry(const KeyInfo& ki, Py_ssize_t offsets_index, PyObject* value) 
+	Entry* add_entry(const KeyInfo& ki, Py_ssize_t offsets_index, PyObject* value, const UnboxedValue* unboxed = nullptr) 
 	{
 		assert(ki.kind <= PY_UCS4);
 		assert(ki.kind >= PY_BYTES);
+		if(not check_key_width(ki))
+			return nullptr;
+		if(not check_resizable())
+			return nullptr;
 		++occupied;
 		int did_reserve = reserve_load_factor(); 
 		if(did_reserve < 0) // attempted to reserve but failed
@@ -564,59 +761,192 @@ protected:
 			--occupied;
 			return nullptr;
 		}
+		if(0 != emplace_entry(ki, value, unboxed))
+		{
+			// roll back
+			--occupied;
+			return nullptr;
+		}
+		link_entry(offsets_index, entries.size() - 1);
+		resize_after_insertion(did_reserve);
+		return &(entries.back());
+	}
+
+	// Append a new entry.  Typed dicts pass the value from 
+	// unbox_for_insertion() in 'unboxed', and 'value' is ignored.
+	int emplace_entry(const KeyInfo& key_info, PyObject* value, const UnboxedValue* unboxed = nullptr)
+	{
+		KeyInfo ki = key_info;
+		if(key_width and (not to_fixed_width(ki)))
+			return fixed_width_error(ki);
+		UnboxedValue unboxed_value{};
+		if(is_typed())
+		{
+			assert(unboxed);
+			unboxed_value = *unboxed;
+			value = Py_None;
+		}
 		try
 		{
 			assert(ki.kind <= PY_UCS4);
 			assert(ki.kind >= PY_BYTES);
-			entries.emplace_back(ki, value);
+			if(is_typed())
+				unboxed_values.push_back(unboxed_value);
+			entries.emplace_back(ki, value, compact_keys);
 		} 
 		catch(const std::bad_alloc&)
 		{
+			if(unboxed_values.size() > entries.size())
+				unboxed_values.pop_back();
 			PyErr_SetString(PyExc_MemoryError, "Attempt to allocate space for new strdict entry failed.");
-			// roll back
-			--occupied;
-			return nullptr;
+			return -1;
 		}
 		catch(const std::exception& e)
 		{
+			if(unboxed_values.size() > entries.size())
+				unboxed_values.pop_back();
 			PyErr_SetString(PyExc_RuntimeError, e.what());
-			// roll back
-			--occupied;
-			return nullptr;
+			return -1;
 		}
-		assert(offset_at(offsets_index) == -1);
-		offset_at(offsets_index) = entries.size() - 1;
-		if(did_reserve)
-			grow(); // shouldn't throw because we reserved the memory already
-		return &(entries.back());
+		if(entries.back().is_empty())
+		{
+			// Entry_FromKeyInfo() failed and set an exception
+			entries.pop_back();
+			if(is_typed())
+				unboxed_values.pop_back();
+			return -1;
+		}
+		on_key_added(entries.back());
+		track_value(value);
+		return 0;
 	}
 
-	int reserve_load_factor()
+	// Bookkeeping for keys entering and leaving the dict.  The auxiliary 
+	// indexes are dropped if they can't be updated, and rebuilt by the next
+	// query that needs them.
+	void on_key_added(const Entry& ent) noexcept
 	{
-		if((double(occupied) / offsets.size()) >= max_load_factor)
+		++generation;
+		on_value_changed();
+		if(key_length_counts)
 		{
 			try
 			{
-				offsets.reserve(2 * offsets.size());
-				return 1;
-			} 
+				++(*key_length_counts)[ent.key_length()];
+			}
 			catch(const std::bad_alloc&)
 			{
-				PyErr_SetString(PyExc_MemoryError, "Attempt to grow strdict size due to high load factor failed.");
-				return -1;
+				key_length_counts.reset();
 			}
-			catch(const std::exception& e)
-			{
-				PyErr_SetString(PyExc_RuntimeError, e.what());
-				return -1;
+		}
+		if(prefix_index)
+		{
+			try
+			{
+				prefix_index->insert(IndexedKey{ent.get(), ent.hash()});
+			}
+			catch(const std::bad_alloc&)
+			{
+				prefix_index.reset();
 			}
 		}
-		else
+	}
+
+	void on_key_removed(const Entry& ent) noexcept
+	{
+		++generation;
+		on_value_changed();
+		if(key_length_counts)
+		{
+			auto pos = key_length_counts->find(ent.key_length());
+			assert(pos != key_length_counts->end());
+			if(--(pos->second) == 0)
+				key_length_counts->erase(pos);
+		}
+		if(prefix_index)
+		{
+			[[maybe_unused]]
+			auto count = prefix_index->erase(IndexedKey{ent.get(), ent.hash()});
+			assert(count == 1);
+		}
+	}
+
+public:
+	bool has_prefix_index() const
+	{ return prefix_index_enabled; }
+
+	// Build the prefix index if it's enabled but doesn't exist yet.
+	int ensure_prefix_index()
+	{
+		if(not prefix_index_enabled)
 		{
+			PyErr_SetString(PyExc_ValueError, "strdict instance was created without prefix_index=True.");
+			return -1;
+		}
+		if(prefix_index)
 			return 0;
+		try
+		{
+			prefix_index.emplace();
+			visit_all_nonempty_entries([&](const Entry& ent) {
+				prefix_index->insert(IndexedKey{ent.get(), ent.hash()});
+			});
+		}
+		catch(const std::bad_alloc&)
+		{
+			prefix_index.reset();
+			PyErr_SetString(PyExc_MemoryError, "Allocation failed while building the prefix index of a strdict instance.");
+			return -1;
+		}
+		return 0;
+	}
+
+	int enable_prefix_index()
+	{
+		if(compact_keys)
+		{
+			PyErr_SetString(PyExc_ValueError, "A strdict with compact_keys can't have a prefix index.");
+			return -1;
+		}
+		prefix_index_enabled = true;
+		return ensure_prefix_index();
+	}
+protected:
+
+	// Called before a key is added, with 'occupied' already incremented.
+	// Returns 1 if the table has to grow after the insertion (the memory is
+	// reserved here), 2 if it only has to be rehashed to drop the buckets of
+	// removed entries, 0 if neither, or -1 on error.  Pass the result to
+	// resize_after_insertion().  See strdict::string_table::load_action().
+	int reserve_load_factor()
+	{
+		strdict::table_resize action = load_action();
+		if(action != strdict::table_resize::grow)
+			return static_cast<int>(action);
+		try
+		{
+			reserve_growth();
+			return static_cast<int>(action);
+		} 
+		catch(const std::bad_alloc&)
+		{
+			PyErr_SetString(PyExc_MemoryError, "Attempt to grow strdict size due to high load factor failed.");
+			return -1;
+		}
+		catch(const std::exception& e)
+		{
+			PyErr_SetString(PyExc_RuntimeError, e.what());
+			return -1;
 		}
 	}
 
+	void resize_after_insertion(int did_reserve)
+	{
+		assert(did_reserve >= 0);
+		// grow() doesn't throw because we reserved the memory already
+		resize(static_cast<strdict::table_resize>(did_reserve));
+	}
+
 	int ensure_load_factor()
 	{
 		if((double(occupied) / offsets.size()) >= max_load_factor)
@@ -644,73 +974,139 @@ protected:
 		
 	}
 
-	int assign_entry(const KeyInfo& ki, Entry* ent, PyObject* value) 
+	// Fill the empty entry 'ent' from find_insertion(), or replace the value 
+	// of the matching entry 'ent'.  Returns the entry holding the key, which 
+	// may have moved, or nullptr on error.  As with emplace_entry(), typed 
+	// dicts pass the already-unboxed value.
+	Entry* assign_entry(const KeyInfo& key_info, Entry* ent, PyObject* value, const UnboxedValue* unboxed_value = nullptr) 
 	{
 		assert(ent);
+		KeyInfo ki = key_info;
+		if(key_width and (not to_fixed_width(ki)))
+		{
+			fixed_width_error(ki);
+			return nullptr;
+		}
 		if(ent->is_empty())
 		{
+			assert(unboxed_value or (not is_typed()));
+			if(not check_resizable())
+				return nullptr;
 			++occupied;
 			int did_reserve = reserve_load_factor();
 			if(did_reserve < 0)
 			{
 				// roll back
 				--occupied;
-				return -1;
+				return nullptr;
+			}
+			// fill the slot before growing; grow() moves the entries around
+			ent->assign_from(ki, is_typed() ? Py_None : value, compact_keys);
+			if(ent->is_empty())
+			{
+				// Entry_FromKeyInfo() failed
+				--occupied;
+				return nullptr;
 			}
+			on_key_added(*ent);
+			if(is_typed())
+				unboxed_values[index_of(*ent)] = *unboxed_value;
+			else
+				track_value(value);
 			if(did_reserve)
-				grow();
-			ent->assign_from(ki, value);
-		}
-		else
-		{
-			assert(ent->matches(ki));
-			ent->set_value(value);
-		}
-		return 0;
-	}
-
-	bool try_assign_entry(const KeyInfo& ki, Entry* ent, PyObject* value) 
-	{
-		assert(ent);
-		if(ent->is_empty())
-		{
-			ent->assign_from(ki, value);
-			return true;
+			{
+				resize_after_insertion(did_reserve);
+				ent = find_existing(ki).second;
+				assert(ent);
+			}
 		}
 		else
 		{
 			assert(ent->matches(ki));
-			return false;
+			store_value(*ent, value, unboxed_value);
 		}
+		return ent;
 	}
 
-	void remove_entry(Entry* ent)
+	int remove_entry(Entry* ent)
 	{
 		assert(size() > 0);
 		assert(not ent->is_empty());
-		ent->set_empty();
-		--occupied;
+		if(not check_resizable())
+			return -1;
+		on_key_removed(*ent);
+		erase_entry(*ent);
+		return 0;
 	}
 
 	// Constructor that doesn't allocate.  This exists so that we can safely 
 	// call the destructor in the strdict_dealloc() function when default
 	// construction fails.
-	StringDictBase(std::nullptr_t) noexcept:
-		entries(), offsets(0), mask(0), occupied(0)
+	StringDictBase(std::nullptr_t) noexcept
 	{
 		
 	}
 	
-	std::vector<Entry> entries;
-	std::vector<Py_ssize_t> offsets = std::vector<Py_ssize_t>(min_buckets, -1);
-	std::make_unsigned_t<Py_ssize_t> mask = min_buckets - 1;
-	Py_ssize_t occupied = 0;
+	// Bumped whenever keys are added or removed, or entries move, so that 
+	// callers that run python code between a probe and its use can tell 
+	// whether the probe result is still valid.
+	std::uint64_t generation = 0;
+	// See get_version().
+	static inline std::uint64_t last_version = 0;
+	std::uint64_t version = ++last_version;
+	ValueType value_type = ValueType::object;
+	Py_ssize_t key_width = 0;
+	bool compact_keys = false;
+	std::vector<UnboxedValue> unboxed_values;
+	// number of active buffer exports of 'unboxed_values'
+	Py_ssize_t exports = 0;
+	// shape and strides of the exported buffer
+	Py_ssize_t export_shape = 0;
+	Py_ssize_t export_stride = sizeof(UnboxedValue);
+	// Number of keys of each length (in code units), longest first.  Only 
+	// maintained once longest_prefix() has been called.
+	std::optional<std::map<Py_ssize_t, Py_ssize_t, std::greater<Py_ssize_t>>> key_length_counts;
+
+	// The prefix index holds the keys in KeyOrder.h order.  The entries are 
+	// referred to by their StringDictEntry, which doesn't move when the 
+	// entries vector is reallocated or compacted.
+	struct IndexedKey
+	{
+		const StringDictEntry* entry;
+		Py_hash_t hash;
+
+		KeyInfo key_info() const
+		{
+			KeyInfo ki;
+			Entry_AsKeyInfo(entry, &ki);
+			ki.hash = hash;
+			return ki;
+		}
+	};
+
+	struct IndexedKeyOrder
+	{
+		using is_transparent = void;
+
+		bool operator()(const IndexedKey& l, const IndexedKey& r) const
+		{ return compare_keys(l.key_info(), r.key_info()) < 0; }
+
+		bool operator()(const IndexedKey& l, const KeyInfo& r) const
+		{ return compare_keys(l.key_info(), r) < 0; }
+
+		bool operator()(const KeyInfo& l, const IndexedKey& r) const
+		{ return compare_keys(l, r.key_info()) < 0; }
+	};
+
+	bool prefix_index_enabled = false;
+	std::optional<std::set<IndexedKey, IndexedKeyOrder>> prefix_index;
 };
 
 
 
 extern "C" bool StringDict_Check(PyObject* self);
 extern "C" bool StringDict_CheckExact(PyObject* self);
+extern "C" PyTypeObject StringDict_Type;
 
 struct StringDict: 
 	public StringDictBase
@@ -739,8 +1135,7 @@ struct StringDict:
 			PythonObject k(key);
 			Py_INCREF(value);
 			PythonObject v(value);
-			PythonObject obj(this->set(key, value, false));
-			if(not obj)
+			if(0 != this->assign(key, value))
 				return -1;
 		}
 		return 0;
@@ -770,7 +1165,7 @@ struct StringDict:
 			PythonObject v(PySequence_GetItem(kvp, 1));
 			if(not v)
 				return -1;
-			if(not this->set(k, v, false))
+			if(0 != this->assign(k, v))
 				return -1;
 		}
 		Py_DECREF(iter.release());
@@ -785,6 +1180,16 @@ struct StringDict:
 		return update_from_iterable(items);
 	}
 	
+	// Key info of an entry of 'other', hashed for lookups in this dict.  
+	// 'owner' holds the decoded key if 'other' stores it as UTF-8.
+	std::optional<KeyInfo> key_info_from(const StringDict& other, const Entry& other_ent, PythonObject& owner) const
+	{
+		auto ki = other_ent.decoded_key_info(owner);
+		if(ki and other.key_width and (not key_width))
+			ki->hash = DataKind_Hash(ki->kind, ki->data, ki->data_size);
+		return ki;
+	}
+
 	int update_from_string_dict(const StringDict& other)
 	{
 		if(other.size() == 0)
@@ -792,23 +1197,18 @@ struct StringDict:
 		int err = 0;
 		auto visit_other = [&](const auto& other_ent) {
 			assert(not other_ent.is_empty());
-			auto ki = other_ent.as_key_info();
-			auto [idx, ent] = find_insertion(ki);
-			if(not ent)
-			{
-				if(not add_entry(ki, idx, other_ent.get_value()))
-				{
-					err = -1;
-					return true;
-				}
-			}
-			else if(ent->is_empty())
+			PythonObject owner;
+			auto ki = key_info_from(other, other_ent, owner);
+			if(not ki)
 			{
-				assign_entry(ki, ent, other_ent.get_value());
+				err = -1;
+				return true;
 			}
-			else 
+			PythonObject value(other.value_of(other_ent));
+			if((not value) or (not insert(*ki, value.get(), false)))
 			{
-				ent->set_value(other_ent.get_value());
+				err = -1;
+				return true;
 			}
 			return false;
 		};
@@ -819,7 +1219,7 @@ struct StringDict:
 	int update_from_object(PyObject* o)
 	{
 		if(StringDict_Check(o))
-			if(o != static_cast<PyObject*>(this))
+			if(o == static_cast<PyObject*>(this))
 				return 0;
 			else
 				return update_from_string_dict(*static_cast<StringDict*>(o));
@@ -827,10 +1227,8 @@ struct StringDict:
 			return update_from_kwargs(o);
 		else if(PyMapping_Check(o) and PyObject_HasAttrString(o, "items")) 
 			return update_from_mapping(o);
-		else if(PyObject* it = PyObject_GetIter(o); (not it))
-			return -1;
 		else
-			return update_from_iterable(it);
+			return update_from_iterable(o);
 	}
 
 	static bool try_default_construct(StringDict* mem)
@@ -847,9 +1245,8 @@ struct StringDict:
 		{
 			new(mem) StringDict();
 			assert(mem->size() == 0);
-			assert(mem->bucket_count() == min_buckets);
+			assert(mem->is_small());
 			assert(mem->entry_slot_count() == 0);
-			assert(mem->mask == (min_buckets - 1));
 			return true;
 		}
 		catch(const std::exception& e)
@@ -901,9 +1298,17 @@ struct StringDict:
 				comma = ',';
 			else if(0 != _PyUnicodeWriter_WriteASCIIString(&writer, comma_sep, 2))
 				return true;
-			if(0 != ent.write_repr(&writer))
+			if(not is_typed())
+				return (0 != ent.write_repr(&writer));
+			if(0 != ent.write_key_repr(&writer))
 				return true;
-			return false;
+			if(0 != _PyUnicodeWriter_WriteASCIIString(&writer, ": ", 2))
+				return true;
+			PythonObject value(value_of(ent));
+			if(not value)
+				return true;
+			PythonObject value_repr(PyObject_Repr(value));
+			return (not value_repr) or (0 != _PyUnicodeWriter_WriteStr(&writer, value_repr));
 		};
 		
 		if(visit_nonempty_entries(write_entry))
@@ -927,7 +1332,7 @@ struct StringDict:
 			return nullptr;
 		}
 		[[maybe_unused]]
-		const auto [ki, meta_] = make_key_info(key);
+		const auto [ki, meta_] = key_info_for(key);
 		if(not meta_)
 			return nullptr;
 		[[maybe_unused]]
@@ -936,9 +1341,10 @@ struct StringDict:
 		if(ent)
 		{
 			assert(not ent->is_empty());
-			PyObject* value = ent->get_value_newref();
-			remove_entry(ent);
-			return value;
+			PythonObject value(value_of(*ent));
+			if((not value) or (0 != remove_entry(ent)))
+				return nullptr;
+			return value.release();
 		}
 		else if(default_value)
 		{
@@ -947,7 +1353,7 @@ struct StringDict:
 		}
 		else
 		{
-			PyErr_SetObject(PyExc_KeyError, key);
+			PyErr_SetObject(PyExc_KeyError, StringDictKey_Unwrap(key));
 			return nullptr;
 		}
 	}
@@ -962,17 +1368,16 @@ struct StringDict:
 		auto pos = std::find_if_not(entries.begin(), entries.end(), std::mem_fn(&Entry::is_empty));
 		assert(pos < entries.end());
 		assert(not pos->is_empty());
-		PyObject* kvp = pos->as_tuple();
-		if(not kvp)
+		PythonObject kvp(item_of(*pos));
+		if((not kvp) or (0 != remove_entry(&(*pos))))
 			return nullptr;
-		remove_entry(&(*pos));
-		return kvp;
+		return kvp.release();
 	}
 
 	PyObject* getdefault(PyObject* key, PyObject* default_value) 
 	{
 		assert(default_value);
-		const auto [ki, meta_] = make_key_info(key);
+		const auto [ki, meta_] = key_info_for(key);
 		if(not meta_)
 			return nullptr;
 		auto [idx, ent] = find_existing(ki);
@@ -981,7 +1386,7 @@ struct StringDict:
 		if(ent)
 		{
 			assert(not ent->is_empty());
-			value = ent->get_value_newref();
+			value = value_of(*ent);
 		}
 		else
 		{
@@ -991,741 +1396,3624 @@ struct StringDict:
 		return value;
 	}
 
-	PyObject* set(PyObject* key, PyObject* value, bool setdefault = false) 
+	// Add 'ki' or replace its value.  With 'setdefault', existing values are
+	// kept.  Returns the entry holding 'ki', or nullptr on error.
+	Entry* insert(const KeyInfo& ki, PyObject* value, bool setdefault, const UnboxedValue* unboxed = nullptr) 
 	{
 		assert(value);
-		const auto [ki, meta_] = make_key_info(key);
+		UnboxedValue unboxed_value;
+		if(is_typed() and (not unboxed))
+		{
+			unboxed = unbox_for_insertion(value, &unboxed_value);
+			if(not unboxed)
+				return nullptr;
+		}
+		auto [idx, ent] = find_insertion(ki);
+		if(not ent)
+			return add_entry(ki, idx, value, unboxed);
+		else if(setdefault and (not ent->is_empty()))
+			return ent;
+		else
+			return assign_entry(ki, ent, value, unboxed);
+	}
+
+	// Returns a new reference to the value stored for 'key'.
+	PyObject* set(PyObject* key, PyObject* value, bool setdefault = false) 
+	{
+		const auto [ki, meta_] = key_info_for(key);
 		if(not meta_)
 			return nullptr;
-		auto [idx, ent] = find_insertion(ki);
+		Entry* ent = insert(ki, value, setdefault);
 		if(not ent)
+			return nullptr;
+		return value_of(*ent);
+	}
+
+	int assign(PyObject* key, PyObject* value) 
+	{
+		const auto [ki, meta_] = key_info_for(key);
+		if(not meta_)
+			return -1;
+		return insert(ki, value, false) ? 0 : -1;
+	}
+
+	// Add 'delta' to the value of 'ki', treating missing keys as zero.  The 
+	// key is probed once unless adding the values runs python code.  Returns
+	// the entry holding 'ki', or nullptr on error.
+	Entry* increment_key(const KeyInfo& ki, PyObject* delta)
+	{
+		UnboxedValue unboxed_delta;
+		if(is_typed() and (0 != unbox_value(delta, &unboxed_delta)))
+			return nullptr;
+		auto [idx, ent] = find_insertion(ki);
+		if((not ent) or ent->is_empty())
 		{
-			ent = add_entry(ki, idx, value);
-			if(not ent)
+			if(is_typed() or PyLong_CheckExact(delta))
+			{
+				if(not ent)
+					return add_entry(ki, idx, delta, &unboxed_delta);
+				return assign_entry(ki, ent, delta, &unboxed_delta);
+			}
+			// Store 0 + delta rather than 'delta' itself, which rejects 
+			// non-numbers and avoids aliasing mutable deltas.  __add__() 
+			// may modify the dict, so the key is probed again afterwards.
+			PythonObject zero(PyLong_FromLong(0));
+			if(not zero)
 				return nullptr;
-			return ent->get_value_newref();
+			PythonObject new_value(PyNumber_Add(zero.get(), delta));
+			if(not new_value)
+				return nullptr;
+			return insert(ki, new_value.get(), false);
 		}
-		else if(setdefault)
+		
+		if(is_typed())
 		{
-			if(try_assign_entry(ki, ent, value))
+			UnboxedValue& value = unboxed_values[index_of(*ent)];
+			on_value_changed();
+			if(value_type == ValueType::float64)
+			{
+				value.f += unboxed_delta.f;
+			}
+			else if(std::int64_t sum; not __builtin_add_overflow(value.i, unboxed_delta.i, &sum))
 			{
-				Py_INCREF(value);
-				return value;
+				value.i = sum;
 			}
 			else
 			{
-				return ent->get_value_newref();
+				PyErr_SetString(PyExc_OverflowError, "strdict.increment() overflowed an 'i8' value.");
+				return nullptr;
 			}
+			return ent;
 		}
-		else
+
+		PyObject* value = ent->get_value();
+		if(PyLong_CheckExact(value) and PyLong_CheckExact(delta))
 		{
-			assign_entry(ki, ent, value);
-			return value;
+			// Fast path for counters.  No python code runs, so 'ent' stays valid.
+			int overflow_value = 0;
+			int overflow_delta = 0;
+			long long lhs = PyLong_AsLongLongAndOverflow(value, &overflow_value);
+			long long rhs = PyLong_AsLongLongAndOverflow(delta, &overflow_delta);
+			long long sum;
+			if((not overflow_value) and (not overflow_delta) and (not __builtin_add_overflow(lhs, rhs, &sum)))
+			{
+				PythonObject new_value(PyLong_FromLongLong(sum));
+				if(not new_value)
+					return nullptr;
+				on_value_changed();
+				ent->set_value(new_value.get());
+				return ent;
+			}
 		}
+		// __add__() may modify the dict, so the key is probed again afterwards.
+		Py_INCREF(value);
+		PythonObject old_value(value);
+		PythonObject new_value(PyNumber_Add(old_value.get(), delta));
+		if(not new_value)
+			return nullptr;
+		return insert(ki, new_value.get(), false);
 	}
 
-	int remove(PyObject* key)
+	PyObject* increment(PyObject* key, PyObject* delta)
 	{
-		const auto [ki, meta_] = make_key_info(key);
+		const auto [ki, meta_] = key_info_for(key);
 		if(not meta_)
-			return -1;
-		auto [idx, ent] = find_existing(ki);
-		(void)idx;
+			return nullptr;
+		Entry* ent = increment_key(ki, delta);
 		if(not ent)
-		{
-			PyErr_SetObject(PyExc_KeyError, key);
-			return -1;
-		}
-		assert(not ent->is_empty());
-		remove_entry(ent);
-		return 0;
+			return nullptr;
+		return value_of(*ent);
 	}
 
-	int contains(PyObject* key)
+	// Increment the value of every key in 'iterable' by one.
+	int count(PyObject* iterable)
 	{
-		const auto [ki, meta_] = make_key_info(key);
-		if(not meta_)
+		PythonObject iter(PyObject_GetIter(iterable));
+		if(not iter)
 			return -1;
-		auto [idx, ent] = find_existing(ki);
-		(void)idx;
-		if(ent)
-			assert(not ent->is_empty());
-		return bool(ent);
+		PythonObject one(PyLong_FromLong(1));
+		if(not one)
+			return -1;
+		while(PythonObject key{PyIter_Next(iter)})
+		{
+			const auto [ki, meta_] = key_info_for(key.get());
+			if(not meta_)
+				return -1;
+			if(not increment_key(ki, one.get()))
+				return -1;
+		}
+		return bool(PyErr_Occurred()) ? -1 : 0;
 	}
 
-	
-	PyObject* subscript(PyObject* key)
+	// Parse an optionally signed decimal integer that fits in an int64.
+	static bool parse_int64(std::string_view text, std::int64_t* result)
 	{
-		const auto [ki, meta_] = make_key_info(key);
-		if(not meta_)
-			return nullptr;
-		auto [idx, ent] = find_existing(ki);
-		(void)idx;
-		if(not ent)
+		bool negative = false;
+		if((not text.empty()) and ((text.front() == '-') or (text.front() == '+')))
 		{
-			if(not StringDict_CheckExact(this))
-			{
-				// check if subtype provides '.__missing__()'
-				_Py_IDENTIFIER(__missing__);
-				PythonObject missing_method(_PyObject_LookupSpecial(this, &PyId___missing__));
-				if(missing_method)
-					return PyObject_CallFunctionObjArgs(missing_method.get(), key, nullptr);
-				else if(PyErr_Occurred())
-					return nullptr;
-			}
-			PyErr_SetObject(PyExc_KeyError, key);
-			return nullptr;
+			negative = (text.front() == '-');
+			text.remove_prefix(1);
 		}
-		assert(not ent->is_empty());
-		return ent->get_value_newref();
-	}
-	
-	bool contains_entry_key(Entry& ent)
-	{
-		assert(not ent.is_empty());
-		auto ki = ent.as_key_info();
-		auto [idx, my_ent] = find_existing(ki);
-		(void)idx;
-		return bool(my_ent);
+		// 18 digits can't overflow
+		if(text.empty() or (text.size() > 18))
+			return false;
+		std::int64_t value = 0;
+		for(char c: text)
+		{
+			if((c < '0') or (c > '9'))
+				return false;
+			value = value * 10 + (c - '0');
+		}
+		*result = negative ? -value : value;
+		return true;
 	}
 
-	int contains_entry(Entry& other_ent)
+	static bool parse_float64(std::string_view text, double* result)
 	{
-		assert(not other_ent.is_empty());
-		auto ki = other_ent.as_key_info();
-		auto [idx, ent] = find_existing(ki);
-		(void)idx;
-		if(not ent)
+		if(text.empty() or (text.size() > 64) or (text.find('\0') != text.npos))
 			return false;
-		PyObject* value = ent->get_value();
-		PyObject* other_value = other_ent.get_value();
-		assert(value);
-		assert(other_value);
-		return PyObject_RichCompareBool(value, other_value, Py_EQ);
+		char buff[65];
+		std::memcpy(buff, text.data(), text.size());
+		buff[text.size()] = '\0';
+		char* end = nullptr;
+		*result = PyOS_string_to_double(buff, &end, nullptr);
+		if(end != buff + text.size())
+		{
+			PyErr_Clear();
+			return false;
+		}
+		return not PyErr_Occurred();
 	}
-	
-	int operator==(StringDict& other)
+
+	// Parse the value of one line for load_buffer().  Typed dicts get the 
+	// value in 'unboxed' when it can be parsed without creating an object, 
+	// and None is returned.  Returns a new reference.
+	PyObject* parse_value(std::string_view text, PyObject* value_parser, UnboxedValue* unboxed, bool* is_unboxed)
 	{
-		if(size() != other.size())
-			return false;
-		
-		// we're going to iterate through the StringDict that has fewer entry slots.  This means
-		// less time spent skipping over empty entries and m
-		StringDict& iter_dict =  (entry_slot_count() <= other.entry_slot_count()) ? *this : other;
-		StringDict& other_dict = (entry_slot_count() <= other.entry_slot_count()) ? other : *this;
-		// once this hits zero, we'll break out of the loop 
-		Py_ssize_t nonempty_count = iter_dict.size();
-		for(Entry& ent: iter_dict.entries)
+		*is_unboxed = false;
+		if(value_parser == reinterpret_cast<PyObject*>(&PyLong_Type))
 		{
-			if(not ent.is_empty()) 
+			std::int64_t i;
+			if(parse_int64(text, &i))
 			{
-				int has_ent = other_dict.contains_entry(ent);
-				if(has_ent < 0) // error
-					return has_ent;
-				else if(not has_ent) // iter_dict has key that other_dict doesn't
-					return false;
-				
-				assert(nonempty_count > 0);
-				--nonempty_count;
-				if(nonempty_count == 0)
+				if(value_type == ValueType::int64)
 				{
-					// assert that the rest of the entries are empty
-					assert(std::all_of(
-						iter_dict.entries.begin() + (&ent - iter_dict.entries.data()) + 1,
-						iter_dict.entries.end(),
-						std::mem_fn(&Entry::is_empty)
-					));
-					break;
+					unboxed->i = i;
+					*is_unboxed = true;
+					Py_INCREF(Py_None);
+					return Py_None;
 				}
+				return PyLong_FromLongLong(i);
 			}
 		}
-		return true;
-	}
-	
-	int operator!=(StringDict& other)
-	{
-		int eq = (*this) == other;
-		if(eq < 0)
-			return eq;
-		else 
-			return not eq;
+		else if(value_parser == reinterpret_cast<PyObject*>(&PyFloat_Type))
+		{
+			double f;
+			if(parse_float64(text, &f))
+			{
+				if(value_type == ValueType::float64)
+				{
+					unboxed->f = f;
+					*is_unboxed = true;
+					Py_INCREF(Py_None);
+					return Py_None;
+				}
+				return PyFloat_FromDouble(f);
+			}
+		}
+		PythonObject bytes(PyBytes_FromStringAndSize(text.data(), text.size()));
+		if((not bytes) or (value_parser == Py_None))
+			return bytes.release();
+		return PyObject_CallFunctionObjArgs(value_parser, bytes.get(), nullptr);
 	}
 
-	int equals_dict(PyObject* dict)
+	// Add the key-value pairs of a buffer holding lines of the form
+	// <key><kv_sep><value>, separated by 'line_sep'.  Keys are hashed and 
+	// copied straight from the buffer.  They're bytes, unless 'decode_keys' 
+	// is true, in which case they're decoded as UTF-8.  Empty lines are 
+	// skipped.
+	int load_buffer(std::string_view data, std::string_view line_sep, std::string_view kv_sep, 
+		PyObject* value_parser, bool decode_keys)
 	{
-		assert(PyDict_Check(dict));
-		if(PyDict_Size(dict) != static_cast<Py_ssize_t>(size()))
-			return false;
-		
-		// iterate over the dict()
-		Py_ssize_t pos = 0;
-		PyObject* key = nullptr;
-		PyObject* value = nullptr;
-		
-		while(PyDict_Next(dict, &pos, &key, &value))
+		assert((not line_sep.empty()) and (not kv_sep.empty()));
+		// count the lines first so the dict only has to be sized once
+		Py_ssize_t line_count = 1;
+		for(auto pos = data.find(line_sep); pos != data.npos; pos = data.find(line_sep, pos + line_sep.size()))
+			++line_count;
+		if(0 != reserve_space(size() + line_count))
+			return -1;
+
+		Py_ssize_t lineno = 0;
+		while(not data.empty())
 		{
-			const auto [ki, meta_] = make_key_info(key);
-			if(not meta_)
+			++lineno;
+			auto line_end = data.find(line_sep);
+			std::string_view line = data.substr(0, line_end);
+			data.remove_prefix((line_end == data.npos) ? data.size() : (line_end + line_sep.size()));
+			if(line.empty())
+				continue;
+			auto key_end = line.find(kv_sep);
+			if(key_end == line.npos)
+			{
+				PyErr_Format(PyExc_ValueError, "Line %zd of strdict buffer has no key-value separator.", lineno);
 				return -1;
-			auto [idx, ent] = find_existing(ki);
-			(void)idx;
-			if(not ent)
-				return false;
-			assert(not ent->is_empty());
-			PyObject* strdict_value = ent->get_value();
-			if(int cmp = PyObject_RichCompareBool(value, strdict_value, Py_EQ); cmp == -1)
+			}
+			std::string_view key = line.substr(0, key_end);
+			const auto* key_data = reinterpret_cast<const unsigned char*>(key.data());
+			KeyInfo ki;
+			PythonObject key_obj;
+			if(not decode_keys)
+			{
+				ki = make_key_info(key_data, key.size(), PY_BYTES);
+			}
+			else if(std::all_of(key_data, key_data + key.size(), [](unsigned char c) { return c < 0x80; }))
+			{
+				// ASCII is stored the same way in UTF-8 and in a UCS1 str
+				ki = make_key_info(key_data, key.size(), PY_UCS1);
+			}
+			else
+			{
+				key_obj = PythonObject(PyUnicode_DecodeUTF8(key.data(), key.size(), nullptr));
+				if(not key_obj)
+					return -1;
+				if(0 != KeyInfo_Init(key_obj.get(), &ki, nullptr))
+					return -1;
+			}
+			UnboxedValue unboxed;
+			bool is_unboxed;
+			PythonObject value(parse_value(line.substr(key_end + kv_sep.size()), value_parser, &unboxed, &is_unboxed));
+			if(not value)
 				return -1;
-			else if(not cmp)
+			if(not insert(ki, value.get(), false, is_unboxed ? &unboxed : nullptr))
+				return -1;
+		}
+		return 0;
+	}
+
+	// Call 'visit(token, is_last)' with each token of 'text' separated by 
+	// 'sep', like text.split(sep).  Stops early and returns true if 'visit'
+	// does.
+	template <class CharT, class Visitor>
+	static bool visit_tokens(std::basic_string_view<CharT> text, std::basic_string_view<CharT> sep, Visitor visit)
+	{
+		assert(not sep.empty());
+		for(;;)
+		{
+			auto token_end = text.find(sep);
+			if(visit(text.substr(0, token_end), token_end == text.npos))
+				return true;
+			if(token_end == text.npos)
 				return false;
+			text.remove_prefix(token_end + sep.size());
 		}
-		return true;
 	}
 
-	int make_copy(StringDict& other)
+	// Like visit_tokens(), but splits on runs of characters for which 
+	// 'is_space' is true and skips leading and trailing ones, like 
+	// text.split().
+	template <class CharT, class IsSpace, class Visitor>
+	static bool visit_whitespace_tokens(std::basic_string_view<CharT> text, IsSpace is_space, Visitor visit)
 	{
-		assert(other.size() == 0);
-		assert(other.offsets.size() == min_buckets);
-		assert(other.entries.size() == 0);
-		try
+		std::size_t pos = 0;
+		auto skip_spaces = [&]() {
+			while((pos < text.size()) and is_space(text[pos]))
+				++pos;
+		};
+		skip_spaces();
+		while(pos < text.size())
 		{
-			other.entries.reserve(this->entries.size());
-			other.offsets = this->offsets;
-			for(Entry& ent: this->entries)
+			const std::size_t start = pos;
+			while((pos < text.size()) and (not is_space(text[pos])))
+				++pos;
+			auto token = text.substr(start, pos - start);
+			skip_spaces();
+			if(visit(token, pos == text.size()))
+				return true;
+		}
+		return false;
+	}
+
+	// Split the str 'text', whose characters are stored as CharT, on 'sep', 
+	// or on 'default_sep' if 'sep' is null.  If both are null, splits on 
+	// whitespace like str.split().  'name' is the method name for error
+	// messages.
+	template <class CharT, class Visitor>
+	static int visit_str_tokens(PyObject* text, PyObject* sep, const char* default_sep, const char* name, Visitor visit)
+	{
+		std::basic_string_view<CharT> text_view(static_cast<const CharT*>(PyUnicode_DATA(text)), PyUnicode_GET_LENGTH(text));
+		if((not sep) and (not default_sep))
+		{
+			return visit_whitespace_tokens(text_view, [](CharT c) {
+				return Py_UNICODE_ISSPACE(static_cast<Py_UCS4>(static_cast<std::make_unsigned_t<CharT>>(c)));
+			}, visit) ? -1 : 0;
+		}
+		std::basic_string<CharT> sep_chars;
+		bool sep_fits = true;
+		if(not sep)
+		{
+			for(const char* c = default_sep; *c; ++c)
+				sep_chars.push_back(static_cast<CharT>(*c));
+		}
+		else
+		{
+			const auto sep_kind = PyUnicode_KIND(sep);
+			const void* sep_data = PyUnicode_DATA(sep);
+			for(Py_ssize_t i = 0, count = PyUnicode_GET_LENGTH(sep); i < count; ++i)
 			{
-				auto opt_ent = ent.make_copy();
-				if(not opt_ent.has_value())
-					throw std::runtime_error("Attempt to make copy strdict entry failed while copying strdict instance.");
-				other.entries.push_back(std::move(*opt_ent));
+				Py_UCS4 c = PyUnicode_READ(sep_kind, sep_data, i);
+				// characters that don't fit in CharT can't be in 'text'
+				sep_fits = sep_fits and (c <= std::numeric_limits<std::make_unsigned_t<CharT>>::max());
+				sep_chars.push_back(static_cast<CharT>(c));
 			}
-			other.mask = this->mask;
-			other.occupied = this->occupied;
-			return 0;
 		}
-		catch(const std::bad_alloc& e)
+		if(sep_chars.empty())
 		{
-			PyErr_SetString(PyExc_MemoryError, "Allocation failed while copying strdict instance.");
+			PyErr_Format(PyExc_ValueError, "strdict.%s() separator must not be empty.", name);
 			return -1;
 		}
-		catch(const std::exception& e)
+		if(not sep_fits)
+			return visit(text_view, true) ? -1 : 0;
+		return visit_tokens(text_view, std::basic_string_view<CharT>(sep_chars), visit) ? -1 : 0;
+	}
+
+	// Call 'visit(ki, is_last)' with a KeyInfo for each token of 'text' (a str
+	// or bytes-like object) split on 'sep', or on 'default_sep' (ASCII) if 
+	// 'sep' is null, or on runs of whitespace if both are null.  The tokens are hashed and compared straight from 
+	// 'text', and 'ki' is only valid during the call.  Stops early if 'visit' 
+	// returns true.  Returns -1 on error or if 'visit' stopped.
+	template <class Visitor>
+	static int visit_key_tokens(PyObject* text, PyObject* sep, const char* default_sep, const char* name, Visitor visit)
+	{
+		if(PyUnicode_Check(text))
 		{
-			PyErr_SetString(PyExc_RuntimeError, e.what());
+			if(sep and (not PyUnicode_Check(sep)))
+			{
+				PyErr_Format(PyExc_TypeError, "strdict.%s() separator for str must be str, not '%.200s'.", 
+					name, Py_TYPE(sep)->tp_name);
+				return -1;
+			}
+			std::vector<unsigned char> scratch;
+			auto visit_token = [&](DataKind kind, auto token, bool is_last) {
+				if(kind == PY_UCS1)
+					return visit(make_key_info(reinterpret_cast<const unsigned char*>(token.data()), token.size(), kind), is_last);
+				return visit(make_str_slice_key_info(token.data(), token.size(), kind, scratch), is_last);
+			};
+			switch(PyUnicode_KIND(text))
+			{
+			case PyUnicode_1BYTE_KIND:
+				return visit_str_tokens<char>(text, sep, default_sep, name, [&](auto token, bool is_last) {
+					return visit_token(PY_UCS1, token, is_last);
+				});
+			case PyUnicode_2BYTE_KIND:
+				return visit_str_tokens<char16_t>(text, sep, default_sep, name, [&](auto token, bool is_last) {
+					return visit_token(PY_UCS2, token, is_last);
+				});
+			default:
+				return visit_str_tokens<char32_t>(text, sep, default_sep, name, [&](auto token, bool is_last) {
+					return visit_token(PY_UCS4, token, is_last);
+				});
+			}
+		}
+
+		Py_buffer text_buff;
+		if(0 != PyObject_GetBuffer(text, &text_buff, PyBUF_SIMPLE))
+			return -1;
+		auto text_guard = make_scope_guard([&](){ PyBuffer_Release(&text_buff); });
+		Py_buffer sep_buff = {};
+		if(sep and (0 != PyObject_GetBuffer(sep, &sep_buff, PyBUF_SIMPLE)))
+			return -1;
+		auto sep_guard = make_scope_guard([&](){ 
+			if(sep_buff.obj)
+				PyBuffer_Release(&sep_buff); 
+		});
+		std::string_view text_view(static_cast<const char*>(text_buff.buf), text_buff.len);
+		auto visit_token = [&](std::string_view token, bool is_last) {
+			return visit(make_key_info(reinterpret_cast<const unsigned char*>(token.data()), token.size(), PY_BYTES), is_last);
+		};
+		if((not sep) and (not default_sep))
+		{
+			// ASCII whitespace, like bytes.split()
+			return visit_whitespace_tokens(text_view, [](char c) {
+				return (c == ' ') or ((c >= '\t') and (c <= '\r'));
+			}, visit_token) ? -1 : 0;
+		}
+		std::string_view sep_view = sep ? std::string_view(static_cast<const char*>(sep_buff.buf), sep_buff.len) : default_sep;
+		if(sep_view.empty())
+		{
+			PyErr_Format(PyExc_ValueError, "strdict.%s() separator must not be empty.", name);
 			return -1;
 		}
+		return visit_tokens(text_view, sep_view, visit_token) ? -1 : 0;
 	}
 
-	template <class GetItem>
-	PyObject* make_itemlist(GetItem get_item)
+	// Look up each token of 'text' split on 'sep' (or on whitespace if 'sep'
+	// is null) and return a list of their values, with 'default_value' for 
+	// missing tokens.  The tokens are hashed and compared straight from 'text'.
+	PyObject* lookup_tokens(PyObject* text, PyObject* sep, PyObject* default_value)
 	{
-		PythonObject itemlist(PyList_New(size()));
-		if(not itemlist)
+		PythonObject result(PyList_New(0));
+		if(not result)
 			return nullptr;
-		
-		auto list_size = static_cast<Py_ssize_t>(size());
-		PyObject** list_items = PySequence_Fast_ITEMS(itemlist);
-		[[maybe_unused]]
-		PyObject** list_items_stop = list_items + list_size;
-		auto visit_ent = [&](const Entry& ent) {
-			assert(not ent.is_empty());
-			assert(list_items < list_items_stop);
-			*list_items = get_item(ent);
-			if(not *list_items++)
+		// looking up entries and building the list can't run python code, 
+		// so the dict can't change while we're in here.
+		int err = visit_key_tokens(text, sep, nullptr, "lookup_tokens", [&](const KeyInfo& ki, bool /* is_last */) {
+			auto [idx, ent] = find_existing(ki);
+			(void)idx;
+			PyObject* value = ent ? value_of(*ent) : (Py_INCREF(default_value), default_value);
+			if(not value)
+				return true;
+			int err = PyList_Append(result.get(), value);
+			Py_DECREF(value);
+			return (err != 0);
+		});
+		if(err)
+			return nullptr;
+		return result.release();
+	}
+
+	// The value at 'path' in nested strdicts, where each segment of 'path' 
+	// split on 'sep' is the key of the next level.  Returns 'default_value' 
+	// if a segment is missing, or if a level that isn't the last one isn't 
+	// a strdict.
+	PyObject* get_path(PyObject* path, PyObject* sep, PyObject* default_value)
+	{
+		// the current level and the value found in it
+		Py_INCREF(this);
+		PythonObject level(this);
+		PythonObject value;
+		bool found = true;
+		int err = visit_key_tokens(path, sep, ".", "get_path", [&](const KeyInfo& ki, bool /* is_last */) {
+			if(value)
 			{
-				itemlist.reset();
+				if(not StringDict_Check(value.get()))
+				{
+					found = false;
+					return true;
+				}
+				level = std::move(value);
+			}
+			auto* dict = static_cast<StringDict*>(level.get());
+			auto [idx, ent] = dict->find_existing(ki);
+			(void)idx;
+			if(not ent)
+			{
+				found = false;
 				return true;
 			}
-			else 
-				return false;
-		};
-		if(visit_nonempty_entries(visit_ent))
-			assert(not itemlist);
-		else
-			assert(itemlist);
-		return itemlist.release();
+			value = PythonObject(dict->value_of(*ent));
+			return not value;
+		});
+		if(not err)
+			return value.release();
+		else if(found)
+			return nullptr;
+		Py_INCREF(default_value);
+		return default_value;
 	}
-	
-	PyObject* get_values()
+
+	// Set the value at 'path' in nested strdicts, adding empty strdicts for
+	// missing levels.  Raises TypeError if a level that isn't the last one 
+	// holds something other than a strdict.
+	int set_path(PyObject* path, PyObject* sep, PyObject* value)
 	{
-		return make_itemlist(std::mem_fn(&Entry::get_value_newref));
+		Py_INCREF(this);
+		PythonObject level(this);
+		Py_ssize_t depth = 0;
+		return visit_key_tokens(path, sep, ".", "set_path", [&](const KeyInfo& segment, bool is_last) {
+			auto* dict = static_cast<StringDict*>(level.get());
+			KeyInfo ki = segment;
+			if(dict->key_width and (not dict->to_fixed_width(ki)))
+				return bool(dict->fixed_width_error(ki));
+			if(is_last)
+				return not dict->insert(ki, value, false);
+			++depth;
+			auto [idx, ent] = dict->find_existing(ki);
+			(void)idx;
+			PythonObject next;
+			if(ent)
+			{
+				next = PythonObject(dict->value_of(*ent));
+				if(not next)
+					return true;
+				if(not StringDict_Check(next.get()))
+				{
+					PyErr_Format(PyExc_TypeError, "strdict.set_path() segment %zd of the path holds '%.200s', not a strdict.", 
+						depth, Py_TYPE(next.get())->tp_name);
+					return true;
+				}
+			}
+			else
+			{
+				next = PythonObject(PyObject_CallNoArgs(reinterpret_cast<PyObject*>(&StringDict_Type)));
+				if((not next) or (not dict->insert(ki, next.get(), false)))
+					return true;
+			}
+			level = std::move(next);
+			return false;
+		});
 	}
 
-	PyObject* get_keys()
+	// The following serve the C API (StringDictCAPI.h), whose keys are raw 
+	// key data hashed like str() and bytes() objects.
+
+	// Returns 1 and a new reference to the value of 'ki' in '*value', 0 if 
+	// 'ki' is missing, or -1 on error.
+	int lookup_data(const KeyInfo& ki, PyObject** value)
 	{
-		return make_itemlist(std::mem_fn(&Entry::get_key_newref));
+		auto [idx, ent] = find_existing(ki);
+		(void)idx;
+		if(not ent)
+			return 0;
+		*value = value_of(*ent);
+		return *value ? 1 : -1;
 	}
-	
-	PyObject* get_items()
+
+	int assign_data(KeyInfo ki, PyObject* value)
 	{
-		return make_itemlist(std::mem_fn(&Entry::as_tuple));
+		if(key_width and (not to_fixed_width(ki)))
+			return fixed_width_error(ki);
+		return insert(ki, value, false) ? 0 : -1;
 	}
-	
-	int gc_traverse(visitproc visit, void* arg)
-	{
-		int result = 0;
 
-		// Wrap the Py_VISIT() macro, which conditionally returns an int.
-		// Specifically, make it return a std::optional<int>.
-		auto py_visit_wrap = [&](PyObject* obj) -> std::optional<int>{
-			Py_VISIT(obj);
-			return std::nullopt;
-		};
+	// Returns 1 if 'ki' was removed, 0 if it's missing, or -1 on error.
+	int remove_data(const KeyInfo& ki)
+	{
+		auto [idx, ent] = find_existing(ki);
+		(void)idx;
+		if(not ent)
+			return 0;
+		return (0 == remove_entry(ent)) ? 1 : -1;
+	}
 
-		// Visit all entries in the strdict.  Note that this lambda may mutate 'result'
-		auto visit_entry = [&](const auto& ent) {
-			assert(not ent.is_empty());
-			auto visit_result = py_visit_wrap(ent.get_value());
-			if(visit_result.has_value())
+	// Like PyDict_Next(), but with new references in '*key' and '*value' 
+	// (either may be null to skip it).  Returns 1 while there are entries 
+	// left, 0 at the end, or -1 on error.
+	int next_entry(Py_ssize_t* pos, PyObject** key, PyObject** value)
+	{
+		for(auto count = static_cast<Py_ssize_t>(entry_slot_count()); (*pos >= 0) and (*pos < count); )
+		{
+			const Entry& ent = entry_from_index((*pos)++);
+			if(ent.is_empty())
+				continue;
+			PythonObject key_obj(key ? key_of(ent) : nullptr);
+			if(key and (not key_obj))
+				return -1;
+			if(value)
 			{
-				result = *visit_result;
-				return true;
+				*value = value_of(ent);
+				if(not *value)
+					return -1;
 			}
-			return false;
-		};
-		visit_nonempty_entries(visit_entry);
-		return result;
+			if(key)
+				*key = key_obj.release();
+			return 1;
+		}
+		return 0;
 	}
-	
-	friend class StringDictIter;
-};
 
-extern "C" {
+	// Like getdefault() and contains(), but for the key obj[start:stop], 
+	// without creating it.
+	PyObject* get_slice(PyObject* obj, Py_ssize_t start, Py_ssize_t stop, PyObject* default_value)
+	{
+		SliceKeyInfo slice;
+		if(0 != slice.init(obj, start, stop))
+			return nullptr;
+		auto [idx, ent] = find_existing(slice.ki);
+		(void)idx;
+		if(ent)
+			return value_of(*ent);
+		Py_INCREF(default_value);
+		return default_value;
+	}
 
-static PyObject* StringDict_GetType();
+	int contains_slice(PyObject* obj, Py_ssize_t start, Py_ssize_t stop)
+	{
+		SliceKeyInfo slice;
+		if(0 != slice.init(obj, start, stop))
+			return -1;
+		auto [idx, ent] = find_existing(slice.ki);
+		(void)idx;
+		return bool(ent);
+	}
 
-bool StringDict_CheckExact(PyObject* self)
-{ return (PyObject*)(Py_TYPE(self)) == StringDict_GetType(); }
+	// Find the longest key that is a prefix of obj[start:].  Only the 
+	// lengths that keys actually have are probed, longest first.
+	PyObject* longest_prefix(PyObject* obj, Py_ssize_t start)
+	{
+		if(not key_length_counts)
+		{
+			try
+			{
+				key_length_counts.emplace();
+				visit_all_nonempty_entries([&](const Entry& ent) {
+					++(*key_length_counts)[ent.key_length()];
+				});
+			}
+			catch(const std::bad_alloc&)
+			{
+				key_length_counts.reset();
+				PyErr_SetString(PyExc_MemoryError, "Allocation failed while indexing the key lengths of a strdict instance.");
+				return nullptr;
+			}
+		}
+		SliceKeyInfo rest;
+		if(0 != rest.init(obj, start, PY_SSIZE_T_MAX))
+			return nullptr;
+		std::vector<unsigned char> scratch;
+		for(const auto& [len, count]: *key_length_counts)
+		{
+			(void)count;
+			if(len > rest.ki.data_size)
+				continue;
+			KeyInfo ki = (rest.ki.kind <= PY_UCS1) ? make_key_info(rest.ki.data, len, rest.ki.kind)
+				: make_str_slice_key_info(rest.ki.data, len, rest.ki.kind, scratch);
+			auto [idx, ent] = find_existing(ki);
+			(void)idx;
+			if(ent)
+				return item_of(*ent);
+		}
+		Py_RETURN_NONE;
+	}
 
-bool StringDict_Check(PyObject* self)
-{ return PyObject_IsInstance(self, StringDict_GetType()); }
+	// Call 'visit' with each entry whose key starts with 'prefix', in key 
+	// order, until it returns true.
+	template <class Visitor>
+	int visit_prefix(PyObject* prefix, Visitor visit)
+	{
+		if(0 != ensure_prefix_index())
+			return -1;
+		SliceKeyInfo slice;
+		if(0 != slice.init(prefix, 0, PY_SSIZE_T_MAX))
+			return -1;
+		for(auto pos = prefix_index->lower_bound(slice.ki); pos != prefix_index->end(); ++pos)
+		{
+			KeyInfo ki = pos->key_info();
+			if(not key_starts_with(ki, slice.ki))
+				break;
+			auto [idx, ent] = find_existing(ki);
+			(void)idx;
+			assert(ent);
+			if(visit(*ent))
+				return -1;
+		}
+		return 0;
+	}
 
+	template <class GetItem>
+	PyObject* prefix_itemlist(PyObject* prefix, GetItem get_item)
+	{
+		PythonObject result(PyList_New(0));
+		if(not result)
+			return nullptr;
+		int err = visit_prefix(prefix, [&](const Entry& ent) {
+			PythonObject item(get_item(ent));
+			return (not item) or (0 != PyList_Append(result.get(), item.get()));
+		});
+		if(err)
+			return nullptr;
+		return result.release();
+	}
 
-static bool StringDict_CheckErr(PyObject* self)
-{
-	if(not StringDict_Check(self))
+	PyObject* keys_with_prefix(PyObject* prefix)
 	{
-		PyErr_SetObject(PyExc_TypeError, self);
-		return false;
+		return prefix_itemlist(prefix, [&](const Entry& ent) { return key_of(ent); });
 	}
-	else
+
+	PyObject* items_with_prefix(PyObject* prefix)
 	{
-		return true;
+		return prefix_itemlist(prefix, [&](const Entry& ent) { return item_of(ent); });
 	}
+
+	Py_ssize_t count_prefix(PyObject* prefix)
+	{
+		Py_ssize_t count = 0;
+		if(0 != visit_prefix(prefix, [&](const Entry&) { ++count; return false; }))
+			return -1;
+		return count;
+	}
+
+	struct SortKey
+	{
+		KeyInfo ki;
+		const Entry* ent;
+	};
+
+	// MSD radix sort of keys.  Code points are split into 'width' big-endian
+	// byte digits; 1 for bytes and UCS1 keys, 3 for wider str keys (code 
+	// points have at most 21 bits).  Ranges still to be sorted go on an 
+	// explicit stack, and the prefix shared by a whole range is skipped in 
+	// one pass, so long common prefixes neither recurse nor re-count per 
+	// digit.
+	static void radix_sort(SortKey* first, SortKey* last, std::size_t width, std::vector<SortKey>& aux)
+	{
+		constexpr std::ptrdiff_t small_range = 32;
+		struct Range
+		{
+			SortKey* first;
+			SortKey* last;
+			// the keys of the range are equal up to this digit
+			std::size_t depth;
+		};
+		std::vector<Range> stack{Range{first, last, 0}};
+		while(not stack.empty())
+		{
+			auto [first, last, depth] = stack.back();
+			stack.pop_back();
+			if(last - first < small_range)
+			{
+				std::sort(first, last, [](const SortKey& l, const SortKey& r) { 
+					return compare_keys(l.ki, r.ki) < 0; 
+				});
+				continue;
+			}
+			if(depth % width == 0)
+			{
+				// skip the code points that all keys of the range share
+				auto pos = static_cast<Py_ssize_t>(depth / width);
+				Py_ssize_t common = first->ki.data_size - std::min(pos, first->ki.data_size);
+				for(auto* key = first + 1; (key < last) and (common > 0); ++key)
+				{
+					Py_ssize_t i = 0;
+					Py_ssize_t limit = std::min(common, key->ki.data_size - std::min(pos, key->ki.data_size));
+					while((i < limit) and (key_code_point(key->ki, pos + i) == key_code_point(first->ki, pos + i)))
+						++i;
+					common = i;
+				}
+				depth += common * width;
+			}
+			// digit 0 is the end of the key, so shorter keys come first
+			auto digit = [&](const SortKey& key) -> std::size_t {
+				auto pos = static_cast<Py_ssize_t>(depth / width);
+				if(pos >= key.ki.data_size)
+					return 0;
+				std::size_t shift = 8 * (width - 1 - (depth % width));
+				return 1 + ((key_code_point(key.ki, pos) >> shift) & 0xff);
+			};
+			std::array<std::size_t, 258> counts{};
+			for(auto* pos = first; pos < last; ++pos)
+				++counts[digit(*pos) + 1];
+			for(std::size_t i = 1; i < counts.size(); ++i)
+				counts[i] += counts[i - 1];
+			aux.resize(last - first);
+			auto offsets = counts;
+			for(auto* pos = first; pos < last; ++pos)
+				aux[offsets[digit(*pos)]++] = *pos;
+			std::copy(aux.begin(), aux.end(), first);
+			// the keys in bucket 0 have all ended, so they're equal
+			for(std::size_t d = 1; d < 257; ++d)
+			{
+				if(counts[d + 1] - counts[d] > 1)
+					stack.push_back(Range{first + counts[d], first + counts[d + 1], depth + 1});
+			}
+		}
+	}
+
+	// Items with keys in [start, stop) in key order (see KeyOrder.h).  Null 
+	// bounds are open.
+	PyObject* sorted_items(PyObject* start, PyObject* stop)
+	{
+		SliceKeyInfo start_key;
+		SliceKeyInfo stop_key;
+		if(start and (0 != start_key.init(start, 0, PY_SSIZE_T_MAX)))
+			return nullptr;
+		if(stop and (0 != stop_key.init(stop, 0, PY_SSIZE_T_MAX)))
+			return nullptr;
+		auto in_range = [&](const KeyInfo& ki) {
+			return ((not start) or (compare_keys(ki, start_key.ki) >= 0))
+				and ((not stop) or (compare_keys(ki, stop_key.ki) < 0));
+		};
+		std::vector<SortKey> keys;
+		if(prefix_index_enabled and (0 == ensure_prefix_index()))
+		{
+			// already sorted
+			auto pos = start ? prefix_index->lower_bound(start_key.ki) : prefix_index->begin();
+			for(; pos != prefix_index->end(); ++pos)
+			{
+				KeyInfo ki = pos->key_info();
+				if(not in_range(ki))
+					break;
+				keys.push_back(SortKey{ki, find_existing(ki).second});
+			}
+		}
+		else
+		{
+			if(PyErr_Occurred())
+				return nullptr;
+			keys.reserve(size());
+			// decoded keys of compact dicts
+			std::vector<PythonObject> owners;
+			if(compact_keys)
+				owners.reserve(size());
+			bool failed = visit_nonempty_entries([&](const Entry& ent) {
+				PythonObject owner;
+				auto ki = ent.decoded_key_info(owner);
+				if(not ki)
+					return true;
+				if(in_range(*ki))
+				{
+					keys.push_back(SortKey{*ki, &ent});
+					if(owner)
+						owners.push_back(std::move(owner));
+				}
+				return false;
+			});
+			if(failed)
+				return nullptr;
+			// bytes keys first, then str keys, each sorted separately
+			auto str_keys = std::partition(keys.begin(), keys.end(), [](const SortKey& key) { 
+				return not key_is_str(key.ki); 
+			});
+			bool wide = std::any_of(str_keys, keys.end(), [](const SortKey& key) { 
+				return key.ki.kind > PY_UCS1; 
+			});
+			std::vector<SortKey> aux;
+			radix_sort(keys.data(), keys.data() + (str_keys - keys.begin()), 1, aux);
+			radix_sort(keys.data() + (str_keys - keys.begin()), keys.data() + keys.size(), wide ? 3 : 1, aux);
+		}
+		PythonObject result(PyList_New(keys.size()));
+		if(not result)
+			return nullptr;
+		for(std::size_t i = 0; i < keys.size(); ++i)
+		{
+			assert(keys[i].ent);
+			PyObject* item = item_of(*keys[i].ent);
+			if(not item)
+				return nullptr;
+			PyList_SET_ITEM(result.get(), i, item);
+		}
+		return result.release();
+	}
+
+	int remove(PyObject* key)
+	{
+		const auto [ki, meta_] = key_info_for(key);
+		if(not meta_)
+			return -1;
+		auto [idx, ent] = find_existing(ki);
+		(void)idx;
+		if(not ent)
+		{
+			PyErr_SetObject(PyExc_KeyError, StringDictKey_Unwrap(key));
+			return -1;
+		}
+		assert(not ent->is_empty());
+		return remove_entry(ent);
+	}
+
+	int contains(PyObject* key)
+	{
+		const auto [ki, meta_] = key_info_for(key);
+		if(not meta_)
+			return -1;
+		auto [idx, ent] = find_existing(ki);
+		(void)idx;
+		if(ent)
+			assert(not ent->is_empty());
+		return bool(ent);
+	}
+
+	
+	PyObject* subscript(PyObject* key)
+	{
+		const auto [ki, meta_] = key_info_for(key);
+		if(not meta_)
+			return nullptr;
+		if(default_factory and (not lookup_missing(Py_TYPE(this))))
+			return get_or_insert_default(ki);
+		auto [idx, ent] = find_existing(ki);
+		(void)idx;
+		if(not ent)
+		{
+			if(not StringDict_CheckExact(this))
+				return call_missing(StringDictKey_Unwrap(key));
+			PyErr_SetObject(PyExc_KeyError, StringDictKey_Unwrap(key));
+			return nullptr;
+		}
+		assert(not ent->is_empty());
+		return value_of(*ent);
+	}
+
+	// Returns the '__missing__' attribute of 'type' (borrowed), or nullptr if
+	// it has none.  Lookups are cached by type version tag, which changes 
+	// whenever the type or one of its bases is modified, so a miss doesn't 
+	// walk the MRO every time.
+	static PyObject* lookup_missing(PyTypeObject* type)
+	{
+		struct CacheSlot
+		{
+			PyTypeObject* type = nullptr;
+			unsigned int version_tag = 0;
+			PyObject* method = nullptr;
+		};
+		static std::array<CacheSlot, 64> cache;
+		_Py_IDENTIFIER(__missing__);
+		auto has_version_tag = [&]() { return PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG); };
+		if(has_version_tag())
+		{
+			const CacheSlot& slot = cache[type->tp_version_tag % cache.size()];
+			if((slot.type == type) and (slot.version_tag == type->tp_version_tag))
+				return slot.method;
+		}
+		// _PyType_LookupId() assigns a version tag if the type doesn't have one
+		PyObject* method = _PyType_LookupId(type, &PyId___missing__);
+		if(has_version_tag())
+		{
+			CacheSlot& slot = cache[type->tp_version_tag % cache.size()];
+			Py_XINCREF(method);
+			Py_XSETREF(slot.method, method);
+			slot.type = type;
+			slot.version_tag = type->tp_version_tag;
+		}
+		return method;
+	}
+
+	// Call the '__missing__()' method of a subtype, or raise KeyError.
+	PyObject* call_missing(PyObject* key)
+	{
+		PyObject* method = lookup_missing(Py_TYPE(this));
+		if(not method)
+		{
+			PyErr_SetObject(PyExc_KeyError, StringDictKey_Unwrap(key));
+			return nullptr;
+		}
+		// the cache may drop its reference while the method runs
+		Py_INCREF(method);
+		PythonObject method_ref(method);
+		PyObject* self = static_cast<PyObject*>(this);
+		// call plain functions unbound, like the interpreter does for methods
+		if(PyFunction_Check(method))
+			return PyObject_CallFunctionObjArgs(method, self, key, nullptr);
+		if(auto descr_get = Py_TYPE(method)->tp_descr_get; descr_get)
+		{
+			PythonObject bound(descr_get(method, self, reinterpret_cast<PyObject*>(Py_TYPE(this))));
+			if(not bound)
+				return nullptr;
+			return PyObject_CallFunctionObjArgs(bound.get(), key, nullptr);
+		}
+		return PyObject_CallFunctionObjArgs(method, key, nullptr);
+	}
+
+	// strdefaultdict lookup: returns the value of 'ki', first inserting 
+	// default_factory() if it's missing.  default_factory() (or unboxing 
+	// its result) can run arbitrary code, so the insertion slot found by 
+	// the lookup is only reused if the generation hasn't changed.
+	PyObject* get_or_insert_default(const KeyInfo& ki)
+	{
+		assert(default_factory);
+		auto [idx, ent] = find_insertion(ki);
+		if(ent and (not ent->is_empty()))
+			return value_of(*ent);
+		const std::uint64_t probed_generation = generation;
+		PythonObject value(PyObject_CallObject(default_factory.get(), nullptr));
+		if(not value)
+			return nullptr;
+		UnboxedValue unboxed_value;
+		const UnboxedValue* unboxed = unbox_for_insertion(value.get(), &unboxed_value);
+		if(is_typed() and (not unboxed))
+			return nullptr;
+		Entry* result;
+		if(generation != probed_generation)
+			result = insert(ki, value.get(), false, unboxed);
+		else if(not ent)
+			result = add_entry(ki, idx, value.get(), unboxed);
+		else
+			result = assign_entry(ki, ent, value.get(), unboxed);
+		if(not result)
+			return nullptr;
+		return value_of(*result);
+	}
+
+	PyObject* get_default_factory() const
+	{
+		PyObject* factory = default_factory ? default_factory.get() : Py_None;
+		Py_INCREF(factory);
+		return factory;
+	}
+
+	int set_default_factory(PyObject* factory)
+	{
+		if((factory != Py_None) and (not PyCallable_Check(factory)))
+		{
+			PyErr_SetString(PyExc_TypeError, "strdefaultdict default_factory must be callable or None.");
+			return -1;
+		}
+		if(factory == Py_None)
+		{
+			default_factory.reset();
+			return 0;
+		}
+		Py_INCREF(factory);
+		default_factory = PythonObject(factory);
+		return 0;
+	}
+
+	// strdefaultdict's default_factory, null for None and for plain strdicts.
+	PythonObject default_factory;
+	
+	bool contains_entry_key(Entry& ent)
+	{
+		assert(not ent.is_empty());
+		auto ki = ent.as_key_info();
+		auto [idx, my_ent] = find_existing(ki);
+		(void)idx;
+		return bool(my_ent);
+	}
+
+	int contains_entry(const StringDict& other, Entry& other_ent)
+	{
+		assert(not other_ent.is_empty());
+		PythonObject owner;
+		auto ki = key_info_from(other, other_ent, owner);
+		if(not ki)
+			return -1;
+		auto [idx, ent] = find_existing(*ki);
+		(void)idx;
+		if(not ent)
+			return false;
+		if(not (is_typed() or other.is_typed()))
+			return PyObject_RichCompareBool(ent->get_value(), other_ent.get_value(), Py_EQ);
+		PythonObject value(value_of(*ent));
+		if(not value)
+			return -1;
+		PythonObject other_value(other.value_of(other_ent));
+		if(not other_value)
+			return -1;
+		return PyObject_RichCompareBool(value, other_value, Py_EQ);
+	}
+	
+	int operator==(StringDict& other)
+	{
+		if(size() != other.size())
+			return false;
+		
+		// we're going to iterate through the StringDict that has fewer entry slots.  This means
+		// less time spent skipping over empty entries and m
+		StringDict& iter_dict =  (entry_slot_count() <= other.entry_slot_count()) ? *this : other;
+		StringDict& other_dict = (entry_slot_count() <= other.entry_slot_count()) ? other : *this;
+		// once this hits zero, we'll break out of the loop 
+		Py_ssize_t nonempty_count = iter_dict.size();
+		for(Entry& ent: iter_dict.entries)
+		{
+			if(not ent.is_empty()) 
+			{
+				int has_ent = other_dict.contains_entry(iter_dict, ent);
+				if(has_ent < 0) // error
+					return has_ent;
+				else if(not has_ent) // iter_dict has key that other_dict doesn't
+					return false;
+				
+				assert(nonempty_count > 0);
+				--nonempty_count;
+				if(nonempty_count == 0)
+				{
+					// assert that the rest of the entries are empty
+					assert(std::all_of(
+						iter_dict.entries.begin() + (&ent - iter_dict.entries.data()) + 1,
+						iter_dict.entries.end(),
+						std::mem_fn(&Entry::is_empty)
+					));
+					break;
+				}
+			}
+		}
+		return true;
+	}
+	
+	int operator!=(StringDict& other)
+	{
+		int eq = (*this) == other;
+		if(eq < 0)
+			return eq;
+		else 
+			return not eq;
+	}
+
+	int equals_dict(PyObject* dict)
+	{
+		assert(PyDict_Check(dict));
+		if(PyDict_Size(dict) != static_cast<Py_ssize_t>(size()))
+			return false;
+		
+		// iterate over the dict()
+		Py_ssize_t pos = 0;
+		PyObject* key = nullptr;
+		PyObject* value = nullptr;
+		
+		while(PyDict_Next(dict, &pos, &key, &value))
+		{
+			const auto [ki, meta_] = key_info_for(key);
+			if(not meta_)
+				return -1;
+			auto [idx, ent] = find_existing(ki);
+			(void)idx;
+			if(not ent)
+				return false;
+			assert(not ent->is_empty());
+			PythonObject strdict_value(value_of(*ent));
+			if(not strdict_value)
+				return -1;
+			if(int cmp = PyObject_RichCompareBool(value, strdict_value, Py_EQ); cmp == -1)
+				return -1;
+			else if(not cmp)
+				return false;
+		}
+		return true;
+	}
+
+	int make_copy(StringDict& other)
+	{
+		assert(other.size() == 0);
+		assert(other.is_small());
+		assert(other.entries.size() == 0);
+		try
+		{
+			other.entries.reserve(this->entries.size());
+			other.offsets = this->offsets;
+			other.value_type = this->value_type;
+			other.key_width = this->key_width;
+			other.compact_keys = this->compact_keys;
+			other.unboxed_values = this->unboxed_values;
+			for(Entry& ent: this->entries)
+			{
+				auto opt_ent = ent.make_copy();
+				if(not opt_ent.has_value())
+					throw std::runtime_error("Attempt to make copy strdict entry failed while copying strdict instance.");
+				other.entries.push_back(std::move(*opt_ent));
+				if((not is_typed()) and (not ent.is_empty()))
+					other.track_value(ent.get_value());
+			}
+			other.mask = this->mask;
+			other.occupied = this->occupied;
+			++other.generation;
+			other.on_value_changed();
+			if(prefix_index_enabled)
+				return other.enable_prefix_index();
+			return 0;
+		}
+		catch(const std::bad_alloc& e)
+		{
+			PyErr_SetString(PyExc_MemoryError, "Allocation failed while copying strdict instance.");
+			return -1;
+		}
+		catch(const std::exception& e)
+		{
+			PyErr_SetString(PyExc_RuntimeError, e.what());
+			return -1;
+		}
+	}
+
+	template <class GetItem>
+	PyObject* make_itemlist(GetItem get_item)
+	{
+		PythonObject itemlist(PyList_New(size()));
+		if(not itemlist)
+			return nullptr;
+		
+		auto list_size = static_cast<Py_ssize_t>(size());
+		PyObject** list_items = PySequence_Fast_ITEMS(itemlist);
+		[[maybe_unused]]
+		PyObject** list_items_stop = list_items + list_size;
+		auto visit_ent = [&](const Entry& ent) {
+			assert(not ent.is_empty());
+			assert(list_items < list_items_stop);
+			*list_items = get_item(ent);
+			if(not *list_items++)
+			{
+				itemlist.reset();
+				return true;
+			}
+			else 
+				return false;
+		};
+		if(visit_nonempty_entries(visit_ent))
+			assert(not itemlist);
+		else
+			assert(itemlist);
+		return itemlist.release();
+	}
+	
+	PyObject* get_values()
+	{
+		return make_itemlist([&](const Entry& ent) { return value_of(ent); });
+	}
+
+	PyObject* get_keys()
+	{
+		return make_itemlist([&](const Entry& ent) { return key_of(ent); });
+	}
+	
+	PyObject* get_items()
+	{
+		return make_itemlist([&](const Entry& ent) { return item_of(ent); });
+	}
+
+	// Header of the key dump written by dump_keys().  It's followed by one
+	// record per entry:
+	// 	- the hash of the key (8 bytes)
+	// 	- 1 byte DataKind
+	// 	- unsigned LEB128 length of the key (in code units)
+	// 	- the key data
+	struct KeyDumpHeader
+	{
+		char magic[4];
+		std::uint32_t byte_order;
+		std::uint32_t hash_width;
+		std::uint32_t reserved;
+		// Hash of a fixed string.  If it doesn't match in the loading process
+		// (different hash seed or algorithm) the stored hashes are discarded.
+		std::int64_t hash_fingerprint;
+		std::uint64_t count;
+	};
+
+	static constexpr const char key_dump_magic[4] = {'S', 'D', 'K', '\x01'};
+	static constexpr const std::uint32_t key_dump_byte_order = 0x01020304u;
+
+	static std::int64_t key_dump_fingerprint()
+	{
+		return _Py_HashBytes("strdict", 7);
+	}
+
+	// Dump the kinds, data and hashes of all of the keys, in the same order 
+	// as get_values().
+	PyObject* dump_keys()
+	{
+		std::size_t total = sizeof(KeyDumpHeader);
+		visit_all_nonempty_entries([&](const Entry& ent) {
+			Py_ssize_t len = ent.key_length();
+			total += sizeof(std::int64_t) + 1 + leb128_encode(len).len 
+				+ len * DataKind_ItemSize(ent.key_kind());
+		});
+		PythonObject blob(PyBytes_FromStringAndSize(nullptr, total));
+		if(not blob)
+			return nullptr;
+		auto* pos = reinterpret_cast<unsigned char*>(PyBytes_AS_STRING(blob.get()));
+		KeyDumpHeader header{};
+		std::memcpy(header.magic, key_dump_magic, sizeof(header.magic));
+		header.byte_order = key_dump_byte_order;
+		header.hash_width = sizeof(Py_hash_t);
+		header.hash_fingerprint = key_dump_fingerprint();
+		header.count = size();
+		std::memcpy(pos, &header, sizeof(header));
+		pos += sizeof(header);
+		bool failed = visit_nonempty_entries([&](const Entry& ent) {
+			PythonObject owner;
+			auto decoded = ent.decoded_key_info(owner);
+			if(not decoded)
+				return true;
+			const KeyInfo& ki = *decoded;
+			std::int64_t hash = ki.hash;
+			std::memcpy(pos, &hash, sizeof(hash));
+			pos += sizeof(hash);
+			*pos++ = static_cast<unsigned char>(ki.kind);
+			Leb128Encoding enc = leb128_encode(ki.data_size);
+			std::memcpy(pos, enc.encoding, enc.len);
+			pos += enc.len;
+			std::size_t data_bytes = ki.data_size * DataKind_ItemSize(ki.kind);
+			std::memcpy(pos, ki.data, data_bytes);
+			pos += data_bytes;
+			return false;
+		});
+		if(failed)
+			return nullptr;
+		assert(pos == reinterpret_cast<unsigned char*>(PyBytes_AS_STRING(blob.get())) + total);
+		return blob.release();
+	}
+
+	// The values of a typed dict as raw bytes, in the same order as 
+	// get_values().
+	PyObject* dump_values()
+	{
+		assert(is_typed());
+		compact();
+		return PyBytes_FromStringAndSize(reinterpret_cast<const char*>(unboxed_values.data()), 
+			unboxed_values.size() * sizeof(UnboxedValue));
+	}
+
+	// Replace the contents of the dict with the keys from a dump_keys() blob
+	// and the corresponding values.  The keys in a dump are unique, so they 
+	// are inserted without comparing them to each other, and without 
+	// rehashing them if the dump came from a process with the same hash seed.
+	//
+	// For typed dicts, 'values' is a dump_values() blob instead of a sequence.
+	int load_keys(PyObject* blob, PyObject* values, ValueType type = ValueType::object, Py_ssize_t width = 0, bool compact = false)
+	{
+		if(not check_resizable())
+			return -1;
+		// clear first; no python code can run after this point.
+		clear();
+		value_type = type;
+		key_width = width;
+		compact_keys = compact and (not prefix_index_enabled);
+		Py_buffer view;
+		if(0 != PyObject_GetBuffer(blob, &view, PyBUF_SIMPLE))
+			return -1;
+		auto view_guard = make_scope_guard([&](){ PyBuffer_Release(&view); });
+		Py_buffer values_view;
+		PythonObject values_seq;
+		if(is_typed())
+		{
+			if(0 != PyObject_GetBuffer(values, &values_view, PyBUF_SIMPLE))
+				return -1;
+		}
+		else
+		{
+			values_seq = PythonObject(PySequence_Fast(values, "strdict state values must be a sequence."));
+			if(not values_seq)
+				return -1;
+		}
+		auto values_guard = make_scope_guard([&](){ 
+			if(is_typed())
+				PyBuffer_Release(&values_view); 
+		});
+
+		auto invalid = [&](const char* msg) {
+			clear();
+			PyErr_SetString(PyExc_ValueError, msg);
+			return -1;
+		};
+		const auto* pos = static_cast<const unsigned char*>(view.buf);
+		const auto* end = pos + view.len;
+		KeyDumpHeader header;
+		if(view.len < static_cast<Py_ssize_t>(sizeof(header)))
+			return invalid("Truncated strdict key dump.");
+		std::memcpy(&header, pos, sizeof(header));
+		pos += sizeof(header);
+		if(0 != std::memcmp(header.magic, key_dump_magic, sizeof(header.magic)))
+			return invalid("Invalid strdict key dump.");
+		if((header.byte_order != key_dump_byte_order) or (header.hash_width != sizeof(Py_hash_t)))
+			return invalid("strdict key dump was written on an incompatible platform.");
+		Py_ssize_t count;
+		if(is_typed())
+		{
+			if(values_view.len % sizeof(UnboxedValue))
+				return invalid("strdict state values have an invalid size.");
+			count = values_view.len / sizeof(UnboxedValue);
+		}
+		else
+		{
+			count = PySequence_Fast_GET_SIZE(values_seq.get());
+		}
+		if(header.count != static_cast<std::uint64_t>(count))
+			return invalid("strdict key dump does not match the number of values.");
+		bool rehash = (header.hash_fingerprint != key_dump_fingerprint());
+		if(0 != reserve_space(count))
+			return -1;
+
+		PyObject** value_items = is_typed() ? nullptr : PySequence_Fast_ITEMS(values_seq.get());
+		for(Py_ssize_t i = 0; i < count; ++i)
+		{
+			KeyInfo ki;
+			std::int64_t hash;
+			if(end - pos < static_cast<Py_ssize_t>(sizeof(hash) + 1))
+				return invalid("Truncated strdict key dump.");
+			std::memcpy(&hash, pos, sizeof(hash));
+			pos += sizeof(hash);
+			if(*pos > PY_UCS4)
+				return invalid("Invalid key kind in strdict key dump.");
+			ki.kind = static_cast<DataKind>(*pos++);
+			std::size_t len_bytes = 0;
+			std::uint64_t len = leb128_decode_bounded(pos, end, &len_bytes);
+			pos += len_bytes;
+			if((not len_bytes) or (len > static_cast<std::uint64_t>(end - pos) / DataKind_ItemSize(ki.kind)))
+				return invalid("Truncated strdict key dump.");
+			ki.key = nullptr;
+			ki.data = pos;
+			ki.data_size = len;
+			ki.hash = rehash ? DataKind_Hash(ki.kind, ki.data, ki.data_size) : hash;
+			pos += len * DataKind_ItemSize(ki.kind);
+			// the state may not come from __getstate__(), so the keys are 
+			// checked for duplicates.  The dict is fresh, so there are no 
+			// removed entries to reuse.
+			auto [idx, existing] = find_insertion(ki);
+			if(existing)
+				return invalid("strdict key dump has duplicate keys.");
+			Entry* ent;
+			if(is_typed())
+			{
+				UnboxedValue unboxed;
+				std::memcpy(&unboxed, static_cast<const char*>(values_view.buf) + i * sizeof(unboxed), sizeof(unboxed));
+				ent = add_entry(ki, idx, Py_None, &unboxed);
+			}
+			else
+			{
+				ent = add_entry(ki, idx, value_items[i]);
+			}
+			if(not ent)
+			{
+				clear();
+				return -1;
+			}
+		}
+		if(pos != end)
+			return invalid("Trailing data in strdict key dump.");
+		return 0;
+	}
+
+	// Write the dict with one of the MappedStringDict_Save*() functions.
+	template <class SaveFunc>
+	int save_mapped(PyObject* name, SaveFunc save_func)
+	{
+		std::vector<KeyInfo> keys;
+		std::vector<PyObject*> values;
+		// boxed values of typed dicts
+		std::vector<PythonObject> boxed;
+		// decoded keys of compact dicts
+		std::vector<PythonObject> owners;
+		try
+		{
+			keys.reserve(size());
+			values.reserve(size());
+			if(is_typed())
+				boxed.reserve(size());
+			if(compact_keys)
+				owners.reserve(size());
+		}
+		catch(const std::bad_alloc&)
+		{
+			PyErr_SetString(PyExc_MemoryError, "Allocation failed while saving strdict instance.");
+			return -1;
+		}
+		// Serializing only touches str, bytes and number values, so no python 
+		// code can run and invalidate the borrowed references.
+		bool failed = visit_nonempty_entries([&](const Entry& ent) {
+			PythonObject owner;
+			auto ki = ent.decoded_key_info(owner);
+			if(not ki)
+				return true;
+			keys.push_back(*ki);
+			if(owner)
+				owners.push_back(std::move(owner));
+			if(not is_typed())
+			{
+				values.push_back(ent.get_value());
+				return false;
+			}
+			boxed.emplace_back(value_of(ent));
+			values.push_back(boxed.back().get());
+			return not values.back();
+		});
+		if(failed)
+			return -1;
+		return save_func(name, keys.data(), values.data(), keys.size());
+	}
+
+	int save(PyObject* path)
+	{
+		return save_mapped(path, MappedStringDict_Save);
+	}
+
+	int save_shared(PyObject* name)
+	{
+		return save_mapped(name, MappedStringDict_SaveShared);
+	}
+	
+	// Stop tracking an exact strdict if none of its values can be part of a
+	// reference cycle.
+	void maybe_untrack()
+	{
+		if((not StringDict_CheckExact(this)) or (not PyObject_GC_IsTracked(this)))
+			return;
+		bool may_have_cycles = false;
+		if(not is_typed())
+		{
+			visit_nonempty_entries([&](const Entry& ent) {
+				may_have_cycles = gc_may_be_tracked(ent.get_value());
+				return may_have_cycles;
+			});
+		}
+		if(not may_have_cycles)
+			PyObject_GC_UnTrack(this);
+	}
+
+	int gc_traverse(visitproc visit, void* arg)
+	{
+		int result = 0;
+		Py_VISIT(default_factory.get());
+		// typed dicts only hold None
+		if(is_typed())
+			return 0;
+
+		// Wrap the Py_VISIT() macro, which conditionally returns an int.
+		// Specifically, make it return a std::optional<int>.
+		auto py_visit_wrap = [&](PyObject* obj) -> std::optional<int>{
+			Py_VISIT(obj);
+			return std::nullopt;
+		};
+
+		// Visit all entries in the strdict.  Note that this lambda may mutate 'result'
+		auto visit_entry = [&](const auto& ent) {
+			assert(not ent.is_empty());
+			auto visit_result = py_visit_wrap(ent.get_value());
+			if(visit_result.has_value())
+			{
+				result = *visit_result;
+				return true;
+			}
+			return false;
+		};
+		visit_nonempty_entries(visit_entry);
+		return result;
+	}
+	
+	// Export the values of a typed dict, contiguous and in insertion order.
+	int get_buffer(Py_buffer* view, int flags)
+	{
+		if(not is_typed())
+		{
+			PyErr_SetString(PyExc_BufferError, "Only strdict instances with an 'i8' or 'f8' value_type support the buffer protocol.");
+			return -1;
+		}
+		if(exports == 0)
+			compact();
+		assert(unboxed_values.size() == size());
+		static UnboxedValue empty_values[1] = {};
+		void* buf = size() ? unboxed_values.data() : empty_values;
+		if(0 != PyBuffer_FillInfo(view, this, buf, size() * sizeof(UnboxedValue), 0, flags))
+			return -1;
+		view->itemsize = sizeof(UnboxedValue);
+		if(flags & PyBUF_FORMAT)
+			view->format = const_cast<char*>((value_type == ValueType::int64) ? "q" : "d");
+		if(flags & PyBUF_ND)
+		{
+			view->ndim = 1;
+			export_shape = size();
+			view->shape = &export_shape;
+		}
+		if((flags & PyBUF_STRIDES) == PyBUF_STRIDES)
+			view->strides = &export_stride;
+		++exports;
+		return 0;
+	}
+
+	// The values may have been written through the buffer.
+	void release_buffer()
+	{
+		assert(exports > 0);
+		--exports;
+		on_value_changed();
+	}
+	
+	friend class StringDictIter;
+};
+
+// strdict.chain: lookups over a sequence of strdicts, first match wins, like
+// collections.ChainMap.  The key is inspected and hashed once per lookup, and
+// the map and entry index each key was found in are memoized until any of
+// the maps changes its generation.
+struct StringDictChain:
+	public PyObject
+{
+	// Entries are memoized by index rather than by pointer, since a map's
+	// entries vector may be reallocated.
+	struct MemoSlot
+	{
+		Py_ssize_t map_index = -1;
+		Py_ssize_t entry_index = -1;
+	};
+
+	struct Memo
+	{
+		static constexpr const std::size_t size = 64;
+		std::array<MemoSlot, size> slots;
+		// get_generation() of each map when the slots were filled
+		std::vector<std::uint64_t> generations;
+	};
+
+	// tuple of the chained strdicts
+	PyObject* maps;
+	Memo memo;
+
+	Py_ssize_t map_count() const
+	{ return PyTuple_GET_SIZE(maps); }
+
+	StringDict* map_at(Py_ssize_t i) const
+	{ return static_cast<StringDict*>(PyTuple_GET_ITEM(maps, i)); }
+
+	// Drop the memo if any of the maps changed since it was filled.
+	void check_memo()
+	{
+		bool valid = true;
+		for(Py_ssize_t i = 0; i < map_count(); ++i)
+		{
+			if(memo.generations[i] != map_at(i)->get_generation())
+			{
+				memo.generations[i] = map_at(i)->get_generation();
+				valid = false;
+			}
+		}
+		if(not valid)
+			memo.slots.fill(MemoSlot{});
+	}
+
+	// The first map that has 'ki', and its entry for it.
+	std::pair<StringDict*, Entry*> find(const KeyInfo& ki)
+	{
+		check_memo();
+		MemoSlot& slot = memo.slots[static_cast<std::size_t>(ki.hash) % Memo::size];
+		if(slot.map_index >= 0)
+		{
+			StringDict* dict = map_at(slot.map_index);
+			if(slot.entry_index < static_cast<Py_ssize_t>(dict->entry_slot_count()))
+			{
+				Entry& ent = dict->entry_from_index(slot.entry_index);
+				if(ent.matches(ki))
+					return std::make_pair(dict, &ent);
+			}
+		}
+		for(Py_ssize_t i = 0; i < map_count(); ++i)
+		{
+			if(Entry* ent = map_at(i)->find_existing(ki).second; ent)
+			{
+				slot = MemoSlot{i, map_at(i)->index_of(*ent)};
+				return std::make_pair(map_at(i), ent);
+			}
+		}
+		return std::make_pair(nullptr, nullptr);
+	}
+
+	// Value of 'key' in the first map that has it.  Returns null without 
+	// an exception set if none of them has it.
+	PyObject* lookup(PyObject* key)
+	{
+		const auto [ki, meta_] = make_key_info(key);
+		if(not meta_)
+			return nullptr;
+		auto [dict, ent] = find(ki);
+		if(not ent)
+			return nullptr;
+		return dict->value_of(*ent);
+	}
+
+	// Visit each distinct key once, with the map it resolves to: the keys of 
+	// the first map, then the keys of each later map that aren't in an 
+	// earlier one.  'visit' returns true to stop.  Returns -1 on error.
+	template <class Visitor>
+	int visit_keys(Visitor visit)
+	{
+		for(Py_ssize_t i = 0; i < map_count(); ++i)
+		{
+			StringDict* dict = map_at(i);
+			int err = 0;
+			dict->visit_nonempty_entries([&](const Entry& ent) {
+				for(Py_ssize_t j = 0; j < i; ++j)
+				{
+					PythonObject owner;
+					auto ki = map_at(j)->key_info_from(*dict, ent, owner);
+					if(not ki)
+					{
+						err = -1;
+						return true;
+					}
+					if(map_at(j)->find_existing(*ki).second)
+						return false;
+				}
+				if(visit(*dict, ent))
+				{
+					err = PyErr_Occurred() ? -1 : 1;
+					return true;
+				}
+				return false;
+			});
+			if(err)
+				return (err < 0) ? -1 : 0;
+		}
+		return 0;
+	}
+
+	template <class GetItem>
+	PyObject* make_itemlist(GetItem get_item)
+	{
+		PythonObject result(PyList_New(0));
+		if(not result)
+			return nullptr;
+		int err = visit_keys([&](StringDict& dict, const Entry& ent) {
+			PythonObject item(get_item(dict, ent));
+			return (not item) or (0 != PyList_Append(result.get(), item.get()));
+		});
+		if(err < 0)
+			return nullptr;
+		return result.release();
+	}
+};
+
+extern "C" {
+
+extern PyTypeObject StringDict_Type;
+extern PyTypeObject StringDefaultDict_Type;
+static PyObject* StringDict_GetType();
+extern PyTypeObject StringDictSlot_Type;
+static PyObject* strdict_slot_new(StringDict* dict, PyObject* key);
+
+bool StringDict_CheckExact(PyObject* self)
+{ return Py_TYPE(self) == &StringDict_Type; }
+
+// Checks the type directly rather than calling PyObject_IsInstance(), which 
+// is relatively expensive and is on the path of every method call.
+bool StringDict_Check(PyObject* self)
+{ return StringDict_CheckExact(self) or PyType_IsSubtype(Py_TYPE(self), &StringDict_Type); }
+
+
+static bool StringDict_CheckErr(PyObject* self)
+{
+	if(not StringDict_Check(self))
+	{
+		PyErr_SetObject(PyExc_TypeError, self);
+		return false;
+	}
+	else
+	{
+		return true;
+	}
+	
+}
+
+static StringDict* to_string_dict(PyObject* self)
+{
+	if(not StringDict_CheckErr(self))
+		return nullptr;
+	return static_cast<StringDict*>(self);
+}
+
+static std::tuple<StringDict*, PyObject*, PyObject*> dictmethod_2args(const char* name, PyObject* self, PyObject* const* args, Py_ssize_t nargs, bool none_is_default = true)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return {nullptr, nullptr, nullptr};
+	if((nargs < 1) or (nargs > 2))
+	{
+		PyErr_Format(PyExc_TypeError, "%s expected 1 or 2 arguments, got %zd.", name, nargs);
+		return {nullptr, nullptr, nullptr};
+	}
+	PyObject* default_value_ = (nargs > 1) ? args[1] : nullptr;
+	if((not default_value_) and (none_is_default))
+		default_value_ = Py_None;
+	return std::make_tuple(dict, args[0], default_value_);
+}
+
+// Unpack the arguments of a METH_FASTCALL | METH_KEYWORDS method into 
+// 'parsed', which has one slot for each name in the null-terminated 'kwlist'.
+// Slots of arguments that weren't given are set to null.  The first 
+// 'required' arguments must be given.
+static int strdict_unpack_args(const char* name, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames, 
+	const char* const* kwlist, Py_ssize_t required, PyObject** parsed)
+{
+	Py_ssize_t count = 0;
+	while(kwlist[count])
+		++count;
+	if(nargs > count)
+	{
+		PyErr_Format(PyExc_TypeError, "%s() takes at most %zd positional arguments (%zd given).", name, count, nargs);
+		return -1;
+	}
+	std::fill(parsed, parsed + count, nullptr);
+	std::copy(args, args + nargs, parsed);
+	Py_ssize_t nkwargs = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+	for(Py_ssize_t i = 0; i < nkwargs; ++i)
+	{
+		PyObject* kwname = PyTuple_GET_ITEM(kwnames, i);
+		auto pos = std::find_if(kwlist, kwlist + count, [&](const char* argname) {
+			return PyUnicode_CompareWithASCIIString(kwname, argname) == 0;
+		});
+		if(pos == kwlist + count)
+		{
+			PyErr_Format(PyExc_TypeError, "%s() got an unexpected keyword argument '%U'.", name, kwname);
+			return -1;
+		}
+		if(parsed[pos - kwlist])
+		{
+			PyErr_Format(PyExc_TypeError, "%s() got multiple values for argument '%s'.", name, *pos);
+			return -1;
+		}
+		parsed[pos - kwlist] = args[nargs + i];
+	}
+	for(Py_ssize_t i = 0; i < required; ++i)
+	{
+		if(not parsed[i])
+		{
+			PyErr_Format(PyExc_TypeError, "%s() missing required argument '%s'.", name, kwlist[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+
+static int strdict_contains(PyObject* self, PyObject* key)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return -1;
+	return dict->contains(key);
+}
+
+static PyObject* strdict___contains__(PyObject* self, PyObject* key)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	int cont = dict->contains(key);
+	switch(cont)
+	{
+	case 0:
+		Py_RETURN_FALSE;
+		break;
+	case 1:
+		Py_RETURN_TRUE;
+		break;
+	default:
+		assert(cont < 0);
+		return nullptr;
+	}
+	assert(false);
+}
+
+
+static Py_ssize_t strdict_length(PyObject* self)
+{
+	const auto* dict = to_string_dict(self);
+	if(not dict)
+		return -1;
+	return dict->size();
+}
+
+static PyObject* strdict_repr(PyObject* self)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->repr();
+}
+
+static PyObject* strdict_keys(PyObject* self)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->get_keys();
+}
+
+static PyObject* strdict_values(PyObject* self)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->get_values();
+}
+
+static PyObject* strdict_items(PyObject* self)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->get_items();
+}
+
+static PyObject* strdict_subscript(PyObject* self, PyObject* key)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->subscript(key);
+}
+
+static int strdict_assign_subscript(PyObject* self, PyObject* key, PyObject* value)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return -1;
+	else if(not value)
+		return dict->remove(key);
+	else
+		return dict->assign(key, value);
+}
+
+static PyObject* strdict_update(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	if(nargs > 1)
+	{
+		PyErr_SetString(PyExc_TypeError, "strdict.update() takes at most 1 positional argument.");
+		return nullptr;
+	}
+	else if(nargs == 1)
+	{
+		if(0 != dict->update_from_object(args[0]))
+			return nullptr;
+	}
+	
+	Py_ssize_t nkwargs = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+	for(Py_ssize_t i = 0; i < nkwargs; ++i)
+	{
+		if(0 != dict->assign(PyTuple_GET_ITEM(kwnames, i), args[nargs + i]))
+			return nullptr;
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+strdict_richcompare(PyObject *left, PyObject *right, int op)
+{
+	if((op != Py_EQ) and (op != Py_NE))
+		Py_RETURN_NOTIMPLEMENTED;
+	
+	bool left_is_strdict = StringDict_Check(left);
+	bool right_is_strdict = StringDict_Check(right);
+	if(left_is_strdict and right_is_strdict)
+	{
+		// both strdicts
+		StringDict& left_dict = *static_cast<StringDict*>(left);
+		StringDict& right_dict = *static_cast<StringDict*>(right);
+		int cmp = 0;
+
+		assert(op == Py_EQ or op == Py_NE);
+		// compare and check if an error occurred 
+		cmp = (left_dict == right_dict);
+		if(cmp < 0)
+			return nullptr;
+		// invert the result if != was requested
+		if(op == Py_NE)
+			cmp = not cmp;
+		if(cmp)
+			Py_RETURN_TRUE;
+		else 
+			Py_RETURN_FALSE;
+	}
+	else
+	{
+		// only other allowable case is that one is a strdict() and the other is a dict()
+		StringDict* strdict = nullptr;
+		PyObject* dict = nullptr;
+		if(left_is_strdict)
+		{
+			if(not PyDict_Check(right))
+				Py_RETURN_NOTIMPLEMENTED;
+			strdict = static_cast<StringDict*>(left);
+			dict = right;
+		}
+		else if(right_is_strdict)
+		{
+			if(not PyDict_Check(left))
+				Py_RETURN_NOTIMPLEMENTED;
+			strdict = static_cast<StringDict*>(right);
+			dict = left;
+		}
+		else
+		{
+			Py_RETURN_NOTIMPLEMENTED;
+		}
+		int cmp = strdict->equals_dict(dict);
+		if(cmp < 0)
+			return nullptr;
+		// invert the result if != was requested
+		if(op == Py_NE)
+			cmp = not cmp;
+		if(cmp)
+			Py_RETURN_TRUE;
+		else 
+			Py_RETURN_FALSE;
+	}
+}
+
+static PyObject* strdict_sizeof(PyObject* self)
+{
+	const auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return PyLong_FromSsize_t(Py_ssize_t(sizeof(*dict)));
+}
+
+
+
+
+
+
+static PyObject* strdict_get(PyObject* self, PyObject* const* args, Py_ssize_t nargs)
+{
+	auto [dict, key, default_value] = dictmethod_2args("get", self, args, nargs);
+	if(not dict)
+		return nullptr;
+	assert(key);
+	assert(default_value);
+	return dict->getdefault(key, default_value);
+}
+
+static PyObject* strdict_setdefault(PyObject* self, PyObject* const* args, Py_ssize_t nargs)
+{
+	auto [dict, key, default_value] = dictmethod_2args("setdefault", self, args, nargs);
+	if(not dict)
+		return nullptr;
+	assert(key);
+	assert(default_value);
+	return dict->set(key, default_value, true);
+}
+
+static PyObject* strdict_increment(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	static const char* const kwlist[] = {"key", "delta", nullptr};
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* parsed[2];
+	if(0 != strdict_unpack_args("increment", args, nargs, kwnames, kwlist, 1, parsed))
+		return nullptr;
+	auto [key, delta] = parsed;
+	if(delta)
+		return dict->increment(key, delta);
+	PythonObject one(PyLong_FromLong(1));
+	if(not one)
+		return nullptr;
+	return dict->increment(key, one.get());
+}
+
+static PyObject* strdict_count(PyObject* self, PyObject* iterable)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	if(0 != dict->count(iterable))
+		return nullptr;
+	Py_RETURN_NONE;
+}
+
+static PyObject* strdict_from_buffer(PyObject* cls, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	static const char* const kwlist[] = {"data", "line_sep", "kv_sep", "value_parser", "decode_keys", "value_type", nullptr};
+	PyObject* parsed[6];
+	if(0 != strdict_unpack_args("from_buffer", args, nargs, kwnames, kwlist, 1, parsed))
+		return nullptr;
+	Py_buffer data = {};
+	Py_buffer line_sep = {};
+	Py_buffer kv_sep = {};
+	auto buffer_guard = make_scope_guard([&](){ 
+		for(Py_buffer* buff: {&data, &line_sep, &kv_sep})
+		{
+			if(buff->obj)
+				PyBuffer_Release(buff);
+		}
+	});
+	if(0 != PyObject_GetBuffer(parsed[0], &data, PyBUF_SIMPLE))
+		return nullptr;
+	if(parsed[1] and (0 != PyObject_GetBuffer(parsed[1], &line_sep, PyBUF_SIMPLE)))
+		return nullptr;
+	if(parsed[2] and (0 != PyObject_GetBuffer(parsed[2], &kv_sep, PyBUF_SIMPLE)))
+		return nullptr;
+	PyObject* value_parser = parsed[3] ? parsed[3] : Py_None;
+	int decode_keys = parsed[4] ? PyObject_IsTrue(parsed[4]) : 0;
+	if(decode_keys < 0)
+		return nullptr;
+	PyObject* value_type = parsed[5] ? parsed[5] : Py_None;
+	auto as_string_view = [](const Py_buffer& buff, std::string_view default_value) {
+		if(not buff.obj)
+			return default_value;
+		return std::string_view(static_cast<const char*>(buff.buf), buff.len);
+	};
+	std::string_view line_sep_view = as_string_view(line_sep, "\n");
+	std::string_view kv_sep_view = as_string_view(kv_sep, "\t");
+	if(line_sep_view.empty() or kv_sep_view.empty())
+	{
+		PyErr_SetString(PyExc_ValueError, "strdict.from_buffer() separators must not be empty.");
+		return nullptr;
+	}
+	if((value_parser != Py_None) and (not PyCallable_Check(value_parser)))
+	{
+		PyErr_SetString(PyExc_TypeError, "strdict.from_buffer() value_parser must be callable or None.");
+		return nullptr;
+	}
+
+	PythonObject ctor_args(PyTuple_New(0));
+	if(not ctor_args)
+		return nullptr;
+	PythonObject ctor_kwargs;
+	if(value_type != Py_None)
+	{
+		ctor_kwargs = PythonObject(Py_BuildValue("{s:O}", "value_type", value_type));
+		if(not ctor_kwargs)
+			return nullptr;
+	}
+	PythonObject result(PyObject_Call(cls, ctor_args.get(), ctor_kwargs.get()));
+	if(not result)
+		return nullptr;
+	auto* dict = to_string_dict(result.get());
+	if(not dict)
+		return nullptr;
+	std::string_view data_view(static_cast<const char*>(data.buf), data.len);
+	if(0 != dict->load_buffer(data_view, line_sep_view, kv_sep_view, value_parser, decode_keys))
+		return nullptr;
+	return result.release();
+}
+
+static PyObject* strdict_lookup_tokens(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	static const char* const kwlist[] = {"text", "sep", "default", nullptr};
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* parsed[3];
+	if(0 != strdict_unpack_args("lookup_tokens", args, nargs, kwnames, kwlist, 1, parsed))
+		return nullptr;
+	auto [text, sep, default_value] = parsed;
+	if(not sep)
+		sep = Py_None;
+	if(default_value)
+		return dict->lookup_tokens(text, (sep == Py_None) ? nullptr : sep, default_value);
+	PythonObject minus_one(PyLong_FromLong(-1));
+	if(not minus_one)
+		return nullptr;
+	return dict->lookup_tokens(text, (sep == Py_None) ? nullptr : sep, minus_one.get());
+}
+
+static PyObject* strdict_slot(PyObject* self, PyObject* key)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return strdict_slot_new(dict, key);
+}
+
+static PyObject* strdict_get_path(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	static const char* const kwlist[] = {"path", "sep", "default", nullptr};
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* parsed[3];
+	if(0 != strdict_unpack_args("get_path", args, nargs, kwnames, kwlist, 1, parsed))
+		return nullptr;
+	auto [path, sep, default_value] = parsed;
+	return dict->get_path(path, (sep == Py_None) ? nullptr : sep, default_value ? default_value : Py_None);
+}
+
+static PyObject* strdict_set_path(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	static const char* const kwlist[] = {"path", "value", "sep", nullptr};
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* parsed[3];
+	if(0 != strdict_unpack_args("set_path", args, nargs, kwnames, kwlist, 2, parsed))
+		return nullptr;
+	auto [path, value, sep] = parsed;
+	if(0 != dict->set_path(path, (sep == Py_None) ? nullptr : sep, value))
+		return nullptr;
+	Py_RETURN_NONE;
+}
+
+// Convert a slice index, where None means 'default_index'.
+static int strdict_slice_index(PyObject* obj, Py_ssize_t* index, Py_ssize_t default_index)
+{
+	if(obj == Py_None)
+	{
+		*index = default_index;
+		return 1;
+	}
+	if(not PyIndex_Check(obj))
+	{
+		PyErr_Format(PyExc_TypeError, "slice indices must be integers or None, not '%.200s'.", Py_TYPE(obj)->tp_name);
+		return 0;
+	}
+	// clamp out-of-range indices like slicing does
+	*index = PyNumber_AsSsize_t(obj, nullptr);
+	return not ((*index == -1) and PyErr_Occurred());
+}
+
+// 'O&' converters for the start and stop indices of a slice.
+static int strdict_slice_start(PyObject* obj, void* result)
+{
+	return strdict_slice_index(obj, static_cast<Py_ssize_t*>(result), 0);
+}
+
+static int strdict_slice_stop(PyObject* obj, void* result)
+{
+	return strdict_slice_index(obj, static_cast<Py_ssize_t*>(result), PY_SSIZE_T_MAX);
+}
+
+static PyObject* strdict_get_slice(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	static const char* const kwlist[] = {"obj", "start", "stop", "default", nullptr};
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* parsed[4];
+	if(0 != strdict_unpack_args("get_slice", args, nargs, kwnames, kwlist, 3, parsed))
+		return nullptr;
+	Py_ssize_t start;
+	Py_ssize_t stop;
+	if(not (strdict_slice_start(parsed[1], &start) and strdict_slice_stop(parsed[2], &stop)))
+		return nullptr;
+	return dict->get_slice(parsed[0], start, stop, parsed[3] ? parsed[3] : Py_None);
+}
+
+static PyObject* strdict_contains_slice(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	static const char* const kwlist[] = {"obj", "start", "stop", nullptr};
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* parsed[3];
+	if(0 != strdict_unpack_args("contains_slice", args, nargs, kwnames, kwlist, 3, parsed))
+		return nullptr;
+	Py_ssize_t start;
+	Py_ssize_t stop;
+	if(not (strdict_slice_start(parsed[1], &start) and strdict_slice_stop(parsed[2], &stop)))
+		return nullptr;
+	int result = dict->contains_slice(parsed[0], start, stop);
+	if(result < 0)
+		return nullptr;
+	return PyBool_FromLong(result);
+}
+
+static PyObject* strdict_longest_prefix(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	static const char* const kwlist[] = {"s", "start", nullptr};
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* parsed[2];
+	if(0 != strdict_unpack_args("longest_prefix", args, nargs, kwnames, kwlist, 1, parsed))
+		return nullptr;
+	Py_ssize_t start = 0;
+	if(parsed[1] and (not strdict_slice_start(parsed[1], &start)))
+		return nullptr;
+	return dict->longest_prefix(parsed[0], start);
+}
+
+static PyObject* strdict_keys_with_prefix(PyObject* self, PyObject* prefix)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->keys_with_prefix(prefix);
+}
+
+static PyObject* strdict_items_with_prefix(PyObject* self, PyObject* prefix)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->items_with_prefix(prefix);
+}
+
+static PyObject* strdict_count_prefix(PyObject* self, PyObject* prefix)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	Py_ssize_t count = dict->count_prefix(prefix);
+	if(count < 0)
+		return nullptr;
+	return PyLong_FromSsize_t(count);
+}
+
+static PyObject* strdict_sorted_items(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+	static const char* const kwlist[] = {"start", "stop", nullptr};
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* parsed[2];
+	if(0 != strdict_unpack_args("sorted_items", args, nargs, kwnames, kwlist, 0, parsed))
+		return nullptr;
+	auto [start, stop] = parsed;
+	return dict->sorted_items((start == Py_None) ? nullptr : start, (stop == Py_None) ? nullptr : stop);
+}
+
+static PyObject* strdict_clear(PyObject* self)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	if(not dict->check_resizable())
+		return nullptr;
+	dict->clear();
+	dict->maybe_untrack();
+	Py_RETURN_NONE;
+}
+
+static PyObject* strdict_pop(PyObject* self, PyObject* const* args, Py_ssize_t nargs)
+{
+	auto [dict, key, default_value] = dictmethod_2args("pop", self, args, nargs, false);
+	if(not dict)
+		return nullptr;
+	return dict->pop(key, default_value);
+}
+
+static PyObject* strdict_save(PyObject* self, PyObject* path)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	if(0 != dict->save(path))
+		return nullptr;
+	Py_RETURN_NONE;
+}
+
+static PyObject* strdict_open_mmap(PyObject* /* unused */, PyObject* path)
+{
+	return MappedStringDict_Open(path);
+}
+
+static PyObject* strdict_save_shared(PyObject* self, PyObject* name)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	if(0 != dict->save_shared(name))
+		return nullptr;
+	Py_RETURN_NONE;
+}
+
+static PyObject* strdict_attach_shared(PyObject* /* unused */, PyObject* name)
+{
+	return MappedStringDict_OpenShared(name);
+}
+
+static PyObject* strdict_unlink_shared(PyObject* /* unused */, PyObject* name)
+{
+	if(0 != MappedStringDict_UnlinkShared(name))
+		return nullptr;
+	Py_RETURN_NONE;
+}
+
+static std::optional<StringDict::ValueType> strdict_parse_value_type(PyObject* name)
+{
+	using ValueType = StringDict::ValueType;
+	if((not name) or (name == Py_None))
+		return ValueType::object;
+	if(PyUnicode_Check(name))
+	{
+		if(0 == PyUnicode_CompareWithASCIIString(name, "O"))
+			return ValueType::object;
+		else if(0 == PyUnicode_CompareWithASCIIString(name, "i8"))
+			return ValueType::int64;
+		else if(0 == PyUnicode_CompareWithASCIIString(name, "f8"))
+			return ValueType::float64;
+	}
+	PyErr_Format(PyExc_ValueError, "Invalid strdict value_type %R; expected None, 'O', 'i8' or 'f8'.", name);
+	return std::nullopt;
+}
+
+static PyObject* strdict_value_type_name(StringDict::ValueType value_type)
+{
+	switch(value_type)
+	{
+	case StringDict::ValueType::int64:
+		return PyUnicode_FromString("i8");
+	case StringDict::ValueType::float64:
+		return PyUnicode_FromString("f8");
+	default:
+		return PyUnicode_FromString("O");
+	}
+}
+
+// Keyword arguments of strdict() that configure the instance instead of 
+// adding entries.
+static const char* const strdict_option_names[] = {"value_type", "prefix_index", "key_width", "compact_keys"};
+
+// Parse the key_width option; None or 0 means any keys.
+static std::optional<Py_ssize_t> strdict_parse_key_width(PyObject* obj)
+{
+	if((not obj) or (obj == Py_None))
+		return 0;
+	Py_ssize_t width = PyNumber_AsSsize_t(obj, PyExc_OverflowError);
+	if((width == -1) and PyErr_Occurred())
+		return std::nullopt;
+	if(width < 0)
+	{
+		PyErr_SetString(PyExc_ValueError, "strdict key_width must not be negative.");
+		return std::nullopt;
+	}
+	return width;
+}
+
+// Apply the options in the dict 'kwargs', ignoring other keys.  The value 
+// type can only be set while the dict is still empty.
+static int strdict_apply_options(StringDict* dict, PyObject* kwargs)
+{
+	assert(PyDict_Check(kwargs));
+	if(PyObject* name = PyDict_GetItemString(kwargs, "value_type"); name)
+	{
+		auto value_type = strdict_parse_value_type(name);
+		if(not value_type)
+			return -1;
+		if(*value_type != dict->get_value_type())
+		{
+			if(dict->entry_slot_count() != 0)
+			{
+				PyErr_SetString(PyExc_ValueError, "The value_type of a non-empty strdict instance can't be changed.");
+				return -1;
+			}
+			dict->set_value_type(*value_type);
+		}
+	}
+	if(PyObject* obj = PyDict_GetItemString(kwargs, "key_width"); obj)
+	{
+		auto key_width = strdict_parse_key_width(obj);
+		if(not key_width)
+			return -1;
+		if(*key_width != dict->get_key_width())
+		{
+			if(dict->entry_slot_count() != 0)
+			{
+				PyErr_SetString(PyExc_ValueError, "The key_width of a non-empty strdict instance can't be changed.");
+				return -1;
+			}
+			dict->set_key_width(*key_width);
+		}
+	}
+	if(PyObject* flag = PyDict_GetItemString(kwargs, "compact_keys"); flag)
+	{
+		int enable = PyObject_IsTrue(flag);
+		if(enable < 0)
+			return -1;
+		if(bool(enable) != dict->has_compact_keys())
+		{
+			if(dict->entry_slot_count() != 0)
+			{
+				PyErr_SetString(PyExc_ValueError, "The compact_keys option of a non-empty strdict instance can't be changed.");
+				return -1;
+			}
+			if(enable and dict->has_prefix_index())
+			{
+				PyErr_SetString(PyExc_ValueError, "A strdict with compact_keys can't have a prefix index.");
+				return -1;
+			}
+			dict->set_compact_keys(enable);
+		}
+	}
+	if(PyObject* flag = PyDict_GetItemString(kwargs, "prefix_index"); flag)
+	{
+		int enable = PyObject_IsTrue(flag);
+		if(enable < 0)
+			return -1;
+		if(enable and (not dict->has_prefix_index()) and (0 != dict->enable_prefix_index()))
+			return -1;
+	}
+	return 0;
+}
+
+// The options of 'dict' that differ from the defaults, for pickling.
+static PyObject* strdict_get_options(StringDict* dict)
+{
+	PythonObject options(PyDict_New());
+	if(not options)
+		return nullptr;
+	if(dict->is_typed())
+	{
+		PythonObject value_type(strdict_value_type_name(dict->get_value_type()));
+		if((not value_type) or (0 != PyDict_SetItemString(options.get(), "value_type", value_type.get())))
+			return nullptr;
+	}
+	if(dict->has_prefix_index() and (0 != PyDict_SetItemString(options.get(), "prefix_index", Py_True)))
+		return nullptr;
+	if(dict->has_compact_keys() and (0 != PyDict_SetItemString(options.get(), "compact_keys", Py_True)))
+		return nullptr;
+	if(dict->get_key_width())
+	{
+		PythonObject key_width(PyLong_FromSsize_t(dict->get_key_width()));
+		if((not key_width) or (0 != PyDict_SetItemString(options.get(), "key_width", key_width.get())))
+			return nullptr;
+	}
+	return options.release();
+}
+
+static PyObject* strdict_get_value_type(PyObject* self, void* /* unused */)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return strdict_value_type_name(dict->get_value_type());
+}
+
+static PyObject* strdict_get_compact_keys(PyObject* self, void* /* unused */)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return PyBool_FromLong(dict->has_compact_keys());
+}
+
+static PyObject* strdict_get_key_width(PyObject* self, void* /* unused */)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	if(not dict->get_key_width())
+		Py_RETURN_NONE;
+	return PyLong_FromSsize_t(dict->get_key_width());
+}
+
+static PyObject* strdict_get_version(PyObject* self, void* /* unused */)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return PyLong_FromUnsignedLongLong(dict->get_version());
+}
+
+static PyObject* strdict_get_prefix_index(PyObject* self, void* /* unused */)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return PyBool_FromLong(dict->has_prefix_index());
+}
+
+static PyObject* strdict_getstate(PyObject* self)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PythonObject blob(dict->dump_keys());
+	if(not blob)
+		return nullptr;
+	PythonObject values(dict->is_typed() ? dict->dump_values() : dict->get_values());
+	if(not values)
+		return nullptr;
+	PythonObject inst_dict;
+	// include the instance dict of subclasses
+	if(Py_TYPE(self)->tp_dictoffset != 0)
+	{
+		inst_dict = PythonObject(PyObject_GetAttrString(self, "__dict__"));
+		if(not inst_dict)
+			return nullptr;
+		if(PyObject_Length(inst_dict) == 0)
+			inst_dict.reset();
+	}
+	PythonObject options(strdict_get_options(dict));
+	if(not options)
+		return nullptr;
+	if(PyDict_Size(options.get()) > 0)
+		return PyTuple_Pack(4, blob.get(), values.get(), inst_dict ? inst_dict.get() : Py_None, options.get());
+	if(inst_dict)
+		return PyTuple_Pack(3, blob.get(), values.get(), inst_dict.get());
+	return PyTuple_Pack(2, blob.get(), values.get());
+}
+
+static PyObject* strdict_setstate(PyObject* self, PyObject* state)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	PyObject* blob;
+	PyObject* values;
+	PyObject* inst_dict = nullptr;
+	PyObject* options = nullptr;
+	if(not PyArg_ParseTuple(state, "OO|OO!:__setstate__", &blob, &values, &inst_dict, &PyDict_Type, &options))
+		return nullptr;
+	if(inst_dict == Py_None)
+	{
+		inst_dict = nullptr;
+	}
+	else if(inst_dict and (not PyDict_Check(inst_dict)))
+	{
+		PyErr_Format(PyExc_TypeError, "strdict instance dict must be a dict, not '%.200s'.", Py_TYPE(inst_dict)->tp_name);
+		return nullptr;
+	}
+	auto value_type = strdict_parse_value_type(options ? PyDict_GetItemString(options, "value_type") : nullptr);
+	if(not value_type)
+		return nullptr;
+	auto key_width = strdict_parse_key_width(options ? PyDict_GetItemString(options, "key_width") : nullptr);
+	if(not key_width)
+		return nullptr;
+	int compact_keys = 0;
+	if(PyObject* flag = options ? PyDict_GetItemString(options, "compact_keys") : nullptr; flag)
+	{
+		compact_keys = PyObject_IsTrue(flag);
+		if(compact_keys < 0)
+			return nullptr;
+	}
+	if(0 != dict->load_keys(blob, values, *value_type, *key_width, compact_keys))
+		return nullptr;
+	if(options and (0 != strdict_apply_options(dict, options)))
+		return nullptr;
+	if(inst_dict)
+	{
+		PythonObject self_dict(PyObject_GetAttrString(self, "__dict__"));
+		if((not self_dict) or (0 != PyDict_Update(self_dict, inst_dict)))
+			return nullptr;
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject* strdict_reduce(PyObject* self)
+{
+	PythonObject state(strdict_getstate(self));
+	if(not state)
+		return nullptr;
+	return Py_BuildValue("O()O", (PyObject*)Py_TYPE(self), state.get());
+}
+
+static PyObject* strdict_popitem(PyObject* self)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+	return dict->popitem();
+}
+
+static int strdict_tp_clear(PyObject *op)
+{
+	auto* dict = static_cast<StringDict*>(op);
+	dict->default_factory.reset();
+	if(not dict->check_resizable())
+		return -1;
+	dict->clear();
+	return 0;
+}
+
+void strdict_dealloc(PyObject* self)
+{
+	// TODO: Do *I* have to untrack this?  I think so, but I'm not sure.
+	PyObject_GC_UnTrack(self);
+	Py_TRASHCAN_SAFE_BEGIN(self)
+	StringDict* dict = static_cast<StringDict*>(self);
+	dict->clear();
+	dict->~StringDict();
+	Py_TYPE(self)->tp_free(self);
+	Py_TRASHCAN_SAFE_END(self)
+}
+
+// Allocate an empty strdict of the given type, without applying any options.
+static PyObject* strdict_alloc(PyTypeObject *type)
+{
+	assert(type);
+	assert(type->tp_alloc);
+	assert(PyType_Check(type));
+	PyObject* self = type->tp_alloc(type, 0);
+	if(not self)
+		return nullptr;
+	if(not StringDict::try_default_construct(static_cast<StringDict*>(self)))
+	{
+		assert(type->tp_dealloc != nullptr);
+		Py_DECREF(self);
+		return nullptr;
+	}
+	assert(Py_REFCNT(self));
+	assert(static_cast<StringDict*>(self)->size() == 0);
+	assert(static_cast<StringDict*>(self)->is_small());
+	// tp_alloc() tracks the new object; exact strdicts start out untracked
+	if(type == &StringDict_Type)
+		PyObject_GC_UnTrack(self);
+	return self;
+}
+
+static PyObject* strdict_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+	assert(args);
+	PyObject* self = strdict_alloc(type);
+	if(not self)
+		return nullptr;
+	if(kwargs and (0 != strdict_apply_options(static_cast<StringDict*>(self), kwargs)))
+	{
+		Py_DECREF(self);
+		return nullptr;
+	}
+	return self;
+}
+
+static int strdict_init(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+	assert(PyTuple_Check(args));
+	PythonObject kwargs_copy;
+	if(kwargs)
+	{
+		// Options were applied by strdict_new(); they're checked again here 
+		// in case __init__() is called explicitly.
+		if(0 != strdict_apply_options(static_cast<StringDict*>(self), kwargs))
+			return -1;
+		for(const char* name: strdict_option_names)
+		{
+			if(not PyDict_GetItemString(kwargs, name))
+				continue;
+			if(not kwargs_copy)
+			{
+				kwargs_copy = PythonObject(PyDict_Copy(kwargs));
+				if(not kwargs_copy)
+					return -1;
+			}
+			if(0 != PyDict_DelItemString(kwargs_copy.get(), name))
+				return -1;
+		}
+		if(kwargs_copy)
+			kwargs = kwargs_copy.get();
+	}
+	Py_ssize_t argc = PyTuple_GET_SIZE(args);
+	if(argc == 0)
+	{
+		
+		assert((not kwargs) or PyDict_Check(kwargs));
+		if(kwargs and PyDict_Size(kwargs) != 0)
+		{
+			return static_cast<StringDict*>(self)->update_from_kwargs(kwargs);
+		}
+		else
+			return 0;
+	}
+	else if(argc > 1)
+	{
+		PyErr_SetString(PyExc_TypeError, "strdict.__init__() only takes a single positional argument, but got more than one.");
+		return -1;
+	}
+	else
+	{
+		auto* dict = static_cast<StringDict*>(self);
+		if(0 != dict->update_from_object(PyTuple_GET_ITEM(args, 0)))
+			return -1;
+		if(kwargs and (PyDict_Size(kwargs) != 0))
+			return dict->update_from_kwargs(kwargs);
+		return 0;
+	}
+}
+
+#if PY_VERSION_HEX >= 0x03090000
+// Vectorcall constructor for strdict(...).  Calls with keyword arguments take 
+// the tp_new/tp_init path.  tp_vectorcall isn't inherited, so subclasses 
+// (which may override __new__ or __init__) always take that path.
+static PyObject* strdict_vectorcall(PyObject* type, PyObject* const* args, size_t nargsf, PyObject* kwnames)
+{
+	assert(PyType_Check(type));
+	Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+	if(kwnames and (PyTuple_GET_SIZE(kwnames) != 0))
+	{
+		PythonObject args_tuple(PyTuple_New(nargs));
+		if(not args_tuple)
+			return nullptr;
+		for(Py_ssize_t i = 0; i < nargs; ++i)
+		{
+			Py_INCREF(args[i]);
+			PyTuple_SET_ITEM(args_tuple.get(), i, args[i]);
+		}
+		PythonObject kwargs(PyDict_New());
+		if(not kwargs)
+			return nullptr;
+		for(Py_ssize_t i = 0; i < PyTuple_GET_SIZE(kwnames); ++i)
+		{
+			if(0 != PyDict_SetItem(kwargs.get(), PyTuple_GET_ITEM(kwnames, i), args[nargs + i]))
+				return nullptr;
+		}
+		PythonObject self(strdict_new((PyTypeObject*)type, args_tuple.get(), kwargs.get()));
+		if((not self) or (0 != strdict_init(self.get(), args_tuple.get(), kwargs.get())))
+			return nullptr;
+		return self.release();
+	}
+	if(nargs > 1)
+	{
+		PyErr_SetString(PyExc_TypeError, "strdict.__init__() only takes a single positional argument, but got more than one.");
+		return nullptr;
+	}
+	PythonObject self(strdict_alloc((PyTypeObject*)type));
+	if(not self)
+		return nullptr;
+	if((nargs == 1) and (0 != static_cast<StringDict*>(self.get())->update_from_object(args[0])))
+		return nullptr;
+	return self.release();
+}
+#endif
+
+static PyObject* strdict_copy_as(PyObject* self, PyTypeObject* type)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return nullptr;
+
+	PythonObject args(PyTuple_New(0));
+	if(not args)
+		return nullptr;
+
+	PythonObject kwargs(PyDict_New());
+	if(not kwargs)
+		return nullptr;
 	
+	PythonObject new_dict(strdict_new(type, args, kwargs));
+	if(not new_dict)
+		return nullptr;
+
+	auto err = dict->make_copy(*static_cast<StringDict*>(new_dict.get()));
+	if(err)
+		return nullptr;
+	return new_dict.release();
 }
 
-static StringDict* to_string_dict(PyObject* self)
+static PyObject* strdict_copy(PyObject* self)
 {
-	if(not StringDict_CheckErr(self))
+	return strdict_copy_as(self, (PyTypeObject*)(StringDict_GetType()));
+}
+
+static PyObject* strdefaultdict_copy(PyObject* self)
+{
+	PythonObject new_dict(strdict_copy_as(self, &StringDefaultDict_Type));
+	if(not new_dict)
 		return nullptr;
-	return static_cast<StringDict*>(self);
+	PythonObject factory(static_cast<StringDict*>(self)->get_default_factory());
+	if(0 != static_cast<StringDict*>(new_dict.get())->set_default_factory(factory.get()))
+		return nullptr;
+	return new_dict.release();
+}
+
+static int strdefaultdict_init(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+	assert(PyTuple_Check(args));
+	Py_ssize_t argc = PyTuple_GET_SIZE(args);
+	PyObject* factory = (argc > 0) ? PyTuple_GET_ITEM(args, 0) : Py_None;
+	if(0 != static_cast<StringDict*>(self)->set_default_factory(factory))
+		return -1;
+	PythonObject dict_args(PyTuple_GetSlice(args, 1, std::max(argc, Py_ssize_t(1))));
+	if(not dict_args)
+		return -1;
+	return strdict_init(self, dict_args.get(), kwargs);
+}
+
+static PyObject* strdefaultdict_repr(PyObject* self)
+{
+	auto* dict = static_cast<StringDict*>(self);
+	PythonObject dict_repr(dict->repr());
+	if(not dict_repr)
+		return nullptr;
+	PythonObject factory(dict->get_default_factory());
+	// guard against factories whose repr contains the dict
+	if(auto count = Py_ReprEnter(factory.get()); count)
+	{
+		if(count < 0)
+			return nullptr;
+		return PyUnicode_FromFormat("strdefaultdict(..., %U)", dict_repr.get());
+	}
+	PythonObject factory_repr(PyObject_Repr(factory.get()));
+	Py_ReprLeave(factory.get());
+	if(not factory_repr)
+		return nullptr;
+	return PyUnicode_FromFormat("strdefaultdict(%U, %U)", factory_repr.get(), dict_repr.get());
+}
+
+static PyObject* strdefaultdict_reduce(PyObject* self)
+{
+	PythonObject state(strdict_getstate(self));
+	if(not state)
+		return nullptr;
+	PythonObject factory(static_cast<StringDict*>(self)->get_default_factory());
+	return Py_BuildValue("O(O)O", (PyObject*)Py_TYPE(self), factory.get(), state.get());
+}
+
+static PyObject* strdefaultdict_get_default_factory(PyObject* self, void* /* unused */)
+{
+	return static_cast<StringDict*>(self)->get_default_factory();
+}
+
+static int strdefaultdict_set_default_factory(PyObject* self, PyObject* factory, void* /* unused */)
+{
+	return static_cast<StringDict*>(self)->set_default_factory(factory ? factory : Py_None);
 }
 
-static std::tuple<StringDict*, PyObject*, PyObject*> dictmethod_2args(PyObject* self, PyObject* args, bool none_is_default = true)
+static int strdict_traverse(PyObject* self, visitproc visit, void *arg)
 {
 	auto* dict = to_string_dict(self);
 	if(not dict)
-		return {nullptr, nullptr, nullptr};
-	PyObject* key_;
-	PyObject* default_value_ = nullptr;
-	if(not PyArg_ParseTuple(args, "O|O", &key_, &default_value_))
-		return {nullptr, nullptr, nullptr};
-	if((not default_value_) and (none_is_default))
-		default_value_ = Py_None;
-	return std::make_tuple(dict, key_, default_value_);
+		return -1;
+	return dict->gc_traverse(visit, arg);
+}
+
+static int strdict_getbuffer(PyObject* self, Py_buffer* view, int flags)
+{
+	auto* dict = to_string_dict(self);
+	if(not dict)
+		return -1;
+	return dict->get_buffer(view, flags);
+}
+
+static void strdict_releasebuffer(PyObject* self, Py_buffer* /* unused */)
+{
+	static_cast<StringDict*>(self)->release_buffer();
+}
+
+
+
+
+static PySequenceMethods strdict_as_sequence = {
+    0,                          /* sq_length */
+    0,                          /* sq_concat */
+    0,                          /* sq_repeat */
+    0,                          /* sq_item */
+    0,                          /* sq_slice */
+    0,                          /* sq_ass_item */
+    0,                          /* sq_ass_slice */
+    strdict_contains,           /* sq_contains */
+    0,                          /* sq_inplace_concat */
+    0,                          /* sq_inplace_repeat */
+};
+
+
+static PyMappingMethods strdict_as_mapping = {
+    (lenfunc)strdict_length, /*mp_length*/
+    (binaryfunc)strdict_subscript, /*mp_subscript*/
+    (objobjargproc)strdict_assign_subscript, /*mp_ass_subscript*/
+};
+
+static PyBufferProcs strdict_as_buffer = {
+    strdict_getbuffer,          /* bf_getbuffer */
+    strdict_releasebuffer,      /* bf_releasebuffer */
+};
+
+#include "StringDict_Docs.h"
+
+static PyMethodDef strdict_methods[] = {
+    {"__contains__", (PyCFunction)strdict___contains__, METH_O|METH_COEXIST,          strdict___contains____doc__},
+    {"__getitem__",  (PyCFunction)strdict_subscript,    METH_O | METH_COEXIST,        getitem__doc__},
+    {"__sizeof__",   (PyCFunction)strdict_sizeof,       METH_NOARGS,                  sizeof__doc__},
+    {"get",          (PyCFunction)strdict_get,          METH_FASTCALL,                 strdict_get__doc__},
+    {"setdefault",   (PyCFunction)strdict_setdefault,   METH_FASTCALL,                 strdict_setdefault__doc__},
+    {"pop",          (PyCFunction)strdict_pop,          METH_FASTCALL,                 pop__doc__},
+    {"popitem",      (PyCFunction)strdict_popitem,      METH_NOARGS,                  popitem__doc__},
+    {"keys",         (PyCFunction)strdict_keys,         METH_NOARGS,                  keys__doc__},
+    {"items",        (PyCFunction)strdict_items,        METH_NOARGS,                  items__doc__},
+    {"values",       (PyCFunction)strdict_values,       METH_NOARGS,                  values__doc__},
+    {"update",       (PyCFunction)strdict_update,       METH_FASTCALL | METH_KEYWORDS, update__doc__},
+    {"increment",    (PyCFunction)strdict_increment,    METH_FASTCALL | METH_KEYWORDS, increment__doc__},
+    {"count",        (PyCFunction)strdict_count,        METH_O,                       count__doc__},
+    {"from_buffer",  (PyCFunction)strdict_from_buffer,  METH_FASTCALL | METH_KEYWORDS | METH_CLASS, from_buffer__doc__},
+    {"lookup_tokens",(PyCFunction)strdict_lookup_tokens,METH_FASTCALL | METH_KEYWORDS, lookup_tokens__doc__},
+    {"get_slice",    (PyCFunction)strdict_get_slice,    METH_FASTCALL | METH_KEYWORDS, get_slice__doc__},
+    {"slot",         (PyCFunction)strdict_slot,         METH_O,                       slot__doc__},
+    {"get_path",     (PyCFunction)strdict_get_path,     METH_FASTCALL | METH_KEYWORDS, get_path__doc__},
+    {"set_path",     (PyCFunction)strdict_set_path,     METH_FASTCALL | METH_KEYWORDS, set_path__doc__},
+    {"contains_slice",(PyCFunction)strdict_contains_slice,METH_FASTCALL | METH_KEYWORDS, contains_slice__doc__},
+    {"longest_prefix",(PyCFunction)strdict_longest_prefix,METH_FASTCALL | METH_KEYWORDS, longest_prefix__doc__},
+    {"keys_with_prefix",(PyCFunction)strdict_keys_with_prefix,METH_O,                  keys_with_prefix__doc__},
+    {"items_with_prefix",(PyCFunction)strdict_items_with_prefix,METH_O,                items_with_prefix__doc__},
+    {"count_prefix", (PyCFunction)strdict_count_prefix, METH_O,                       count_prefix__doc__},
+    {"sorted_items", (PyCFunction)strdict_sorted_items, METH_FASTCALL | METH_KEYWORDS, sorted_items__doc__},
+    {"clear",        (PyCFunction)strdict_clear,        METH_NOARGS,                  clear__doc__},
+    {"copy",         (PyCFunction)strdict_copy,         METH_NOARGS,                  copy__doc__},
+    {"__getstate__", (PyCFunction)strdict_getstate,     METH_NOARGS,                  getstate__doc__},
+    {"__setstate__", (PyCFunction)strdict_setstate,     METH_O,                       setstate__doc__},
+    {"__reduce__",   (PyCFunction)strdict_reduce,       METH_NOARGS,                  reduce__doc__},
+    {"save",         (PyCFunction)strdict_save,         METH_O,                       save__doc__},
+    {"open_mmap",    (PyCFunction)strdict_open_mmap,    METH_O | METH_STATIC,         open_mmap__doc__},
+    {"save_shared",  (PyCFunction)strdict_save_shared,  METH_O,                       save_shared__doc__},
+    {"attach_shared",(PyCFunction)strdict_attach_shared,METH_O | METH_STATIC,         attach_shared__doc__},
+    {"unlink_shared",(PyCFunction)strdict_unlink_shared,METH_O | METH_STATIC,         unlink_shared__doc__},
+    {NULL,           NULL}   /* sentinel */
+};
+
+static PyGetSetDef strdict_getset[] = {
+    {"value_type",   strdict_get_value_type,            nullptr,                      value_type__doc__},
+    {"prefix_index", strdict_get_prefix_index,          nullptr,                      prefix_index__doc__},
+    {"key_width",    strdict_get_key_width,             nullptr,                      key_width__doc__},
+    {"compact_keys", strdict_get_compact_keys,          nullptr,                      compact_keys__doc__},
+    {"version",      strdict_get_version,               nullptr,                      version__doc__},
+    {NULL}   /* sentinel */
+};
+
+PyObject* test_alloc(PyTypeObject *type, Py_ssize_t nitems)
+{
+	assert(nitems == 0);
+	return PyObject_GC_New(StringDict, type);
 }
 
 
+PyTypeObject StringDict_Type{
+	PyVarObject_HEAD_INIT(nullptr, 0)
+	"StringDict.strdict",
+	sizeof(StringDict),
+	0,
+	(destructor)strdict_dealloc,                         /* tp_dealloc */
+	0,                                                   /* tp_print */
+	0,                                                   /* tp_getattr */
+	0,                                                   /* tp_setattr */
+	0,                                                   /* tp_as_async */
+	(reprfunc)strdict_repr,                   	     /* tp_repr */
+	0,                                                   /* tp_as_number */
+	&strdict_as_sequence,                                /* tp_as_sequence */
+	&strdict_as_mapping,                                 /* tp_as_mapping */
+	PyObject_HashNotImplemented,                         /* tp_hash */
+	0,                                                   /* tp_call */
+	0,                                                   /* tp_str */
+	PyObject_GenericGetAttr,                             /* tp_getattro */
+	0,                                                   /* tp_setattro */
+	&strdict_as_buffer,                                  /* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | 
+		Py_TPFLAGS_BASETYPE,                         /* tp_flags */
+	strdict_doc,                                         /* tp_doc */
+	strdict_traverse,                                    /* tp_traverse */
+	strdict_tp_clear,                                    /* tp_clear */
+	strdict_richcompare,                                 /* tp_richcompare */
+	0,                                                   /* tp_weaklistoffset */
+	0,                                                   /* tp_iter */
+	0,                                                   /* tp_iternext */
+	strdict_methods,                                     /* tp_methods */
+	0,                                                   /* tp_members */
+	strdict_getset,                                      /* tp_getset */
+	0,                                                   /* tp_base */
+	0,                                                   /* tp_dict */
+	0,                                                   /* tp_descr_get */
+	0,                                                   /* tp_descr_set */
+	0,                                                   /* tp_dictoffset */
+	strdict_init,                                        /* tp_init */
+	0,//PyType_GenericAlloc,                                 /* tp_alloc */
+	strdict_new,                                         /* tp_new */
+	0,//PyObject_GC_Del,                                     /* tp_free */
+	// 0,                                                /* tp_is_gc */ 
+	// 0,                                                /* tp_bases */
+	// 0,                                                /* tp_mro */
+	// 0,                                                /* tp_cache */
+	// 0,                                                /* tp_subclasses */
+	// 0,                                                /* tp_weaklist */
+	// 0,                                                /* tp_del */
+	// 0,                                                /* tp_version_tag */
+	// 0                                                 /* tp_finalize */
+};
 
-static int strdict_contains(PyObject* self, PyObject* key)
+static PyObject* StringDict_GetType()
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return -1;
-	return dict->contains(key);
+	return (PyObject*)(&StringDict_Type);
 }
 
-static PyObject* strdict___contains__(PyObject* self, PyObject* key)
+static PyMethodDef strdefaultdict_methods[] = {
+    {"copy",         (PyCFunction)strdefaultdict_copy,  METH_NOARGS,                  copy__doc__},
+    {"__reduce__",   (PyCFunction)strdefaultdict_reduce,METH_NOARGS,                  reduce__doc__},
+    {NULL,	NULL},
+};
+
+static PyGetSetDef strdefaultdict_getset[] = {
+    {"default_factory", strdefaultdict_get_default_factory, strdefaultdict_set_default_factory, default_factory__doc__},
+    {NULL}   /* sentinel */
+};
+
+static PyObject* strdict_key_new(PyTypeObject* type, PyObject* args, PyObject* kwargs)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
+	static const char* kwlist[] = {"key", nullptr};
+	PyObject* key;
+	if(not PyArg_ParseTupleAndKeywords(args, kwargs, "O:Key", const_cast<char**>(kwlist), &key))
 		return nullptr;
-	int cont = dict->contains(key);
-	switch(cont)
+	if(StringDictKey_Check(key))
 	{
-	case 0:
-		Py_RETURN_FALSE;
-		break;
-	case 1:
-		Py_RETURN_TRUE;
-		break;
-	default:
-		assert(cont < 0);
+		Py_INCREF(key);
+		return key;
+	}
+	PythonObject owned;
+	if(PyUnicode_Check(key) or PyBytes_Check(key))
+	{
+		Py_INCREF(key);
+		owned = PythonObject(key);
+	}
+	else if(PyObject_CheckBuffer(key))
+	{
+		// copy mutable buffers; the hash has to stay valid
+		owned = PythonObject(PyBytes_FromObject(key));
+		if(not owned)
+			return nullptr;
+	}
+	else
+	{
+		PyErr_Format(PyExc_TypeError, "strdict keys must be str or bytes-like objects, not '%.200s'.", Py_TYPE(key)->tp_name);
 		return nullptr;
 	}
-	assert(false);
+	PythonObject self(type->tp_alloc(type, 0));
+	if(not self)
+		return nullptr;
+	KeyInfo& ki = reinterpret_cast<StringDictKey*>(self.get())->ki;
+	ki.key = nullptr;
+	if(0 != KeyInfo_Init(owned.get(), &ki, nullptr))
+		return nullptr;
+	assert(ki.key == owned.get());
+	owned.release();
+	return self.release();
 }
 
+static void strdict_key_dealloc(PyObject* self)
+{
+	Py_XDECREF(reinterpret_cast<StringDictKey*>(self)->ki.key);
+	Py_TYPE(self)->tp_free(self);
+}
 
-static Py_ssize_t strdict_length(PyObject* self)
+static Py_hash_t strdict_key_hash(PyObject* self)
 {
-	const auto* dict = to_string_dict(self);
-	if(not dict)
-		return -1;
-	return dict->size();
+	return reinterpret_cast<StringDictKey*>(self)->ki.hash;
 }
 
-static PyObject* strdict_repr(PyObject* self)
+// Keys compare like the str or bytes objects they hold.
+static PyObject* strdict_key_richcompare(PyObject* self, PyObject* other, int op)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return nullptr;
-	return dict->repr();
+	return PyObject_RichCompare(StringDictKey_Unwrap(self), StringDictKey_Unwrap(other), op);
 }
 
-static PyObject* strdict_keys(PyObject* self)
+static PyObject* strdict_key_repr(PyObject* self)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return nullptr;
-	return dict->get_keys();
+	return PyUnicode_FromFormat("strdict.Key(%R)", StringDictKey_Unwrap(self));
 }
 
-static PyObject* strdict_values(PyObject* self)
+static PyObject* strdict_key_get_key(PyObject* self, void* /* unused */)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return nullptr;
-	return dict->get_values();
+	PyObject* key = StringDictKey_Unwrap(self);
+	Py_INCREF(key);
+	return key;
 }
 
-static PyObject* strdict_items(PyObject* self)
+static PyGetSetDef strdict_key_getset[] = {
+    {"key", strdict_key_get_key, nullptr, strdict_key_key__doc__},
+    {NULL}   /* sentinel */
+};
+
+PyTypeObject StringDictKey_Type{
+	PyVarObject_HEAD_INIT(nullptr, 0)
+	"StringDict.strdict_key",
+	sizeof(StringDictKey),
+	0,
+	(destructor)strdict_key_dealloc,                     /* tp_dealloc */
+	0,                                                   /* tp_print */
+	0,                                                   /* tp_getattr */
+	0,                                                   /* tp_setattr */
+	0,                                                   /* tp_as_async */
+	(reprfunc)strdict_key_repr,                          /* tp_repr */
+	0,                                                   /* tp_as_number */
+	0,                                                   /* tp_as_sequence */
+	0,                                                   /* tp_as_mapping */
+	strdict_key_hash,                                    /* tp_hash */
+	0,                                                   /* tp_call */
+	0,                                                   /* tp_str */
+	PyObject_GenericGetAttr,                             /* tp_getattro */
+	0,                                                   /* tp_setattro */
+	0,                                                   /* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,                                  /* tp_flags */
+	strdict_key_doc,                                     /* tp_doc */
+	0,                                                   /* tp_traverse */
+	0,                                                   /* tp_clear */
+	strdict_key_richcompare,                             /* tp_richcompare */
+	0,                                                   /* tp_weaklistoffset */
+	0,                                                   /* tp_iter */
+	0,                                                   /* tp_iternext */
+	0,                                                   /* tp_methods */
+	0,                                                   /* tp_members */
+	strdict_key_getset,                                  /* tp_getset */
+	0,                                                   /* tp_base */
+	0,                                                   /* tp_dict */
+	0,                                                   /* tp_descr_get */
+	0,                                                   /* tp_descr_set */
+	0,                                                   /* tp_dictoffset */
+	0,                                                   /* tp_init */
+	0,                                                   /* tp_alloc */
+	strdict_key_new,                                     /* tp_new */
+	0,                                                   /* tp_free */
+};
+
+// Handle returned by strdict.slot(key).  Remembers the index of the entry of
+// 'key' (or that it's missing), which stays valid while the generation of the
+// dict is unchanged, so repeated reads and writes skip hashing and probing.
+struct StringDictSlot:
+	public PyObject
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
+	StringDict* dict;
+	// strdict.Key that owns the data of 'ki'
+	PyObject* key;
+	// the KeyInfo of 'key' as 'dict' hashes it
+	KeyInfo ki;
+	// index of the entry of 'key' in 'dict', or -1 if it's missing
+	Py_ssize_t index;
+	std::uint64_t generation;
+
+	// Probe 'dict' again if it changed since the last probe.
+	void refresh()
+	{
+		if(generation == dict->get_generation())
+			return;
+		auto [idx, ent] = dict->find_existing(ki);
+		(void)idx;
+		index = ent ? dict->index_of(*ent) : -1;
+		generation = dict->get_generation();
+	}
+};
+
+static PyObject* strdict_slot_new(StringDict* dict, PyObject* key)
+{
+	PythonObject key_obj(PyObject_CallOneArg(reinterpret_cast<PyObject*>(&StringDictKey_Type), key));
+	if(not key_obj)
 		return nullptr;
-	return dict->get_items();
+	KeyInfo ki = reinterpret_cast<StringDictKey*>(key_obj.get())->ki;
+	if(dict->get_key_width())
+	{
+		if(not dict->to_fixed_width(ki))
+			return (dict->fixed_width_error(ki), nullptr);
+		// 'ki.key' is cleared for fixed-width dicts, so keep the key alive
+		// with 'key_obj'
+	}
+	auto* slot = PyObject_GC_New(StringDictSlot, &StringDictSlot_Type);
+	if(not slot)
+		return nullptr;
+	Py_INCREF(dict);
+	slot->dict = dict;
+	slot->key = key_obj.release();
+	slot->ki = ki;
+	slot->index = -1;
+	// never a valid generation, so the first access probes
+	slot->generation = dict->get_generation() - 1;
+	PyObject_GC_Track(slot);
+	return slot;
 }
 
-static PyObject* strdict_subscript(PyObject* self, PyObject* key)
+static void strdict_slot_dealloc(PyObject* self)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return nullptr;
-	return dict->subscript(key);
+	PyObject_GC_UnTrack(self);
+	auto* slot = static_cast<StringDictSlot*>(self);
+	Py_XDECREF(slot->dict);
+	Py_XDECREF(slot->key);
+	PyObject_GC_Del(self);
 }
 
-static int strdict_assign_subscript(PyObject* self, PyObject* key, PyObject* value)
+static int strdict_slot_traverse(PyObject* self, visitproc visit, void* arg)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return -1;
-	else if(not value)
-		return dict->remove(key);
-	else if(dict->set(key, value, false))
-		return 0;
-	else
-		return -1;
+	Py_VISIT(static_cast<StringDictSlot*>(self)->dict);
+	return 0;
 }
 
-static PyObject* strdict_update(PyObject* self, PyObject* args, PyObject* kwargs)
+static PyObject* strdict_slot_get(PyObject* self, PyObject* const* args, Py_ssize_t nargs)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return nullptr;
-	assert(PyTuple_Check(args));
-	if(Py_ssize_t argc = PyTuple_GET_SIZE(args); argc > 1)
+	if(nargs > 1)
 	{
-		PyErr_SetString(PyExc_TypeError, "strdict.update() takes at most 1 positional argument.");
+		PyErr_Format(PyExc_TypeError, "get expected at most 1 argument, got %zd.", nargs);
 		return nullptr;
 	}
-	else if(argc == 1)
-	{
-		if(0 != dict->update_from_object(PyTuple_GET_ITEM(args, 0)))
-			return nullptr;
-	}
-	
-	if(kwargs)
-	{
-		assert(PyDict_Check(kwargs));
-		if(dict->update_from_kwargs(kwargs) != 0)
-			return nullptr;
-	}
-	Py_RETURN_NONE;
+	auto* slot = static_cast<StringDictSlot*>(self);
+	slot->refresh();
+	if(slot->index >= 0)
+		return slot->dict->value_of(slot->dict->entry_from_index(slot->index));
+	PyObject* default_value = nargs ? args[0] : Py_None;
+	Py_INCREF(default_value);
+	return default_value;
 }
 
-static PyObject *
-strdict_richcompare(PyObject *left, PyObject *right, int op)
+static PyObject* strdict_slot_set(PyObject* self, PyObject* value)
 {
-	if((op != Py_EQ) and (op != Py_NE))
-		Py_RETURN_NOTIMPLEMENTED;
-	
-	bool left_is_strdict = StringDict_Check(left);
-	bool right_is_strdict = StringDict_Check(right);
-	if(left_is_strdict and right_is_strdict)
-	{
-		// both strdicts
-		StringDict& left_dict = *static_cast<StringDict*>(left);
-		StringDict& right_dict = *static_cast<StringDict*>(right);
-		int cmp = 0;
-
-		assert(op == Py_EQ or op == Py_NE);
-		// compare and check if an error occurred 
-		cmp = (left_dict == right_dict);
-		if(cmp < 0)
-			return nullptr;
-		// invert the result if != was requested
-		if(op == Py_NE)
-			cmp = not cmp;
-		if(cmp)
-			Py_RETURN_TRUE;
-		else 
-			Py_RETURN_FALSE;
-	}
-	else
+	auto* slot = static_cast<StringDictSlot*>(self);
+	StringDict::UnboxedValue unboxed;
+	const StringDict::UnboxedValue* unboxed_value = slot->dict->unbox_for_insertion(value, &unboxed);
+	if(slot->dict->is_typed() and (not unboxed_value))
+		return nullptr;
+	slot->refresh();
+	if(slot->index >= 0)
 	{
-		// only other allowable case is that one is a strdict() and the other is a dict()
-		StringDict* strdict = nullptr;
-		PyObject* dict = nullptr;
-		if(left_is_strdict)
-		{
-			if(not PyDict_Check(right))
-				Py_RETURN_NOTIMPLEMENTED;
-			strdict = static_cast<StringDict*>(left);
-			dict = right;
-		}
-		else if(right_is_strdict)
-		{
-			if(not PyDict_Check(left))
-				Py_RETURN_NOTIMPLEMENTED;
-			strdict = static_cast<StringDict*>(right);
-			dict = left;
-		}
-		else
-		{
-			Py_RETURN_NOTIMPLEMENTED;
-		}
-		int cmp = strdict->equals_dict(dict);
-		if(cmp < 0)
-			return nullptr;
-		// invert the result if != was requested
-		if(op == Py_NE)
-			cmp = not cmp;
-		if(cmp)
-			Py_RETURN_TRUE;
-		else 
-			Py_RETURN_FALSE;
+		slot->dict->store_value(slot->dict->entry_from_index(slot->index), value, unboxed_value);
+		Py_RETURN_NONE;
 	}
+	Entry* ent = slot->dict->insert(slot->ki, value, false, unboxed_value);
+	if(not ent)
+		return nullptr;
+	slot->index = slot->dict->index_of(*ent);
+	slot->generation = slot->dict->get_generation();
+	Py_RETURN_NONE;
 }
 
-static PyObject* strdict_sizeof(PyObject* self)
+static PyObject* strdict_slot_get_key(PyObject* self, void* /* unused */)
 {
-	const auto* dict = to_string_dict(self);
-	if(not dict)
-		return nullptr;
-	return PyLong_FromSsize_t(Py_ssize_t(sizeof(*dict)));
+	PyObject* key = reinterpret_cast<StringDictKey*>(static_cast<StringDictSlot*>(self)->key)->ki.key;
+	Py_INCREF(key);
+	return key;
 }
 
+static PyObject* strdict_slot_repr(PyObject* self)
+{
+	return PyUnicode_FromFormat("<strdict slot %R>", reinterpret_cast<StringDictKey*>(static_cast<StringDictSlot*>(self)->key)->ki.key);
+}
 
+static PyMethodDef strdict_slot_methods[] = {
+    {"get",          (PyCFunction)strdict_slot_get,     METH_FASTCALL,                strdict_slot_get__doc__},
+    {"set",          (PyCFunction)strdict_slot_set,     METH_O,                       strdict_slot_set__doc__},
+    {NULL,	NULL},
+};
 
+static PyGetSetDef strdict_slot_getset[] = {
+    {"key",          strdict_slot_get_key,              nullptr,                      strdict_slot_key__doc__},
+    {NULL}   /* sentinel */
+};
 
+PyTypeObject StringDictSlot_Type{
+	PyVarObject_HEAD_INIT(nullptr, 0)
+	"StringDict.strdict_slot",
+	sizeof(StringDictSlot),
+	0,
+	(destructor)strdict_slot_dealloc,                    /* tp_dealloc */
+	0,                                                   /* tp_print */
+	0,                                                   /* tp_getattr */
+	0,                                                   /* tp_setattr */
+	0,                                                   /* tp_as_async */
+	(reprfunc)strdict_slot_repr,                         /* tp_repr */
+	0,                                                   /* tp_as_number */
+	0,                                                   /* tp_as_sequence */
+	0,                                                   /* tp_as_mapping */
+	0,                                                   /* tp_hash */
+	0,                                                   /* tp_call */
+	0,                                                   /* tp_str */
+	PyObject_GenericGetAttr,                             /* tp_getattro */
+	0,                                                   /* tp_setattro */
+	0,                                                   /* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,             /* tp_flags */
+	strdict_slot_doc,                                    /* tp_doc */
+	strdict_slot_traverse,                               /* tp_traverse */
+	0,                                                   /* tp_clear */
+	0,                                                   /* tp_richcompare */
+	0,                                                   /* tp_weaklistoffset */
+	0,                                                   /* tp_iter */
+	0,                                                   /* tp_iternext */
+	strdict_slot_methods,                                /* tp_methods */
+	0,                                                   /* tp_members */
+	strdict_slot_getset,                                 /* tp_getset */
+};
 
-
-static PyObject* strdict_get(PyObject* self, PyObject* args)
-{
-	auto [dict, key, default_value] = dictmethod_2args(self, args);
-	if(not dict)
-		return nullptr;
-	assert(key);
-	assert(default_value);
-	return dict->getdefault(key, default_value);
-}
-
-static PyObject* strdict_setdefault(PyObject* self, PyObject* args)
+static PyObject* strdict_chain_new(PyTypeObject* type, PyObject* args, PyObject* kwargs)
 {
-	auto [dict, key, default_value] = dictmethod_2args(self, args);
-	if(not dict)
+	if(kwargs and (PyDict_Size(kwargs) > 0))
+	{
+		PyErr_SetString(PyExc_TypeError, "strdict.chain() takes no keyword arguments.");
 		return nullptr;
-	assert(key);
-	assert(default_value);
-	return dict->set(key, default_value, true);
-}
-
-static PyObject* strdict_clear(PyObject* self)
-{
-	auto* dict = to_string_dict(self);
-	if(not dict)
+	}
+	for(Py_ssize_t i = 0; i < PyTuple_GET_SIZE(args); ++i)
+	{
+		PyObject* map = PyTuple_GET_ITEM(args, i);
+		if(not StringDict_Check(map))
+		{
+			PyErr_Format(PyExc_TypeError, "strdict.chain() arguments must be strdict instances, not '%.200s'.", Py_TYPE(map)->tp_name);
+			return nullptr;
+		}
+	}
+	PyObject* self = type->tp_alloc(type, 0);
+	if(not self)
 		return nullptr;
-	dict->clear();
-	Py_RETURN_NONE;
+	auto* chain = static_cast<StringDictChain*>(self);
+	new(&chain->memo) StringDictChain::Memo();
+	Py_INCREF(args);
+	chain->maps = args;
+	try
+	{
+		// -1 is never a valid generation, so the memo starts out stale
+		chain->memo.generations.assign(PyTuple_GET_SIZE(args), std::uint64_t(-1));
+	}
+	catch(const std::bad_alloc&)
+	{
+		Py_DECREF(self);
+		PyErr_SetString(PyExc_MemoryError, "Allocation failed while creating strdict.chain instance.");
+		return nullptr;
+	}
+	return self;
 }
 
-static PyObject* strdict_pop(PyObject* self, PyObject* args)
+static int strdict_chain_tp_clear(PyObject* self)
 {
-	auto [dict, key, default_value] = dictmethod_2args(self, args, false);
-	if(not dict)
-		return nullptr;
-	return dict->pop(key, default_value);
+	auto* chain = static_cast<StringDictChain*>(self);
+	chain->memo.slots.fill(StringDictChain::MemoSlot{});
+	// keep 'maps' a tuple; the memo generations must match its size
+	if(chain->maps and PyTuple_GET_SIZE(chain->maps))
+	{
+		PyObject* maps = chain->maps;
+		chain->maps = PyTuple_New(0);
+		chain->memo.generations.clear();
+		Py_DECREF(maps);
+	}
+	return 0;
 }
 
-static PyObject* strdict_popitem(PyObject* self)
+static void strdict_chain_dealloc(PyObject* self)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return nullptr;
-	return dict->popitem();
+	PyObject_GC_UnTrack(self);
+	auto* chain = static_cast<StringDictChain*>(self);
+	Py_XDECREF(chain->maps);
+	chain->memo.~Memo();
+	Py_TYPE(self)->tp_free(self);
 }
 
-static int strdict_tp_clear(PyObject *op)
+static int strdict_chain_traverse(PyObject* self, visitproc visit, void* arg)
 {
-	PyObject* obj = strdict_clear(op);
-	if(not obj)
-		return -1;
+	Py_VISIT(static_cast<StringDictChain*>(self)->maps);
 	return 0;
 }
 
-void strdict_dealloc(PyObject* self)
+static Py_ssize_t strdict_chain_len(PyObject* self)
 {
-	// TODO: Do *I* have to untrack this?  I think so, but I'm not sure.
-	PyObject_GC_UnTrack(self);
-	Py_TRASHCAN_SAFE_BEGIN(self)
-	StringDict* dict = static_cast<StringDict*>(self);
-	dict->clear();
-	dict->~StringDict();
-	Py_TYPE(self)->tp_free(self);
-	Py_TRASHCAN_SAFE_END(self)
+	Py_ssize_t count = 0;
+	int err = static_cast<StringDictChain*>(self)->visit_keys([&](StringDict&, const Entry&) {
+		++count;
+		return false;
+	});
+	return (err < 0) ? -1 : count;
 }
 
-static PyObject* strdict_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+static PyObject* strdict_chain_subscript(PyObject* self, PyObject* key)
 {
-	assert(args);
-	assert(type);
-	assert(type->tp_alloc);
-	assert(PyType_Check(type));
-	PyObject* self = type->tp_alloc(type, 0);
-	if(not self)
-		return nullptr;
-	if(not StringDict::try_default_construct(static_cast<StringDict*>(self)))
-	{
-		assert(type->tp_dealloc != nullptr);
-		Py_DECREF(self);
-		return nullptr;
-	}
-	assert(Py_REFCNT(self));
-	assert(static_cast<StringDict*>(self)->size() == 0);
-	assert(static_cast<StringDict*>(self)->bucket_count() == 8);
-	// PyObject_GC_Track(self);
-	return self;
+	PyObject* value = static_cast<StringDictChain*>(self)->lookup(key);
+	if((not value) and (not PyErr_Occurred()))
+		PyErr_SetObject(PyExc_KeyError, StringDictKey_Unwrap(key));
+	return value;
 }
 
-static int strdict_init(PyObject* self, PyObject* args, PyObject* kwargs)
+// Like ChainMap, changes only go to the first map.
+static int strdict_chain_assign_subscript(PyObject* self, PyObject* key, PyObject* value)
 {
-	assert(PyTuple_Check(args));
-	Py_ssize_t argc = PyTuple_GET_SIZE(args);
-	if(argc == 0)
-	{
-		
-		assert((not kwargs) or PyDict_Check(kwargs));
-		if(kwargs and PyDict_Size(kwargs) != 0)
-		{
-			return static_cast<StringDict*>(self)->update_from_kwargs(kwargs);
-		}
-		else
-			return 0;
-	}
-	else if(argc > 1)
+	auto* chain = static_cast<StringDictChain*>(self);
+	if(chain->map_count() == 0)
 	{
-		PyErr_SetString(PyExc_TypeError, "strdict.__init__() only takes a single positional argument, but got more than one.");
+		PyErr_SetString(PyExc_KeyError, "strdict.chain has no maps to modify.");
 		return -1;
 	}
-	else
-	{
-		return static_cast<StringDict*>(self)->update_from_object(PyTuple_GET_ITEM(args, 0));
-	}
+	if(value)
+		return chain->map_at(0)->assign(key, value);
+	return chain->map_at(0)->remove(key);
 }
 
-static PyObject* strdict_copy(PyObject* self)
+static int strdict_chain_contains(PyObject* self, PyObject* key)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return nullptr;
-
-	PythonObject args(PyTuple_New(0));
-	if(not args)
-		return nullptr;
+	const auto [ki, meta_] = make_key_info(key);
+	if(not meta_)
+		return -1;
+	return bool(static_cast<StringDictChain*>(self)->find(ki).second);
+}
 
-	PythonObject kwargs(PyDict_New());
-	if(not kwargs)
-		return nullptr;
-	
-	PythonObject new_dict(strdict_new((PyTypeObject*)(StringDict_GetType()), args, kwargs));
-	if(not new_dict)
+static PyObject* strdict_chain_get(PyObject* self, PyObject* const* args, Py_ssize_t nargs)
+{
+	if((nargs < 1) or (nargs > 2))
+	{
+		PyErr_Format(PyExc_TypeError, "get expected 1 or 2 arguments, got %zd.", nargs);
 		return nullptr;
+	}
+	PyObject* value = static_cast<StringDictChain*>(self)->lookup(args[0]);
+	if(value or PyErr_Occurred())
+		return value;
+	PyObject* default_value = (nargs > 1) ? args[1] : Py_None;
+	Py_INCREF(default_value);
+	return default_value;
+}
 
-	auto err = dict->make_copy(*static_cast<StringDict*>(new_dict.get()));
-	if(err)
-		return nullptr;
-	return new_dict.release();
+static PyObject* strdict_chain_keys(PyObject* self)
+{
+	return static_cast<StringDictChain*>(self)->make_itemlist([](StringDict& dict, const Entry& ent) { 
+		return dict.key_of(ent); 
+	});
 }
 
-static int strdict_traverse(PyObject* self, visitproc visit, void *arg)
+static PyObject* strdict_chain_values(PyObject* self)
 {
-	auto* dict = to_string_dict(self);
-	if(not dict)
-		return -1;
-	return dict->gc_traverse(visit, arg);
+	return static_cast<StringDictChain*>(self)->make_itemlist([](StringDict& dict, const Entry& ent) { 
+		return dict.value_of(ent); 
+	});
 }
 
+static PyObject* strdict_chain_items(PyObject* self)
+{
+	return static_cast<StringDictChain*>(self)->make_itemlist([](StringDict& dict, const Entry& ent) { 
+		return dict.item_of(ent); 
+	});
+}
 
+static PyObject* strdict_chain_get_maps(PyObject* self, void* /* unused */)
+{
+	PyObject* maps = static_cast<StringDictChain*>(self)->maps;
+	Py_INCREF(maps);
+	return maps;
+}
 
+static PyObject* strdict_chain_repr(PyObject* self)
+{
+	PyObject* maps = static_cast<StringDictChain*>(self)->maps;
+	if(PyTuple_GET_SIZE(maps) == 0)
+		return PyUnicode_FromString("strdict.chain()");
+	PythonObject sep(PyUnicode_FromString(", "));
+	if(not sep)
+		return nullptr;
+	int status = Py_ReprEnter(self);
+	if(status != 0)
+		return (status > 0) ? PyUnicode_FromString("strdict.chain(...)") : nullptr;
+	auto repr_guard = make_scope_guard([&](){ Py_ReprLeave(self); });
+	PythonObject reprs(PyList_New(PyTuple_GET_SIZE(maps)));
+	if(not reprs)
+		return nullptr;
+	for(Py_ssize_t i = 0; i < PyTuple_GET_SIZE(maps); ++i)
+	{
+		PyObject* map_repr = PyObject_Repr(PyTuple_GET_ITEM(maps, i));
+		if(not map_repr)
+			return nullptr;
+		PyList_SET_ITEM(reprs.get(), i, map_repr);
+	}
+	PythonObject joined(PyUnicode_Join(sep.get(), reprs.get()));
+	if(not joined)
+		return nullptr;
+	return PyUnicode_FromFormat("strdict.chain(%U)", joined.get());
+}
 
-static PySequenceMethods strdict_as_sequence = {
-    0,                          /* sq_length */
-    0,                          /* sq_concat */
-    0,                          /* sq_repeat */
-    0,                          /* sq_item */
-    0,                          /* sq_slice */
-    0,                          /* sq_ass_item */
-    0,                          /* sq_ass_slice */
-    strdict_contains,           /* sq_contains */
-    0,                          /* sq_inplace_concat */
-    0,                          /* sq_inplace_repeat */
+static PyMappingMethods strdict_chain_as_mapping = {
+	strdict_chain_len,                 /* mp_length */
+	strdict_chain_subscript,           /* mp_subscript */
+	strdict_chain_assign_subscript,    /* mp_ass_subscript */
 };
 
-
-static PyMappingMethods strdict_as_mapping = {
-    (lenfunc)strdict_length, /*mp_length*/
-    (binaryfunc)strdict_subscript, /*mp_subscript*/
-    (objobjargproc)strdict_assign_subscript, /*mp_ass_subscript*/
+static PySequenceMethods strdict_chain_as_sequence = {
+	0,                                 /* sq_length */
+	0,                                 /* sq_concat */
+	0,                                 /* sq_repeat */
+	0,                                 /* sq_item */
+	0,                                 /* sq_slice */
+	0,                                 /* sq_ass_item */
+	0,                                 /* sq_ass_slice */
+	strdict_chain_contains,            /* sq_contains */
+	0,                                 /* sq_inplace_concat */
+	0,                                 /* sq_inplace_repeat */
 };
 
-#include "StringDict_Docs.h"
-
-static PyMethodDef strdict_methods[] = {
-    {"__contains__", (PyCFunction)strdict___contains__, METH_O|METH_COEXIST,          strdict___contains____doc__},
-    {"__getitem__",  (PyCFunction)strdict_subscript,    METH_O | METH_COEXIST,        getitem__doc__},
-    {"__sizeof__",   (PyCFunction)strdict_sizeof,       METH_NOARGS,                  sizeof__doc__},
-    {"get",          (PyCFunction)strdict_get,          METH_VARARGS,                 strdict_get__doc__},
-    {"setdefault",   (PyCFunction)strdict_setdefault,   METH_VARARGS,                 strdict_setdefault__doc__},
-    {"pop",          (PyCFunction)strdict_pop,          METH_VARARGS,                 pop__doc__},
-    {"popitem",      (PyCFunction)strdict_popitem,      METH_NOARGS,                  popitem__doc__},
-    {"keys",         (PyCFunction)strdict_keys,         METH_NOARGS,                  keys__doc__},
-    {"items",        (PyCFunction)strdict_items,        METH_NOARGS,                  items__doc__},
-    {"values",       (PyCFunction)strdict_values,       METH_NOARGS,                  values__doc__},
-    {"update",       (PyCFunction)strdict_update,       METH_VARARGS | METH_KEYWORDS, update__doc__},
-    {"clear",        (PyCFunction)strdict_clear,        METH_NOARGS,                  clear__doc__},
-    {"copy",         (PyCFunction)strdict_copy,         METH_NOARGS,                  copy__doc__},
-    {NULL,           NULL}   /* sentinel */
+static PyMethodDef strdict_chain_methods[] = {
+    {"get",          (PyCFunction)strdict_chain_get,    METH_FASTCALL,                strdict_chain_get__doc__},
+    {"keys",         (PyCFunction)strdict_chain_keys,   METH_NOARGS,                  strdict_chain_keys__doc__},
+    {"values",       (PyCFunction)strdict_chain_values, METH_NOARGS,                  strdict_chain_values__doc__},
+    {"items",        (PyCFunction)strdict_chain_items,  METH_NOARGS,                  strdict_chain_items__doc__},
+    {NULL,	NULL},
 };
 
-PyObject* test_alloc(PyTypeObject *type, Py_ssize_t nitems)
-{
-	assert(nitems == 0);
-	return PyObject_GC_New(StringDict, type);
-}
+static PyGetSetDef strdict_chain_getset[] = {
+    {"maps", strdict_chain_get_maps, nullptr, strdict_chain_maps__doc__},
+    {NULL}   /* sentinel */
+};
 
+PyTypeObject StringDictChain_Type{
+	PyVarObject_HEAD_INIT(nullptr, 0)
+	"StringDict.strdict_chain",
+	sizeof(StringDictChain),
+	0,
+	(destructor)strdict_chain_dealloc,                   /* tp_dealloc */
+	0,                                                   /* tp_print */
+	0,                                                   /* tp_getattr */
+	0,                                                   /* tp_setattr */
+	0,                                                   /* tp_as_async */
+	(reprfunc)strdict_chain_repr,                        /* tp_repr */
+	0,                                                   /* tp_as_number */
+	&strdict_chain_as_sequence,                          /* tp_as_sequence */
+	&strdict_chain_as_mapping,                           /* tp_as_mapping */
+	PyObject_HashNotImplemented,                         /* tp_hash */
+	0,                                                   /* tp_call */
+	0,                                                   /* tp_str */
+	PyObject_GenericGetAttr,                             /* tp_getattro */
+	0,                                                   /* tp_setattro */
+	0,                                                   /* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,             /* tp_flags */
+	strdict_chain_doc,                                   /* tp_doc */
+	strdict_chain_traverse,                              /* tp_traverse */
+	strdict_chain_tp_clear,                              /* tp_clear */
+	0,                                                   /* tp_richcompare */
+	0,                                                   /* tp_weaklistoffset */
+	0,                                                   /* tp_iter */
+	0,                                                   /* tp_iternext */
+	strdict_chain_methods,                               /* tp_methods */
+	0,                                                   /* tp_members */
+	strdict_chain_getset,                                /* tp_getset */
+	0,                                                   /* tp_base */
+	0,                                                   /* tp_dict */
+	0,                                                   /* tp_descr_get */
+	0,                                                   /* tp_descr_set */
+	0,                                                   /* tp_dictoffset */
+	0,                                                   /* tp_init */
+	0,                                                   /* tp_alloc */
+	strdict_chain_new,                                   /* tp_new */
+	0,                                                   /* tp_free */
+};
 
-PyTypeObject StringDict_Type{
+PyTypeObject StringDefaultDict_Type{
 	PyVarObject_HEAD_INIT(nullptr, 0)
-	"strdict",
+	"StringDict.strdefaultdict",
 	sizeof(StringDict),
 	0,
 	(destructor)strdict_dealloc,                         /* tp_dealloc */
@@ -1733,10 +5021,10 @@ PyTypeObject StringDict_Type{
 	0,                                                   /* tp_getattr */
 	0,                                                   /* tp_setattr */
 	0,                                                   /* tp_as_async */
-	(reprfunc)strdict_repr,                   	     /* tp_repr */
+	(reprfunc)strdefaultdict_repr,                       /* tp_repr */
 	0,                                                   /* tp_as_number */
-	&strdict_as_sequence,                                /* tp_as_sequence */
-	&strdict_as_mapping,                                 /* tp_as_mapping */
+	0,                                                   /* tp_as_sequence */
+	0,                                                   /* tp_as_mapping */
 	PyObject_HashNotImplemented,                         /* tp_hash */
 	0,                                                   /* tp_call */
 	0,                                                   /* tp_str */
@@ -1745,41 +5033,27 @@ PyTypeObject StringDict_Type{
 	0,                                                   /* tp_as_buffer */
 	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | 
 		Py_TPFLAGS_BASETYPE,                         /* tp_flags */
-	strdict_doc,                                         /* tp_doc */
+	strdefaultdict_doc,                                  /* tp_doc */
 	strdict_traverse,                                    /* tp_traverse */
 	strdict_tp_clear,                                    /* tp_clear */
 	strdict_richcompare,                                 /* tp_richcompare */
 	0,                                                   /* tp_weaklistoffset */
 	0,                                                   /* tp_iter */
 	0,                                                   /* tp_iternext */
-	strdict_methods,                                     /* tp_methods */
+	strdefaultdict_methods,                              /* tp_methods */
 	0,                                                   /* tp_members */
-	0,                                                   /* tp_getset */
-	0,                                                   /* tp_base */
+	strdefaultdict_getset,                               /* tp_getset */
+	&StringDict_Type,                                    /* tp_base */
 	0,                                                   /* tp_dict */
 	0,                                                   /* tp_descr_get */
 	0,                                                   /* tp_descr_set */
 	0,                                                   /* tp_dictoffset */
-	strdict_init,                                        /* tp_init */
-	0,//PyType_GenericAlloc,                                 /* tp_alloc */
-	strdict_new,                                         /* tp_new */
-	0,//PyObject_GC_Del,                                     /* tp_free */
-	// 0,                                                /* tp_is_gc */ 
-	// 0,                                                /* tp_bases */
-	// 0,                                                /* tp_mro */
-	// 0,                                                /* tp_cache */
-	// 0,                                                /* tp_subclasses */
-	// 0,                                                /* tp_weaklist */
-	// 0,                                                /* tp_del */
-	// 0,                                                /* tp_version_tag */
-	// 0                                                 /* tp_finalize */
+	strdefaultdict_init,                                 /* tp_init */
+	0,                                                   /* tp_alloc */
+	0,                                                   /* tp_new */
+	0,                                                   /* tp_free */
 };
 
-static PyObject* StringDict_GetType()
-{
-	return (PyObject*)(&StringDict_Type);
-}
-
 
 
 
@@ -1802,20 +5076,180 @@ static PyModuleDef StringDictmodule = {
 	nullptr
 };
 
+static int strdict_capi_check(PyObject* obj)
+{
+	return StringDict_Check(obj);
+}
+
+static uint64_t strdict_capi_get_version(PyObject* dict)
+{
+	assert(StringDict_Check(dict));
+	return static_cast<StringDict*>(dict)->get_version();
+}
+
+static Py_ssize_t strdict_capi_size(PyObject* dict)
+{
+	assert(StringDict_Check(dict));
+	return static_cast<StringDict*>(dict)->size();
+}
+
+static int strdict_capi_reserve(PyObject* dict, Py_ssize_t count)
+{
+	assert(StringDict_Check(dict));
+	if(count < 0)
+	{
+		PyErr_SetString(PyExc_ValueError, "Can't reserve space for a negative number of strdict keys.");
+		return -1;
+	}
+	return static_cast<StringDict*>(dict)->reserve_space(count);
+}
+
+static bool strdict_capi_check_key(Py_ssize_t length, DataKind kind)
+{
+	if((kind < PY_BYTES) or (kind > PY_UCS4))
+	{
+		PyErr_Format(PyExc_ValueError, "Invalid DataKind %d for a strdict key.", static_cast<int>(kind));
+		return false;
+	}
+	if(length < 0)
+	{
+		PyErr_SetString(PyExc_ValueError, "strdict key length must not be negative.");
+		return false;
+	}
+	return true;
+}
+
+// KeyInfo for key data of any kind, narrowed into 'scratch' like 
+// make_str_slice_key_info() does.
+static KeyInfo strdict_capi_key_info(const void* data, Py_ssize_t length, DataKind kind, std::vector<unsigned char>& scratch)
+{
+	if(kind <= PY_UCS1)
+		return make_key_info(static_cast<const unsigned char*>(data), length, kind);
+	return make_str_slice_key_info(data, length, kind, scratch);
+}
+
+static int strdict_capi_lookup(PyObject* dict, const void* data, Py_ssize_t length, DataKind kind, PyObject** value)
+{
+	assert(StringDict_Check(dict));
+	if(not strdict_capi_check_key(length, kind))
+		return -1;
+	std::vector<unsigned char> scratch;
+	return static_cast<StringDict*>(dict)->lookup_data(strdict_capi_key_info(data, length, kind, scratch), value);
+}
+
+static Py_hash_t strdict_capi_hash(const void* data, Py_ssize_t length, DataKind kind)
+{
+	if(not strdict_capi_check_key(length, kind))
+		return -1;
+	return DataKind_Hash(kind, data, length);
+}
+
+static int strdict_capi_lookup_hashed(PyObject* dict, const void* data, Py_ssize_t length, DataKind kind, Py_hash_t hash, PyObject** value)
+{
+	assert(StringDict_Check(dict));
+	if(not strdict_capi_check_key(length, kind))
+		return -1;
+	KeyInfo ki;
+	ki.key = nullptr;
+	ki.hash = hash;
+	ki.data = static_cast<const unsigned char*>(data);
+	ki.data_size = length;
+	ki.kind = kind;
+	return static_cast<StringDict*>(dict)->lookup_data(ki, value);
+}
+
+static int strdict_capi_set_item(PyObject* dict, const void* data, Py_ssize_t length, DataKind kind, PyObject* value)
+{
+	assert(StringDict_Check(dict));
+	if(not strdict_capi_check_key(length, kind))
+		return -1;
+	std::vector<unsigned char> scratch;
+	return static_cast<StringDict*>(dict)->assign_data(strdict_capi_key_info(data, length, kind, scratch), value);
+}
+
+static int strdict_capi_del_item(PyObject* dict, const void* data, Py_ssize_t length, DataKind kind)
+{
+	assert(StringDict_Check(dict));
+	if(not strdict_capi_check_key(length, kind))
+		return -1;
+	std::vector<unsigned char> scratch;
+	return static_cast<StringDict*>(dict)->remove_data(strdict_capi_key_info(data, length, kind, scratch));
+}
+
+static int strdict_capi_next(PyObject* dict, Py_ssize_t* pos, PyObject** key, PyObject** value)
+{
+	assert(StringDict_Check(dict));
+	return static_cast<StringDict*>(dict)->next_entry(pos, key, value);
+}
+
+static const StringDict_CAPI strdict_capi = {
+	STRING_DICT_CAPI_VERSION,
+	strdict_capi_check,
+	strdict_capi_get_version,
+	strdict_capi_size,
+	strdict_capi_reserve,
+	strdict_capi_lookup,
+	strdict_capi_hash,
+	strdict_capi_lookup_hashed,
+	strdict_capi_set_item,
+	strdict_capi_del_item,
+	strdict_capi_next,
+};
 
 PyMODINIT_FUNC
 PyInit_StringDict(void)
 {
 
+#if PY_VERSION_HEX >= 0x03090000
+	StringDict_Type.tp_vectorcall = strdict_vectorcall;
+#endif
 	if (PyType_Ready(&StringDict_Type) < 0)
 		return NULL;
 
+	if (PyType_Ready(&StringDefaultDict_Type) < 0)
+		return NULL;
+
+	if (PyType_Ready(&MappedStringDict_Type) < 0)
+		return NULL;
+
+	if (PyType_Ready(&StringDictKey_Type) < 0)
+		return NULL;
+
+	if (PyType_Ready(&StringDictChain_Type) < 0)
+		return NULL;
+
+	if (PyType_Ready(&StringDictSlot_Type) < 0)
+		return NULL;
+
+	// strdict.Key
+	if (PyDict_SetItemString(StringDict_Type.tp_dict, "Key", (PyObject*)&StringDictKey_Type) < 0)
+		return NULL;
+	// strdict.chain
+	if (PyDict_SetItemString(StringDict_Type.tp_dict, "chain", (PyObject*)&StringDictChain_Type) < 0)
+		return NULL;
+	PyType_Modified(&StringDict_Type);
+
 	PyObject* m = PyModule_Create(&StringDictmodule);
 	if (m == NULL)
 		return NULL;
 
 	Py_INCREF(&StringDict_Type);
 	PyModule_AddObject(m, "strdict", (PyObject *)&StringDict_Type);
+	Py_INCREF(&StringDefaultDict_Type);
+	PyModule_AddObject(m, "strdefaultdict", (PyObject *)&StringDefaultDict_Type);
+	Py_INCREF(&MappedStringDict_Type);
+	PyModule_AddObject(m, "mapped_strdict", (PyObject *)&MappedStringDict_Type);
+	Py_INCREF(&StringDictKey_Type);
+	PyModule_AddObject(m, "strdict_key", (PyObject *)&StringDictKey_Type);
+	Py_INCREF(&StringDictChain_Type);
+	PyModule_AddObject(m, "strdict_chain", (PyObject *)&StringDictChain_Type);
+	PyObject* capi = PyCapsule_New(const_cast<StringDict_CAPI*>(&strdict_capi), STRING_DICT_CAPSULE_NAME, nullptr);
+	if ((capi == NULL) or (PyModule_AddObject(m, "_C_API", capi) < 0))
+	{
+		Py_XDECREF(capi);
+		Py_DECREF(m);
+		return NULL;
+	}
 	return m;
 }
 
@@ -32,6 +32,18 @@ static PyObject* tag_pyobject(PyObject* obj, uintptr_t tag)
 }
 
 typedef unsigned char uchar_t;
+
+// Flag added to the kind of str keys that are stored as UTF-8 by 
+// Entry_FromKeyInfoCompact().  It needs a third tag bit, so keys are only
+// encoded when the kind is stored in the data or the pointers have one to 
+// spare.
+#define ENTRY_UTF8_FLAG ((uchar_t)0x04)
+
+static int Entry_CanEncode(void)
+{
+	return (pyobject_pointer_lowbits == 0) || (pyobject_pointer_lowbits >= 3);
+}
+
 struct string_dict_entry
 {
 	// cached bytes() or str() (PyByteObject or PyUnicodeObject)
@@ -62,7 +74,7 @@ static uintptr_t Entry_KeyTag(const StringDictEntry* self)
 }
 
 
-static DataKind Entry_Kind(const StringDictEntry* self)
+static uchar_t Entry_KindTag(const StringDictEntry* self)
 {
 	uchar_t kind = 0;
 	// this should be constant-folded by the compiler
@@ -80,14 +92,29 @@ static DataKind Entry_Kind(const StringDictEntry* self)
 	case 2:
 	case 3:
 	case 4:
-		assert(Entry_KeyTag(self) < 4);
+		assert(Entry_KeyTag(self) < 8);
 		assert(Entry_ValueTag(self) == 0);
 		kind = Entry_KeyTag(self);
 		break;
 	default:
 		assert(0);
 	};
-	return (DataKind)kind;
+	return kind;
+}
+
+static DataKind Entry_Kind(const StringDictEntry* self)
+{
+	return (DataKind)(Entry_KindTag(self) & ~ENTRY_UTF8_FLAG);
+}
+
+DataKind Entry_KeyKind(const StringDictEntry* self)
+{
+	return Entry_Kind(self);
+}
+
+int Entry_IsEncoded(const StringDictEntry* self)
+{
+	return Entry_CanEncode() && (Entry_KindTag(self) & ENTRY_UTF8_FLAG);
 }
 
 static int Entry_SetKind(StringDictEntry* self, DataKind kind)
@@ -125,6 +152,7 @@ static const uchar_t* Entry_DataAndSize(const StringDictEntry* self, Py_ssize_t*
 {
 	assert(self);
 	assert(Entry_Kind(self) == kind);
+	assert(!Entry_IsEncoded(self));
 	const uchar_t* data_header = self->data + (pyobject_pointer_lowbits == 0);
 	size_t bytecount = 0;
 	*size = leb128_decode(data_header, &bytecount);
@@ -230,6 +258,179 @@ StringDictEntry* Entry_FromKeyInfo(const KeyInfo* ki, PyObject* value)
 	return ent;
 }
 
+static Py_UCS4 KeyInfo_CodePoint(const KeyInfo* ki, Py_ssize_t index)
+{
+	switch(ki->kind)
+	{
+	case PY_UCS2:
+		return ((const Py_UCS2*)ki->data)[index];
+	case PY_UCS4:
+		return ((const Py_UCS4*)ki->data)[index];
+	default:
+		return ki->data[index];
+	}
+}
+
+static Py_ssize_t UTF8_Length(const KeyInfo* ki)
+{
+	Py_ssize_t len = 0;
+	for(Py_ssize_t i = 0; i < ki->data_size; ++i)
+	{
+		Py_UCS4 ch = KeyInfo_CodePoint(ki, i);
+		len += (ch < 0x80) ? 1 : (ch < 0x800) ? 2 : (ch < 0x10000) ? 3 : 4;
+	}
+	return len;
+}
+
+// Lone surrogates are encoded like any other code point.
+static uchar_t* UTF8_Encode(uchar_t* out, Py_UCS4 ch)
+{
+	if(ch < 0x80)
+	{
+		*out++ = (uchar_t)ch;
+	}
+	else if(ch < 0x800)
+	{
+		*out++ = (uchar_t)(0xC0 | (ch >> 6));
+		*out++ = (uchar_t)(0x80 | (ch & 0x3F));
+	}
+	else if(ch < 0x10000)
+	{
+		*out++ = (uchar_t)(0xE0 | (ch >> 12));
+		*out++ = (uchar_t)(0x80 | ((ch >> 6) & 0x3F));
+		*out++ = (uchar_t)(0x80 | (ch & 0x3F));
+	}
+	else
+	{
+		*out++ = (uchar_t)(0xF0 | (ch >> 18));
+		*out++ = (uchar_t)(0x80 | ((ch >> 12) & 0x3F));
+		*out++ = (uchar_t)(0x80 | ((ch >> 6) & 0x3F));
+		*out++ = (uchar_t)(0x80 | (ch & 0x3F));
+	}
+	return out;
+}
+
+// Decode one code point written by UTF8_Encode().
+static const uchar_t* UTF8_Decode(const uchar_t* pos, Py_UCS4* ch)
+{
+	uchar_t lead = *pos++;
+	if(lead < 0x80)
+	{
+		*ch = lead;
+		return pos;
+	}
+	int trailing = (lead >= 0xF0) ? 3 : (lead >= 0xE0) ? 2 : 1;
+	Py_UCS4 value = lead & (0x3F >> trailing);
+	for(int i = 0; i < trailing; ++i)
+		value = (value << 6) | (*pos++ & 0x3F);
+	*ch = value;
+	return pos;
+}
+
+StringDictEntry* Entry_FromKeyInfoCompact(const KeyInfo* ki, PyObject* value)
+{
+	assert(value);
+	KeyInfo uncached = *ki;
+	uncached.key = NULL;
+	if(!Entry_CanEncode() || (ki->kind < PY_UCS2))
+		return Entry_FromKeyInfo(&uncached, value);
+	Py_ssize_t utf8_len = UTF8_Length(ki);
+	if(utf8_len >= ki->data_size * DataKind_ItemSize(ki->kind))
+		return Entry_FromKeyInfo(&uncached, value);
+
+	Leb128Encoding enc = leb128_encode(utf8_len);
+	uchar_t* mem = Entry_Alloc(enc.len, utf8_len, 1);
+	if(!mem)
+	{
+		PyErr_SetString(PyExc_MemoryError, "Failed to allocate new entry for StringDict.");
+		return NULL;
+	}
+	Py_INCREF(value);
+	StringDictEntry* ent = (StringDictEntry*)mem;
+	ent->cached_key = NULL;
+	ent->value = value;
+	uchar_t* data = mem + offsetof(StringDictEntry, data);
+	uchar_t kind_tag = (uchar_t)ki->kind | ENTRY_UTF8_FLAG;
+	if(pyobject_pointer_lowbits == 0)
+		*data++ = kind_tag;
+	else
+		ent->cached_key = tag_pyobject(NULL, kind_tag);
+	memcpy(data, enc.encoding, enc.len);
+	data += enc.len;
+	for(Py_ssize_t i = 0; i < ki->data_size; ++i)
+		data = UTF8_Encode(data, KeyInfo_CodePoint(ki, i));
+	*data = '\0';
+	assert(Entry_IsEncoded(ent));
+	assert(Entry_Kind(ent) == ki->kind);
+	return ent;
+}
+
+// The UTF-8 data of an encoded entry.
+static const uchar_t* Entry_EncodedData(const StringDictEntry* self, const uchar_t** end)
+{
+	assert(Entry_IsEncoded(self));
+	const uchar_t* data_header = self->data + (pyobject_pointer_lowbits == 0);
+	size_t bytecount = 0;
+	Py_ssize_t len = leb128_decode(data_header, &bytecount);
+	assert(bytecount);
+	*end = data_header + bytecount + len;
+	return data_header + bytecount;
+}
+
+Py_ssize_t Entry_KeyLength(const StringDictEntry* self)
+{
+	if(!Entry_IsEncoded(self))
+	{
+		Py_ssize_t len;
+		Entry_DataAndSize(self, &len, Entry_Kind(self));
+		return len;
+	}
+	const uchar_t* end;
+	const uchar_t* pos = Entry_EncodedData(self, &end);
+	Py_ssize_t len = 0;
+	for(; pos < end; ++pos)
+		len += ((*pos & 0xC0) != 0x80);
+	return len;
+}
+
+// New str for an encoded entry.
+static PyObject* Entry_DecodeKey(const StringDictEntry* self)
+{
+	DataKind kind = Entry_Kind(self);
+	assert((kind == PY_UCS2) || (kind == PY_UCS4));
+	PyObject* key = PyUnicode_New(Entry_KeyLength(self), (kind == PY_UCS2) ? 0xFFFF : 0x10FFFF);
+	if(!key)
+		return NULL;
+	const uchar_t* end;
+	const uchar_t* pos = Entry_EncodedData(self, &end);
+	void* out = PyUnicode_DATA(key);
+	for(Py_ssize_t i = 0; pos < end; ++i)
+	{
+		Py_UCS4 ch;
+		pos = UTF8_Decode(pos, &ch);
+		if(kind == PY_UCS2)
+			((Py_UCS2*)out)[i] = (Py_UCS2)ch;
+		else
+			((Py_UCS4*)out)[i] = ch;
+	}
+	return key;
+}
+
+static int Entry_EncodedMatches(const StringDictEntry* self, const KeyInfo* ki)
+{
+	const uchar_t* end;
+	const uchar_t* pos = Entry_EncodedData(self, &end);
+	Py_ssize_t i = 0;
+	for(; (pos < end) && (i < ki->data_size); ++i)
+	{
+		Py_UCS4 ch;
+		pos = UTF8_Decode(pos, &ch);
+		if(ch != KeyInfo_CodePoint(ki, i))
+			return 0;
+	}
+	return (pos == end) && (i == ki->data_size);
+}
+
 static Py_ssize_t Entry_Data(const StringDictEntry* self, const uchar_t** begin, const uchar_t** end, DataKind kind)
 {
 	assert(Entry_Kind(self) == kind);
@@ -247,26 +448,77 @@ PyObject* Entry_AsTuple(const StringDictEntry* self)
 	return PyTuple_Pack(2, Entry_Key(self), Entry_Value(self));
 }
 
-int Entry_Matches(const StringDictEntry* self, const KeyInfo* ki)
+// Entry_Matches() for keys of a known kind.  Only called with a constant 
+// 'kind', so that the kind check and the item size fold into constants and 
+// each kind gets its own comparison loop.
+static inline int Entry_MatchesKind(const StringDictEntry* self, const KeyInfo* ki, DataKind kind)
 {
-	if(ki->key == Entry_GetKey(self))
+	assert(ki->kind == kind);
+	// keys that weren't cached (and buffer keys, which can't be) are null
+	if(ki->key && (ki->key == Entry_GetKey(self)))
 		return 1;
-	DataKind kind = Entry_Kind(self);
-	if(ki->kind != kind)
+	uchar_t tag = Entry_KindTag(self);
+	if(tag != (uchar_t)kind)
 	{
+		if((kind >= PY_UCS2) && Entry_CanEncode() && (tag == ((uchar_t)kind | ENTRY_UTF8_FLAG)))
+			return Entry_EncodedMatches(self, ki);
 		return 0;
 	}
-	const uchar_t* begin;
-	const uchar_t* end;
-	Py_ssize_t len = Entry_Data(self, &begin, &end, kind);
+	const uchar_t* data = self->data + (pyobject_pointer_lowbits == 0);
+	size_t bytecount = 0;
+	Py_ssize_t len = leb128_decode(data, &bytecount);
 	if(ki->data_size != len)
 		return 0;
+	const size_t item_size = (kind == PY_UCS4) ? 4 : (kind == PY_UCS2) ? 2 : 1;
+	return memcmp(ki->data, data + bytecount, len * item_size) == 0;
+}
 
-	return memcmp(ki->data, begin, end - begin) == 0;
+static int Entry_MatchesBytes(const StringDictEntry* self, const KeyInfo* ki)
+{
+	return Entry_MatchesKind(self, ki, PY_BYTES);
+}
+
+static int Entry_MatchesUCS1(const StringDictEntry* self, const KeyInfo* ki)
+{
+	return Entry_MatchesKind(self, ki, PY_UCS1);
+}
+
+static int Entry_MatchesUCS2(const StringDictEntry* self, const KeyInfo* ki)
+{
+	return Entry_MatchesKind(self, ki, PY_UCS2);
+}
+
+static int Entry_MatchesUCS4(const StringDictEntry* self, const KeyInfo* ki)
+{
+	return Entry_MatchesKind(self, ki, PY_UCS4);
+}
+
+EntryMatchFunc Entry_MatchFunction(DataKind kind)
+{
+	switch(kind)
+	{
+	case PY_BYTES:
+		return Entry_MatchesBytes;
+	case PY_UCS1:
+		return Entry_MatchesUCS1;
+	case PY_UCS2:
+		return Entry_MatchesUCS2;
+	case PY_UCS4:
+		return Entry_MatchesUCS4;
+	default:
+		assert(0);
+		return Entry_MatchesBytes;
+	}
+}
+
+int Entry_Matches(const StringDictEntry* self, const KeyInfo* ki)
+{
+	return Entry_MatchFunction(ki->kind)(self, ki);
 }
 
 void Entry_AsKeyInfo(const StringDictEntry* self, KeyInfo* ki)
 {
+	assert(!Entry_IsEncoded(self));
 	DataKind kind = Entry_Kind(self);
 	ki->key = Entry_GetKey(self);
 	const uchar_t* data_end;
@@ -274,7 +526,7 @@ void Entry_AsKeyInfo(const StringDictEntry* self, KeyInfo* ki)
 	ki->kind = kind;
 }
 
-int Entry_WriteRepr(const StringDictEntry* self, _PyUnicodeWriter* writer)
+int Entry_WriteKeyRepr(const StringDictEntry* self, _PyUnicodeWriter* writer)
 {
 	assert(self);
 	assert(writer);
@@ -284,9 +536,8 @@ int Entry_WriteRepr(const StringDictEntry* self, _PyUnicodeWriter* writer)
 	if(0 != _PyUnicodeWriter_WriteASCIIString(writer, "'", 1))
 		return -1;
 
-	if((!key) || kind == PY_BYTES)
+	if(kind == PY_BYTES)
 	{
-		assert(Entry_Kind(self) == PY_BYTES);
 		assert((!key) || PyBytes_Check(key));
 		const uchar_t* first;
 		const uchar_t* last;
@@ -297,14 +548,23 @@ int Entry_WriteRepr(const StringDictEntry* self, _PyUnicodeWriter* writer)
 	}
 	else 
 	{
-		assert(key || PyUnicode_Check(key));
-		if(0 != _PyUnicodeWriter_WriteStr(writer, key))
+		key = Entry_NewKey(self);
+		if(!key)
+			return -1;
+		assert(PyUnicode_Check(key));
+		int errc = _PyUnicodeWriter_WriteStr(writer, key);
+		Py_DECREF(key);
+		if(0 != errc)
 			return -1;
 	}
 	// surrounding quotes for key
-	if(0 != _PyUnicodeWriter_WriteASCIIString(writer, "'", 1))
+	return _PyUnicodeWriter_WriteASCIIString(writer, "'", 1);
+}
+
+int Entry_WriteRepr(const StringDictEntry* self, _PyUnicodeWriter* writer)
+{
+	if(0 != Entry_WriteKeyRepr(self, writer))
 		return -1;
-	
 	if(0 != _PyUnicodeWriter_WriteASCIIString(writer, ": ", 2))
 		return -1;
 	PyObject* value = Entry_GetValue(self);
@@ -321,10 +581,16 @@ int Entry_WriteRepr(const StringDictEntry* self, _PyUnicodeWriter* writer)
 StringDictEntry* Entry_Copy(const StringDictEntry* self)
 {
 	assert(self);
-	DataKind kind = Entry_Kind(self);
-	const uchar_t* first;
 	const uchar_t* last;
-	Entry_Data(self, &first, &last, kind);
+	if(Entry_IsEncoded(self))
+	{
+		Entry_EncodedData(self, &last);
+	}
+	else
+	{
+		const uchar_t* first;
+		Entry_Data(self, &first, &last, Entry_Kind(self));
+	}
 	assert((*(char*)last) == '\0');
 	size_t allocd = ((char*)last - (char*)self) + 1;
 	uchar_t* mem = Entry_RawAlloc(allocd);
@@ -372,24 +638,57 @@ PyObject* Entry_Key(const StringDictEntry* self_)
 			return key;
 	}
 
-	// if the key isn't cached yet, then create a Bytes object for 
+	// if the key isn't cached yet, then create a bytes or str object for 
 	// it and save it in self->cached_key
 	
 	// it's okay I'm a professional...
 	StringDictEntry* self = (StringDictEntry*)self_;
-	// get the data in 'self'
-	assert(Entry_Kind(self) == PY_BYTES);
-	const uchar_t* data_begin;
-	const uchar_t* data_end;
-	Py_ssize_t sz = Entry_Data(self, &data_begin, &data_end, PY_BYTES);
-	assert(sz == (data_end - data_begin));
-	// make the bytes object
-	PyObject* bytes_obj = PyBytes_FromStringAndSize((char*)data_begin, sz);
-	if(!bytes_obj)
+	PyObject* key_obj = Entry_NewKey(self);
+	if(!key_obj)
 		return NULL;
-	assert(PYOBJECT_TAG_(bytes_obj) == 0);
+	assert(PYOBJECT_TAG_(key_obj) == 0);
 
 	uintptr_t tag = Entry_KeyTag(self);
-	self->cached_key = tag_pyobject(bytes_obj, tag);
+	self->cached_key = tag_pyobject(key_obj, tag);
 	return Entry_GetKey(self);
 }
+
+PyObject* Entry_NewKey(const StringDictEntry* self)
+{
+	assert(self);
+	{
+		PyObject* key = Entry_GetKey(self);
+		if(key)
+		{
+			Py_INCREF(key);
+			return key;
+		}
+	}
+	if(Entry_IsEncoded(self))
+		return Entry_DecodeKey(self);
+	// get the data in 'self'
+	DataKind kind = Entry_Kind(self);
+	const uchar_t* data_begin;
+	const uchar_t* data_end;
+	Py_ssize_t sz = Entry_Data(self, &data_begin, &data_end, kind);
+	// make the key object
+	PyObject* key_obj = NULL;
+	switch(kind)
+	{
+	case PY_BYTES:
+		key_obj = PyBytes_FromStringAndSize((char*)data_begin, sz);
+		break;
+	case PY_UCS1:
+		key_obj = PyUnicode_FromKindAndData(PyUnicode_1BYTE_KIND, data_begin, sz);
+		break;
+	case PY_UCS2:
+		key_obj = PyUnicode_FromKindAndData(PyUnicode_2BYTE_KIND, data_begin, sz);
+		break;
+	case PY_UCS4:
+		key_obj = PyUnicode_FromKindAndData(PyUnicode_4BYTE_KIND, data_begin, sz);
+		break;
+	default:
+		assert(0);
+	}
+	return key_obj;
+}